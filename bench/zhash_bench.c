@@ -0,0 +1,446 @@
+// clock_gettime with -std=c11
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 199309L
+#endif
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include "../src/zhash.h"
+#include "../src/zsorted_hash.h"
+
+// built and run by zhash_bench.sh, which also counts allocations on Linux
+// runs each workload on a ZHashTable or a ZSortedHashTable in its own process
+// and prints CSV to stdout: ns/op, latency percentiles, peak RSS and the
+// allocations made by the timed operations (-1 when they are not counted)
+
+#define KEY_COUNT 200000
+#define OP_COUNT 1000000
+#define ZIPF_EXPONENT 0.99
+
+enum BenchTable { BENCH_ZHASH, BENCH_ZSORTED };
+enum BenchOp { BENCH_INSERT, BENCH_GET_HIT, BENCH_GET_MISS, BENCH_CHURN,
+  BENCH_ITERATE };
+
+struct Workload {
+  const char *name;
+  enum BenchTable table;
+  enum BenchOp op;
+  int long_keys;
+  int zipf;
+};
+
+static const struct Workload workloads[] = {
+  { "insert", BENCH_ZHASH, BENCH_INSERT, 0, 0 },
+  { "insert", BENCH_ZHASH, BENCH_INSERT, 1, 0 },
+  { "get_hit", BENCH_ZHASH, BENCH_GET_HIT, 0, 0 },
+  { "get_hit", BENCH_ZHASH, BENCH_GET_HIT, 0, 1 },
+  { "get_hit", BENCH_ZHASH, BENCH_GET_HIT, 1, 0 },
+  { "get_hit", BENCH_ZHASH, BENCH_GET_HIT, 1, 1 },
+  { "get_miss", BENCH_ZHASH, BENCH_GET_MISS, 0, 0 },
+  { "get_miss", BENCH_ZHASH, BENCH_GET_MISS, 1, 0 },
+  { "churn", BENCH_ZHASH, BENCH_CHURN, 0, 0 },
+  { "churn", BENCH_ZHASH, BENCH_CHURN, 0, 1 },
+  { "insert", BENCH_ZSORTED, BENCH_INSERT, 0, 0 },
+  { "get_hit", BENCH_ZSORTED, BENCH_GET_HIT, 0, 1 },
+  { "get_miss", BENCH_ZSORTED, BENCH_GET_MISS, 0, 0 },
+  { "churn", BENCH_ZSORTED, BENCH_CHURN, 0, 1 },
+  { "iterate", BENCH_ZSORTED, BENCH_ITERATE, 0, 0 },
+};
+
+struct Bench {
+  char **keys;
+  char **miss_keys;
+  size_t *indexes;
+  char *in_table;
+  uint64_t *latencies;
+  uint64_t clock_overhead;
+};
+
+#ifdef ZBENCH_WRAP_MALLOC
+// linked with -Wl,--wrap so that calls from zhash.c and zsorted_hash.c come
+// here first
+static int counting;
+static long long alloc_count, free_count, alloc_bytes;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t num, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+void __real_free(void *ptr);
+
+void *__wrap_malloc(size_t size)
+{
+  if (counting) {
+    alloc_count++;
+    alloc_bytes += (long long) size;
+  }
+
+  return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t num, size_t size)
+{
+  if (counting) {
+    alloc_count++;
+    alloc_bytes += (long long) (num * size);
+  }
+
+  return __real_calloc(num, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size)
+{
+  if (counting) {
+    alloc_count++;
+    alloc_bytes += (long long) size;
+  }
+
+  return __real_realloc(ptr, size);
+}
+
+void __wrap_free(void *ptr)
+{
+  if (counting && ptr) free_count++;
+
+  __real_free(ptr);
+}
+
+#define COUNT_ALLOCATIONS(on) (counting = (on))
+#else
+static const long long alloc_count = -1, free_count = -1, alloc_bytes = -1;
+
+#define COUNT_ALLOCATIONS(on) ((void) 0)
+#endif
+
+// xorshift64*
+static uint64_t next_random(uint64_t *state)
+{
+  *state ^= *state >> 12;
+  *state ^= *state << 25;
+  *state ^= *state >> 27;
+
+  return *state * 0x2545f4914f6cdd1dull;
+}
+
+static uint64_t now_ns(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return (uint64_t) ts.tv_sec * 1000000000ull + (uint64_t) ts.tv_nsec;
+}
+
+// keys are unique because they start with their index; miss keys start with
+// '#', which is never used by the other keys
+static char **generate_keys(size_t count, int long_keys, char first,
+    uint64_t *state)
+{
+  char **keys;
+  size_t ii, length, prefix, jj;
+
+  keys = malloc(count * sizeof(char *));
+
+  for (ii = 0; ii < count; ii++) {
+    length = long_keys ? 64 + next_random(state) % 65 :
+      8 + next_random(state) % 9;
+    keys[ii] = malloc(length + 1);
+    prefix = (size_t) snprintf(keys[ii], length + 1, "%c%zx:", first, ii);
+
+    for (jj = prefix; jj < length; jj++) {
+      keys[ii][jj] = 'a' + next_random(state) % 26;
+    }
+    keys[ii][length] = '\0';
+  }
+
+  return keys;
+}
+
+static void free_keys(char **keys, size_t count)
+{
+  size_t ii;
+
+  for (ii = 0; ii < count; ii++) free(keys[ii]);
+
+  free(keys);
+}
+
+// indexes into the keys, either uniform or Zipfian (rank k is drawn with
+// probability proportional to 1 / k^ZIPF_EXPONENT); ranks are shuffled over
+// the keys so that hot keys are spread through the table
+static size_t *generate_indexes(size_t count, int zipf, uint64_t *state)
+{
+  size_t *indexes, *ranks, ii;
+  double *cdf, sum;
+
+  indexes = malloc(count * sizeof(size_t));
+
+  if (!zipf) {
+    for (ii = 0; ii < count; ii++) indexes[ii] = next_random(state) % KEY_COUNT;
+
+    return indexes;
+  }
+
+  cdf = malloc(KEY_COUNT * sizeof(double));
+  ranks = malloc(KEY_COUNT * sizeof(size_t));
+
+  for (sum = 0, ii = 0; ii < KEY_COUNT; ii++) {
+    sum += 1.0 / pow((double) (ii + 1), ZIPF_EXPONENT);
+    cdf[ii] = sum;
+    ranks[ii] = ii;
+  }
+
+  for (ii = KEY_COUNT - 1; ii > 0; ii--) {
+    size_t jj, tmp;
+
+    jj = next_random(state) % (ii + 1);
+    tmp = ranks[ii];
+    ranks[ii] = ranks[jj];
+    ranks[jj] = tmp;
+  }
+
+  for (ii = 0; ii < count; ii++) {
+    double target;
+    size_t low, high;
+
+    target = (double) (next_random(state) >> 11) / 9007199254740992.0 * sum;
+
+    for (low = 0, high = KEY_COUNT - 1; low < high; ) {
+      size_t mid;
+
+      mid = low + (high - low) / 2;
+      if (cdf[mid] < target) low = mid + 1;
+      else high = mid;
+    }
+
+    indexes[ii] = ranks[low];
+  }
+
+  free(ranks);
+  free(cdf);
+
+  return indexes;
+}
+
+static void table_set(void *table, enum BenchTable kind, char *key)
+{
+  if (kind == BENCH_ZHASH) zhash_set(table, key, key);
+  else zsorted_hash_set(table, key, key);
+}
+
+static void *table_get(void *table, enum BenchTable kind, char *key)
+{
+  if (kind == BENCH_ZHASH) return zhash_get(table, key);
+
+  return zsorted_hash_get(table, key);
+}
+
+static void table_delete(void *table, enum BenchTable kind, char *key)
+{
+  if (kind == BENCH_ZHASH) zhash_delete(table, key);
+  else zsorted_hash_delete(table, key);
+}
+
+// run the operations of the workload, storing the latency of each one;
+// return the number of operations
+static size_t run_ops(struct Bench *bench, const struct Workload *workload,
+    void *table)
+{
+  struct ZIterator *iterator;
+  size_t ii, op_count;
+  uint64_t start;
+  void * volatile sink;
+
+  op_count = workload->op == BENCH_INSERT ? KEY_COUNT : OP_COUNT;
+  iterator = NULL;
+  // only the lookup workloads assign sink, but it is read after every one
+  sink = NULL;
+
+  for (ii = 0; ii < op_count; ii++) {
+    char *key;
+
+    start = 0;
+
+    switch (workload->op) {
+    case BENCH_INSERT:
+      key = bench->keys[ii];
+      start = now_ns();
+      table_set(table, workload->table, key);
+      break;
+    case BENCH_GET_HIT:
+      key = bench->keys[bench->indexes[ii]];
+      start = now_ns();
+      sink = table_get(table, workload->table, key);
+      break;
+    case BENCH_GET_MISS:
+      key = bench->miss_keys[bench->indexes[ii]];
+      start = now_ns();
+      sink = table_get(table, workload->table, key);
+      break;
+    case BENCH_CHURN:
+      // delete the drawn key if it is in the table, insert it otherwise
+      key = bench->keys[bench->indexes[ii]];
+      start = now_ns();
+
+      if (bench->in_table[bench->indexes[ii]]) {
+        table_delete(table, workload->table, key);
+      } else {
+        table_set(table, workload->table, key);
+      }
+
+      bench->in_table[bench->indexes[ii]] ^= 1;
+      break;
+    case BENCH_ITERATE:
+      if (!iterator || !ziterator_exists(iterator)) {
+        if (iterator) zfree_iterator(iterator);
+        iterator = zcreate_iterator(table);
+      }
+      start = now_ns();
+      ziterator_next(iterator);
+      break;
+    }
+
+    bench->latencies[ii] = now_ns() - start;
+  }
+
+  (void) sink;
+  if (iterator) zfree_iterator(iterator);
+
+  return op_count;
+}
+
+static int compare_latencies(const void *a, const void *b)
+{
+  uint64_t x, y;
+
+  x = *(const uint64_t *) a;
+  y = *(const uint64_t *) b;
+
+  return x < y ? -1 : x > y;
+}
+
+static void run_workload(struct Bench *bench, const struct Workload *workload)
+{
+  struct rusage usage;
+  uint64_t state, total;
+  size_t op_count, ii, prefill;
+  void *table;
+  long peak_rss_kb;
+
+  state = 0x9e3779b97f4a7c15ull;
+  bench->keys = generate_keys(KEY_COUNT, workload->long_keys, 'k', &state);
+  bench->miss_keys = generate_keys(KEY_COUNT, workload->long_keys, '#',
+      &state);
+  bench->indexes = generate_indexes(OP_COUNT, workload->zipf, &state);
+  bench->latencies = malloc(OP_COUNT * sizeof(uint64_t));
+  bench->in_table = calloc(KEY_COUNT, sizeof(char));
+
+  if (workload->table == BENCH_ZHASH) table = zcreate_hash_table();
+  else table = zcreate_sorted_hash_table();
+
+  prefill = workload->op == BENCH_INSERT ? 0 :
+    workload->op == BENCH_CHURN ? KEY_COUNT / 2 : KEY_COUNT;
+
+  for (ii = 0; ii < prefill; ii++) {
+    table_set(table, workload->table, bench->keys[ii]);
+    bench->in_table[ii] = 1;
+  }
+
+  COUNT_ALLOCATIONS(1);
+  op_count = run_ops(bench, workload, table);
+  COUNT_ALLOCATIONS(0);
+
+  // latencies include one clock read, which is subtracted
+  for (total = 0, ii = 0; ii < op_count; ii++) {
+    bench->latencies[ii] = bench->latencies[ii] > bench->clock_overhead ?
+      bench->latencies[ii] - bench->clock_overhead : 0;
+    total += bench->latencies[ii];
+  }
+
+  qsort(bench->latencies, op_count, sizeof(uint64_t), compare_latencies);
+
+  getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+  peak_rss_kb = usage.ru_maxrss / 1024;
+#else
+  peak_rss_kb = usage.ru_maxrss;
+#endif
+
+  printf("%s,%s,%s,%s,%zu,%.1f,%llu,%llu,%llu,%ld,%lld,%lld,%lld\n",
+      workload->name,
+      workload->table == BENCH_ZHASH ? "zhash" : "zsorted_hash",
+      workload->long_keys ? "long" : "short",
+      workload->zipf ? "zipf" : "uniform",
+      op_count, (double) total / (double) op_count,
+      (unsigned long long) bench->latencies[op_count / 2],
+      (unsigned long long) bench->latencies[op_count * 99 / 100],
+      (unsigned long long) bench->latencies[op_count * 999 / 1000],
+      peak_rss_kb, alloc_count, free_count, alloc_bytes);
+
+  if (workload->table == BENCH_ZHASH) zfree_hash_table(table);
+  else zfree_sorted_hash_table(table);
+
+  free(bench->in_table);
+  free(bench->latencies);
+  free(bench->indexes);
+  free_keys(bench->miss_keys, KEY_COUNT);
+  free_keys(bench->keys, KEY_COUNT);
+}
+
+// median cost of reading the clock twice with nothing in between
+static uint64_t measure_clock_overhead(void)
+{
+  uint64_t samples[1001];
+  size_t ii;
+
+  for (ii = 0; ii < 1001; ii++) {
+    uint64_t start;
+
+    start = now_ns();
+    samples[ii] = now_ns() - start;
+  }
+
+  qsort(samples, 1001, sizeof(uint64_t), compare_latencies);
+
+  return samples[500];
+}
+
+int main()
+{
+  struct Bench bench;
+  size_t ii;
+
+  bench.clock_overhead = measure_clock_overhead();
+
+  printf("workload,table,keys,distribution,ops,ns_per_op,p50_ns,p99_ns,"
+      "p999_ns,peak_rss_kb,allocs,frees,alloc_bytes\n");
+  fflush(stdout);
+
+  // one process per workload, so that peak RSS belongs to that workload
+  for (ii = 0; ii < sizeof(workloads) / sizeof(*workloads); ii++) {
+    pid_t pid;
+    int status;
+
+    pid = fork();
+
+    if (pid == 0) {
+      run_workload(&bench, &workloads[ii]);
+      fflush(stdout);
+      _exit(EXIT_SUCCESS);
+    }
+
+    if (pid < 0 || waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) ||
+        WEXITSTATUS(status) != EXIT_SUCCESS) {
+      fprintf(stderr, "workload %s failed\n", workloads[ii].name);
+      return EXIT_FAILURE;
+    }
+  }
+
+  return 0;
+}
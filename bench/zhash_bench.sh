@@ -0,0 +1,24 @@
+#!/bin/bash
+
+# build and run the ZHash and ZSortedHash benchmarks; the CSV they print can be
+# saved and compared between versions:
+#   ./zhash_bench.sh > before.csv
+
+flags='-O2 -Wall -Wextra'
+
+# count allocations on Linux by wrapping the allocator at link time
+if [ "$(uname)" = 'Linux' ]; then
+  flags="$flags -DZBENCH_WRAP_MALLOC -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc,--wrap=free"
+fi
+
+gcc $flags ../src/zhash.c ../src/zsorted_hash.c ./zhash_bench.c -lm -o zhash_bench
+if [ $? -ne 0 ]; then
+  echo '[FAIL]: Benchmark build failed' >&2
+  exit 1
+fi
+
+./zhash_bench
+status=$?
+
+rm zhash_bench
+exit $status
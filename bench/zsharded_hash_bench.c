@@ -0,0 +1,191 @@
+// clock_gettime and pthread_rwlock_t with -std=c11
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200112L
+#endif
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "../src/zhash.h"
+#include "../src/zsharded_hash.h"
+
+// measures throughput of a sharded table and of a ZHashTable behind one mutex
+// at 1 to 64 threads, for several read/write ratios; prints CSV to stdout
+// (built and run by zsharded_hash_bench.sh)
+//
+// reads look up the KEY_COUNT preloaded keys; writes are split evenly between
+// overwriting a preloaded key, inserting a fresh key and deleting one, so the
+// shards grow and shrink while they are being read
+
+#define KEY_COUNT 100000
+#define OPS_PER_THREAD 200000
+#define SHARD_COUNT 64
+// keys that writes insert and delete, never preloaded
+#define FRESH_KEY_COUNT 100000
+
+enum BenchOp { BENCH_READ, BENCH_OVERWRITE, BENCH_INSERT, BENCH_DELETE };
+
+struct BenchTable {
+  struct ZShardedHashTable *sharded;
+  struct ZHashTable *global;
+  pthread_mutex_t global_lock;
+};
+
+struct ThreadArgs {
+  struct BenchTable *table;
+  char **keys;
+  unsigned read_percent;
+  uint64_t seed;
+  int sharded;
+};
+
+// xorshift64*, one generator per thread
+static uint64_t next_random(uint64_t *state)
+{
+  *state ^= *state >> 12;
+  *state ^= *state << 25;
+  *state ^= *state >> 27;
+
+  return *state * 0x2545f4914f6cdd1dull;
+}
+
+static void *bench_thread(void *arg)
+{
+  struct ThreadArgs *args;
+  size_t ii;
+  uint64_t state;
+
+  args = (struct ThreadArgs *) arg;
+  state = args->seed;
+
+  for (ii = 0; ii < OPS_PER_THREAD; ii++) {
+    uint64_t random;
+    char *key;
+    int op;
+
+    random = next_random(&state);
+    op = (random >> 32) % 100 < args->read_percent ? BENCH_READ :
+      (int) ((random >> 48) % 3) + BENCH_OVERWRITE;
+    key = op == BENCH_READ || op == BENCH_OVERWRITE ?
+      args->keys[random % KEY_COUNT] :
+      args->keys[KEY_COUNT + random % FRESH_KEY_COUNT];
+
+    if (args->sharded) {
+      switch (op) {
+        case BENCH_READ:
+          zsharded_hash_get(args->table->sharded, key);
+          break;
+        case BENCH_DELETE:
+          zsharded_hash_delete(args->table->sharded, key);
+          break;
+        default:
+          zsharded_hash_set(args->table->sharded, key, (void *) key);
+      }
+    } else {
+      pthread_mutex_lock(&args->table->global_lock);
+      switch (op) {
+        case BENCH_READ:
+          zhash_get(args->table->global, key);
+          break;
+        case BENCH_DELETE:
+          zhash_delete(args->table->global, key);
+          break;
+        default:
+          zhash_set(args->table->global, key, (void *) key);
+      }
+      pthread_mutex_unlock(&args->table->global_lock);
+    }
+  }
+
+  return NULL;
+}
+
+// return operations per second for thread_count threads
+static double run(struct BenchTable *table, char **keys, size_t thread_count,
+    unsigned read_percent, int sharded)
+{
+  pthread_t threads[64];
+  struct ThreadArgs args[64];
+  struct timespec start, end;
+  size_t ii;
+  double seconds;
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  for (ii = 0; ii < thread_count; ii++) {
+    args[ii].table = table;
+    args[ii].keys = keys;
+    args[ii].read_percent = read_percent;
+    args[ii].seed = 0x9e3779b97f4a7c15ull * (ii + 1);
+    args[ii].sharded = sharded;
+    pthread_create(&threads[ii], NULL, bench_thread, &args[ii]);
+  }
+
+  for (ii = 0; ii < thread_count; ii++) pthread_join(threads[ii], NULL);
+
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  seconds = (double) (end.tv_sec - start.tv_sec) +
+    (double) (end.tv_nsec - start.tv_nsec) / 1e9;
+
+  return (double) (thread_count * OPS_PER_THREAD) / seconds;
+}
+
+// delete the fresh keys, so that every run starts from the preloaded keys
+static void reset(struct BenchTable *table, char **keys)
+{
+  size_t ii;
+
+  for (ii = KEY_COUNT; ii < KEY_COUNT + FRESH_KEY_COUNT; ii++) {
+    zsharded_hash_delete(table->sharded, keys[ii]);
+    zhash_delete(table->global, keys[ii]);
+  }
+}
+
+int main()
+{
+  static const size_t thread_counts[] = { 1, 2, 4, 8, 16, 32, 64 };
+  static const unsigned read_percents[] = { 50, 90, 99 };
+  struct BenchTable table;
+  char **keys;
+  double global_ops, sharded_ops;
+  size_t ii, jj;
+
+  keys = malloc((KEY_COUNT + FRESH_KEY_COUNT) * sizeof(char *));
+  table.sharded = zcreate_sharded_hash_table(SHARD_COUNT);
+  table.global = zcreate_hash_table();
+  pthread_mutex_init(&table.global_lock, NULL);
+
+  for (ii = 0; ii < KEY_COUNT + FRESH_KEY_COUNT; ii++) {
+    keys[ii] = malloc(32);
+    snprintf(keys[ii], 32, "key:%zu", ii);
+  }
+
+  for (ii = 0; ii < KEY_COUNT; ii++) {
+    zsharded_hash_set(table.sharded, keys[ii], (void *) keys[ii]);
+    zhash_set(table.global, keys[ii], (void *) keys[ii]);
+  }
+
+  printf("threads,read_percent,global_mutex_ops_per_sec,sharded_ops_per_sec\n");
+
+  for (ii = 0; ii < sizeof(read_percents) / sizeof(*read_percents); ii++) {
+    for (jj = 0; jj < sizeof(thread_counts) / sizeof(*thread_counts); jj++) {
+      global_ops = run(&table, keys, thread_counts[jj], read_percents[ii], 0);
+      sharded_ops = run(&table, keys, thread_counts[jj], read_percents[ii], 1);
+      reset(&table, keys);
+      printf("%zu,%u,%.0f,%.0f\n", thread_counts[jj], read_percents[ii],
+          global_ops, sharded_ops);
+    }
+  }
+
+  for (ii = 0; ii < KEY_COUNT + FRESH_KEY_COUNT; ii++) free(keys[ii]);
+
+  free(keys);
+  pthread_mutex_destroy(&table.global_lock);
+  zfree_hash_table(table.global);
+  zfree_sharded_hash_table(table.sharded);
+
+  return 0;
+}
@@ -0,0 +1,18 @@
+#!/bin/bash
+
+# build and run the ZShardedHash benchmark; the CSV it prints can be saved and
+# compared between versions:
+#   ./zsharded_hash_bench.sh > before.csv
+
+gcc -O2 -Wall -Wextra -pthread ../src/zhash.c ../src/zsharded_hash.c \
+  ./zsharded_hash_bench.c -o zsharded_hash_bench
+if [ $? -ne 0 ]; then
+  echo '[FAIL]: Benchmark build failed' >&2
+  exit 1
+fi
+
+./zsharded_hash_bench
+status=$?
+
+rm zsharded_hash_bench
+exit $status
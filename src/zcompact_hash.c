@@ -0,0 +1,482 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "./zhash.h"
+#include "./zcompact_hash.h"
+
+// helper macros and functions, declarations
+// index slot values other than positions in the entries array
+#define ZCOMPACT_EMPTY UINT32_MAX
+#define ZCOMPACT_DELETED (UINT32_MAX - 1)
+
+// smallest key array, in bytes
+#define ZCOMPACT_MIN_KEYS ((size_t) 64)
+
+static size_t zcompact_find(struct ZCompactHashTable *hash_table, char *key,
+    uint64_t hash);
+static size_t zcompact_find_free(uint32_t *index, size_t size_index,
+    uint64_t hash);
+static bool zcompact_resize(struct ZCompactHashTable *hash_table,
+    size_t size_index, size_t extra_key_bytes);
+static bool zreserve_keys(struct ZCompactHashTable *hash_table, size_t size);
+static size_t zcompact_fit_size_index(size_t entry_count);
+static size_t zkeys_capacity(size_t key_bytes);
+static size_t zindex_size(size_t size_index);
+static size_t zusable_size(size_t size_index);
+static void zcompact_iterator_seek(struct ZCompactIterator *iterator,
+    size_t position, bool forward);
+static void *zmalloc(const struct ZAllocator *allocator, size_t size);
+static void zrelease(const struct ZAllocator *allocator, void *ptr);
+static void *zdefault_alloc(size_t size, void *ctx);
+static void zdefault_free(void *ptr, void *ctx);
+
+static const struct ZAllocator default_allocator = {
+  zdefault_alloc, NULL, zdefault_free, NULL
+};
+
+// functions declared in zcompact_hash.h
+struct ZCompactHashTable *zcreate_compact_hash_table(void)
+{
+  return zcreate_compact_hash_table_with_allocator(NULL);
+}
+
+struct ZCompactHashTable *zcreate_compact_hash_table_with_allocator(
+    const struct ZAllocator *allocator)
+{
+  struct ZCompactHashTable *hash_table;
+
+  if (!allocator) allocator = &default_allocator;
+
+  hash_table = zmalloc(allocator, sizeof(struct ZCompactHashTable));
+
+  if (!hash_table) return NULL;
+
+  hash_table->size_index = 0;
+  hash_table->entry_count = 0;
+  hash_table->entries_used = 0;
+  hash_table->keys_used = 0;
+  hash_table->keys_capacity = ZCOMPACT_MIN_KEYS;
+  hash_table->key_bytes = 0;
+  hash_table->allocator = *allocator;
+  hash_table->index = zmalloc(allocator, zindex_size(0) * sizeof(uint32_t));
+  hash_table->entries = zmalloc(allocator,
+      zusable_size(0) * sizeof(struct ZCompactEntry));
+  hash_table->keys = zmalloc(allocator, ZCOMPACT_MIN_KEYS);
+
+  if (!hash_table->index || !hash_table->entries || !hash_table->keys) {
+    if (hash_table->index) zrelease(allocator, hash_table->index);
+    if (hash_table->entries) zrelease(allocator, hash_table->entries);
+    if (hash_table->keys) zrelease(allocator, hash_table->keys);
+    zrelease(allocator, hash_table);
+    return NULL;
+  }
+
+  memset(hash_table->index, 0xff, zindex_size(0) * sizeof(uint32_t));
+
+  return hash_table;
+}
+
+void zfree_compact_hash_table(struct ZCompactHashTable *hash_table)
+{
+  struct ZAllocator allocator;
+
+  // the keys are in the key array, so the entries are not walked
+  zrelease(&hash_table->allocator, hash_table->index);
+  zrelease(&hash_table->allocator, hash_table->entries);
+  zrelease(&hash_table->allocator, hash_table->keys);
+
+  // the allocator is part of the table being freed
+  allocator = hash_table->allocator;
+  zrelease(&allocator, hash_table);
+}
+
+enum ZHashStatus zcompact_hash_set(struct ZCompactHashTable *hash_table,
+    char *key, void *val)
+{
+  size_t slot, key_size;
+  uint64_t hash;
+  struct ZCompactEntry *entry;
+
+  hash = zhash_hash(key);
+  slot = zcompact_find(hash_table, key, hash);
+
+  if (slot != SIZE_MAX) {
+    hash_table->entries[hash_table->index[slot]].val = val;
+    return ZHASH_OK;
+  }
+
+  key_size = strlen(key) + 1;
+
+  // the entries array is full; drop deleted entries and grow if needed,
+  // making room for the key at the same time
+  if (hash_table->entries_used == zusable_size(hash_table->size_index)) {
+    if (!zcompact_resize(hash_table,
+          zcompact_fit_size_index(hash_table->entry_count + 1), key_size)) {
+      return ZHASH_NO_MEMORY;
+    }
+  } else if (!zreserve_keys(hash_table, key_size)) {
+    return ZHASH_NO_MEMORY;
+  }
+
+  slot = zcompact_find_free(hash_table->index, hash_table->size_index, hash);
+  entry = &hash_table->entries[hash_table->entries_used];
+
+  entry->hash = hash;
+  entry->key_offset = hash_table->keys_used;
+  entry->val = val;
+
+  memcpy(hash_table->keys + hash_table->keys_used, key, key_size);
+  hash_table->keys_used += key_size;
+  hash_table->key_bytes += key_size;
+
+  hash_table->index[slot] = (uint32_t) hash_table->entries_used;
+  hash_table->entries_used++;
+  hash_table->entry_count++;
+
+  return ZHASH_OK;
+}
+
+void *zcompact_hash_get(struct ZCompactHashTable *hash_table, char *key)
+{
+  size_t slot;
+
+  slot = zcompact_find(hash_table, key, zhash_hash(key));
+
+  return slot != SIZE_MAX ?
+    hash_table->entries[hash_table->index[slot]].val : NULL;
+}
+
+void *zcompact_hash_delete(struct ZCompactHashTable *hash_table, char *key)
+{
+  size_t slot;
+  struct ZCompactEntry *entry;
+  void *val;
+
+  slot = zcompact_find(hash_table, key, zhash_hash(key));
+
+  if (slot == SIZE_MAX) return NULL;
+
+  entry = &hash_table->entries[hash_table->index[slot]];
+  val = entry->val;
+
+  // the key's bytes stay in the key array until the table is resized
+  hash_table->key_bytes -= strlen(hash_table->keys + entry->key_offset) + 1;
+  entry->key_offset = ZCOMPACT_NO_KEY;
+  entry->val = NULL;
+  hash_table->index[slot] = ZCOMPACT_DELETED;
+  hash_table->entry_count--;
+
+  // if the smaller arrays cannot be allocated the table keeps its size
+  if (hash_table->size_index > 0 &&
+      hash_table->entry_count < zusable_size(hash_table->size_index) / 8) {
+    zcompact_resize(hash_table,
+        zcompact_fit_size_index(hash_table->entry_count), 0);
+  }
+
+  return val;
+}
+
+bool zcompact_hash_exists(struct ZCompactHashTable *hash_table, char *key)
+{
+  return zcompact_find(hash_table, key, zhash_hash(key)) != SIZE_MAX;
+}
+
+size_t zcompact_hash_count(struct ZCompactHashTable *hash_table)
+{
+  return hash_table->entry_count;
+}
+
+struct ZCompactIterator *zcreate_compact_iterator(
+    struct ZCompactHashTable *hash_table)
+{
+  struct ZCompactIterator *iterator;
+
+  // iterators are owned by the caller, not the table, so they always come
+  // from malloc
+  if (!(iterator = malloc(sizeof(struct ZCompactIterator)))) return NULL;
+
+  iterator->hash_table = hash_table;
+  iterator->position = 0;
+
+  if (hash_table->entry_count > 0) {
+    iterator->status = ZWITHIN_BOUNDS;
+    zcompact_iterator_seek(iterator, 0, true);
+  } else {
+    iterator->status = ZNO_ENTRIES;
+  }
+
+  return iterator;
+}
+
+void zfree_compact_iterator(struct ZCompactIterator *iterator)
+{
+  free(iterator);
+}
+
+bool zcompact_iterator_exists(struct ZCompactIterator *iterator)
+{
+  return iterator->status == ZWITHIN_BOUNDS;
+}
+
+char *zcompact_iterator_get_key(struct ZCompactIterator *iterator)
+{
+  struct ZCompactHashTable *hash_table;
+
+  if (iterator->status != ZWITHIN_BOUNDS) return NULL;
+
+  hash_table = iterator->hash_table;
+
+  return hash_table->keys + hash_table->entries[iterator->position].key_offset;
+}
+
+void *zcompact_iterator_get_val(struct ZCompactIterator *iterator)
+{
+  if (iterator->status != ZWITHIN_BOUNDS) return NULL;
+
+  return iterator->hash_table->entries[iterator->position].val;
+}
+
+void zcompact_iterator_next(struct ZCompactIterator *iterator)
+{
+  if (iterator->status == ZBEFORE_FIRST) {
+    iterator->status = ZWITHIN_BOUNDS;
+
+    return;
+  }
+
+  if (iterator->status == ZWITHIN_BOUNDS) {
+    zcompact_iterator_seek(iterator, iterator->position + 1, true);
+  }
+}
+
+void zcompact_iterator_prev(struct ZCompactIterator *iterator)
+{
+  if (iterator->status == ZAFTER_LAST) {
+    iterator->status = ZWITHIN_BOUNDS;
+
+    return;
+  }
+
+  if (iterator->status == ZWITHIN_BOUNDS) {
+    zcompact_iterator_seek(iterator, iterator->position - 1, false);
+  }
+}
+
+// helper functions, definitions
+// return the index slot that holds the position of key, or SIZE_MAX if key
+// is not in the table
+static size_t zcompact_find(struct ZCompactHashTable *hash_table, char *key,
+    uint64_t hash)
+{
+  size_t mask, slot;
+
+  mask = zindex_size(hash_table->size_index) - 1;
+
+  for (slot = (size_t) hash & mask; ; slot = (slot + 1) & mask) {
+    uint32_t position;
+    struct ZCompactEntry *entry;
+
+    position = hash_table->index[slot];
+
+    if (position == ZCOMPACT_EMPTY) return SIZE_MAX;
+    if (position == ZCOMPACT_DELETED) continue;
+
+    entry = &hash_table->entries[position];
+    if (entry->hash == hash &&
+        strcmp(hash_table->keys + entry->key_offset, key) == 0) {
+      return slot;
+    }
+  }
+}
+
+// return the first empty or deleted index slot in the probe sequence of hash
+// at most 2/3 of the slots are ever used, so there always is one
+static size_t zcompact_find_free(uint32_t *index, size_t size_index,
+    uint64_t hash)
+{
+  size_t mask, slot;
+
+  mask = zindex_size(size_index) - 1;
+
+  for (slot = (size_t) hash & mask; index[slot] < ZCOMPACT_DELETED;
+      slot = (slot + 1) & mask);
+
+  return slot;
+}
+
+// rebuild the index and move the entries that are not deleted to the front
+// of a new entries array, keeping their order; their keys are moved the same
+// way to a new key array with room for extra_key_bytes more
+// return false and leave the table as it is if the new arrays cannot be
+// allocated
+static bool zcompact_resize(struct ZCompactHashTable *hash_table,
+    size_t size_index, size_t extra_key_bytes)
+{
+  const struct ZAllocator *allocator;
+  struct ZCompactEntry *entries;
+  uint32_t *index;
+  char *keys;
+  size_t ii, used, keys_used, keys_capacity;
+
+  allocator = &hash_table->allocator;
+  keys_capacity = zkeys_capacity(hash_table->key_bytes + extra_key_bytes);
+
+  index = zmalloc(allocator, zindex_size(size_index) * sizeof(uint32_t));
+  entries = zmalloc(allocator,
+      zusable_size(size_index) * sizeof(struct ZCompactEntry));
+  keys = zmalloc(allocator, keys_capacity);
+
+  if (!index || !entries || !keys) {
+    if (index) zrelease(allocator, index);
+    if (entries) zrelease(allocator, entries);
+    if (keys) zrelease(allocator, keys);
+    return false;
+  }
+
+  memset(index, 0xff, zindex_size(size_index) * sizeof(uint32_t));
+
+  used = 0;
+  keys_used = 0;
+  for (ii = 0; ii < hash_table->entries_used; ii++) {
+    struct ZCompactEntry *entry;
+    size_t slot, key_size;
+
+    entry = &hash_table->entries[ii];
+    if (entry->key_offset == ZCOMPACT_NO_KEY) continue;
+
+    key_size = strlen(hash_table->keys + entry->key_offset) + 1;
+    memcpy(keys + keys_used, hash_table->keys + entry->key_offset, key_size);
+
+    slot = zcompact_find_free(index, size_index, entry->hash);
+    index[slot] = (uint32_t) used;
+    entries[used] = *entry;
+    entries[used++].key_offset = keys_used;
+    keys_used += key_size;
+  }
+
+  zrelease(allocator, hash_table->index);
+  zrelease(allocator, hash_table->entries);
+  zrelease(allocator, hash_table->keys);
+
+  hash_table->size_index = size_index;
+  hash_table->index = index;
+  hash_table->entries = entries;
+  hash_table->entries_used = used;
+  hash_table->keys = keys;
+  hash_table->keys_used = keys_used;
+  hash_table->keys_capacity = keys_capacity;
+
+  return true;
+}
+
+// make room for size more bytes at the end of the key array, doubling it as
+// needed; return false and leave it as it is if it cannot grow
+static bool zreserve_keys(struct ZCompactHashTable *hash_table, size_t size)
+{
+  size_t capacity;
+  char *keys;
+
+  if (size <= hash_table->keys_capacity - hash_table->keys_used) return true;
+
+  capacity = zkeys_capacity(hash_table->keys_used + size);
+
+  if (!(keys = zmalloc(&hash_table->allocator, capacity))) return false;
+
+  memcpy(keys, hash_table->keys, hash_table->keys_used);
+  zrelease(&hash_table->allocator, hash_table->keys);
+
+  hash_table->keys = keys;
+  hash_table->keys_capacity = capacity;
+
+  return true;
+}
+
+// return the smallest size whose entries array is at least twice entry_count
+static size_t zcompact_fit_size_index(size_t entry_count)
+{
+  size_t size_index;
+
+  for (size_index = 0; zusable_size(size_index) < entry_count * 2; size_index++);
+
+  return size_index;
+}
+
+// return the size of a key array that holds key_bytes, with room to grow
+static size_t zkeys_capacity(size_t key_bytes)
+{
+  size_t capacity;
+
+  for (capacity = ZCOMPACT_MIN_KEYS; capacity < key_bytes; capacity *= 2);
+
+  return capacity;
+}
+
+static size_t zindex_size(size_t size_index)
+{
+  return (size_t) 8 << size_index;
+}
+
+static size_t zusable_size(size_t size_index)
+{
+  return zindex_size(size_index) / 3 * 2;
+}
+
+// move the iterator to the first entry at or after position (or at or before
+// position when going back) that is not deleted
+static void zcompact_iterator_seek(struct ZCompactIterator *iterator,
+    size_t position, bool forward)
+{
+  struct ZCompactHashTable *hash_table;
+
+  hash_table = iterator->hash_table;
+
+  if (forward) {
+    while (position < hash_table->entries_used &&
+        hash_table->entries[position].key_offset == ZCOMPACT_NO_KEY) {
+      position++;
+    }
+
+    if (position == hash_table->entries_used) {
+      iterator->status = ZAFTER_LAST;
+      return;
+    }
+  } else {
+    while (position != SIZE_MAX &&
+        hash_table->entries[position].key_offset == ZCOMPACT_NO_KEY) {
+      position--;
+    }
+
+    if (position == SIZE_MAX) {
+      iterator->status = ZBEFORE_FIRST;
+      return;
+    }
+  }
+
+  iterator->position = position;
+}
+
+static void *zmalloc(const struct ZAllocator *allocator, size_t size)
+{
+  return allocator->alloc(size, allocator->ctx);
+}
+
+static void zrelease(const struct ZAllocator *allocator, void *ptr)
+{
+  if (allocator->free) allocator->free(ptr, allocator->ctx);
+}
+
+static void *zdefault_alloc(size_t size, void *ctx)
+{
+  (void) ctx;
+
+  return malloc(size);
+}
+
+static void zdefault_free(void *ptr, void *ctx)
+{
+  (void) ctx;
+
+  free(ptr);
+}
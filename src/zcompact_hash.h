@@ -0,0 +1,96 @@
+#ifndef ZCOMPACT_HASH_H
+#define ZCOMPACT_HASH_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "./zhash.h"
+#include "./zsorted_hash.h"
+
+// compact hash table, keeps entries sorted by insertion order like zsorted_hash
+// keys are strings
+// values are void *pointers
+// entries are stored in one array in insertion order and the index is an open
+// addressing table of 32-bit positions in that array (so a table holds fewer
+// than 2^32 - 1 entries); iterating reads the entries sequentially and no
+// entry needs its own list node
+// keys are copied back to back, each followed by a NUL byte, into one key
+// array, so no key needs its own allocation either
+
+// value of key_offset for deleted entries
+#define ZCOMPACT_NO_KEY SIZE_MAX
+
+// struct representing an entry in the hash table
+// key_offset is the position of the key in the key array; deleted entries are
+// left in the array with key_offset set to ZCOMPACT_NO_KEY until the table is
+// resized
+struct ZCompactEntry {
+  uint64_t hash;
+  size_t key_offset;
+  void *val;
+};
+
+// struct representing the compact hash table
+// the index has (8 << size_index) slots and the entries array has room for 2/3
+// as many entries; entries_used counts entries appended so far, including
+// deleted ones
+// keys_used bytes of the key array (of keys_capacity bytes) hold keys
+// appended so far, including those of deleted entries; key_bytes counts only
+// the keys still in the table; resizing drops the deleted keys
+// all of the table's memory, including the table itself, comes from allocator
+struct ZCompactHashTable {
+  size_t size_index;
+  size_t entry_count;
+  size_t entries_used;
+  uint32_t *index;
+  struct ZCompactEntry *entries;
+  char *keys;
+  size_t keys_used;
+  size_t keys_capacity;
+  size_t key_bytes;
+  struct ZAllocator allocator;
+};
+
+// struct used for iteration through values, in insertion order
+// position is the index of the current entry in the entries array
+struct ZCompactIterator {
+  enum ZIteratorStatus status;
+  struct ZCompactHashTable *hash_table;
+  size_t position;
+};
+
+// compact hash table creation and destruction
+// tables are created with malloc, calloc and free unless an allocator is given
+// (NULL for the default; see struct ZAllocator in zhash.h); creation returns
+// NULL if there is not enough memory
+struct ZCompactHashTable *zcreate_compact_hash_table(void);
+struct ZCompactHashTable *zcreate_compact_hash_table_with_allocator(
+    const struct ZAllocator *allocator);
+void zfree_compact_hash_table(struct ZCompactHashTable *hash_table);
+
+// compact hash table operations
+// set returns ZHASH_NO_MEMORY and leaves the table unchanged if the table
+// needs to grow and cannot
+enum ZHashStatus zcompact_hash_set(struct ZCompactHashTable *hash_table,
+    char *key, void *val);
+void *zcompact_hash_get(struct ZCompactHashTable *hash_table, char *key);
+void *zcompact_hash_delete(struct ZCompactHashTable *hash_table, char *key);
+bool zcompact_hash_exists(struct ZCompactHashTable *hash_table, char *key);
+size_t zcompact_hash_count(struct ZCompactHashTable *hash_table);
+
+// iterator creation and destruction
+// iterators are allocated with malloc; creation returns NULL if it fails
+// setting a new key or deleting a key invalidates every iterator of the table,
+// and every key returned by zcompact_iterator_get_key
+struct ZCompactIterator *zcreate_compact_iterator(
+    struct ZCompactHashTable *hash_table);
+void zfree_compact_iterator(struct ZCompactIterator *iterator);
+
+// iteration functions
+bool zcompact_iterator_exists(struct ZCompactIterator *iterator);
+char *zcompact_iterator_get_key(struct ZCompactIterator *iterator);
+void *zcompact_iterator_get_val(struct ZCompactIterator *iterator);
+void zcompact_iterator_next(struct ZCompactIterator *iterator);
+void zcompact_iterator_prev(struct ZCompactIterator *iterator);
+
+#endif
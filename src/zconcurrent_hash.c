@@ -0,0 +1,462 @@
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "./zhash.h"
+#include "./zconcurrent_hash.h"
+
+// helper macros and functions, declarations
+#define zfree free
+
+// bucket arrays have (ZCONCURRENT_MIN_SIZE << size_index) buckets
+#define ZCONCURRENT_MIN_SIZE 64
+
+// value of an entry that was deleted but could not be retired because there
+// was no memory for its retire record; it stays in its chain, missing to
+// readers, until the next resize leaves it behind with the old chains
+static char ztombstone;
+#define ZCONCURRENT_DELETED ((void *) &ztombstone)
+
+static struct ZConcurrentBuckets *zcreate_buckets(size_t size_index);
+static struct ZConcurrentEntry *zcreate_concurrent_entry(char *key,
+    size_t key_length, uint64_t hash, void *val);
+static struct ZConcurrentEntry *zfind_concurrent_entry(
+    struct ZConcurrentBuckets *buckets, char *key, size_t key_length,
+    uint64_t hash);
+static bool zconcurrent_rehash(struct ZConcurrentHashTable *hash_table,
+    size_t size_index);
+static bool zretire(struct ZConcurrentHashTable *hash_table, void *ptr,
+    bool chains);
+static void zreclaim(struct ZConcurrentHashTable *hash_table);
+static void zfree_retired(struct ZRetiredPointer *retired);
+static void zfree_chains(struct ZConcurrentBuckets *buckets);
+static size_t zbucket_count(size_t size_index);
+
+// functions declared in zconcurrent_hash.h
+struct ZConcurrentHashTable *zcreate_concurrent_hash_table(void)
+{
+  struct ZConcurrentHashTable *hash_table;
+  struct ZConcurrentBuckets *buckets;
+
+  hash_table = malloc(sizeof(struct ZConcurrentHashTable));
+  buckets = zcreate_buckets(0);
+
+  if (!hash_table || !buckets ||
+      pthread_mutex_init(&hash_table->write_lock, NULL) != 0) {
+    zfree((void *) buckets);
+    zfree((void *) hash_table);
+    return NULL;
+  }
+
+  atomic_init(&hash_table->buckets, buckets);
+  atomic_init(&hash_table->epoch, 1);
+  hash_table->entry_count = 0;
+  hash_table->readers = NULL;
+  hash_table->retired = NULL;
+
+  return hash_table;
+}
+
+void zfree_concurrent_hash_table(struct ZConcurrentHashTable *hash_table)
+{
+  struct ZConcurrentBuckets *buckets;
+  struct ZConcurrentReader *reader, *next_reader;
+  struct ZRetiredPointer *retired, *next_retired;
+
+  buckets = atomic_load_explicit(&hash_table->buckets, memory_order_relaxed);
+  zfree_chains(buckets);
+
+  for (retired = hash_table->retired; retired; retired = next_retired) {
+    next_retired = retired->next;
+    zfree_retired(retired);
+  }
+
+  for (reader = hash_table->readers; reader; reader = next_reader) {
+    next_reader = reader->next;
+    zfree((void *) reader);
+  }
+
+  pthread_mutex_destroy(&hash_table->write_lock);
+  zfree((void *) buckets);
+  zfree((void *) hash_table);
+}
+
+// a table that cannot allocate a larger bucket array keeps its current one and
+// tries again on a later insertion
+enum ZHashStatus zconcurrent_hash_set(struct ZConcurrentHashTable *hash_table,
+    char *key, void *val)
+{
+  struct ZConcurrentBuckets *buckets;
+  struct ZConcurrentEntry *entry;
+  _Atomic(struct ZConcurrentEntry *) *head;
+  enum ZHashStatus status;
+  size_t key_length;
+  uint64_t hash;
+
+  key_length = strlen(key);
+  hash = zhash_hash(key);
+  status = ZHASH_OK;
+
+  pthread_mutex_lock(&hash_table->write_lock);
+
+  buckets = atomic_load_explicit(&hash_table->buckets, memory_order_relaxed);
+  entry = zfind_concurrent_entry(buckets, key, key_length, hash);
+
+  if (entry) {
+    if (atomic_load_explicit(&entry->val, memory_order_relaxed) ==
+        ZCONCURRENT_DELETED) {
+      hash_table->entry_count++;
+    }
+    atomic_store_explicit(&entry->val, val, memory_order_release);
+  } else if (!(entry = zcreate_concurrent_entry(key, key_length, hash, val))) {
+    status = ZHASH_NO_MEMORY;
+  } else {
+    head = &buckets->entries[hash & (zbucket_count(buckets->size_index) - 1)];
+
+    atomic_init(&entry->next,
+        atomic_load_explicit(head, memory_order_relaxed));
+
+    // readers that see the new head also see the initialized entry
+    atomic_store_explicit(head, entry, memory_order_release);
+    hash_table->entry_count++;
+
+    if (hash_table->entry_count > zbucket_count(buckets->size_index) / 2 &&
+        zconcurrent_rehash(hash_table, buckets->size_index + 1)) {
+      zreclaim(hash_table);
+    }
+  }
+
+  pthread_mutex_unlock(&hash_table->write_lock);
+
+  return status;
+}
+
+void *zconcurrent_hash_delete(struct ZConcurrentHashTable *hash_table, char *key)
+{
+  struct ZConcurrentBuckets *buckets;
+  struct ZConcurrentEntry *entry;
+  _Atomic(struct ZConcurrentEntry *) *link;
+  size_t key_length;
+  uint64_t hash;
+  void *val;
+
+  key_length = strlen(key);
+  hash = zhash_hash(key);
+  val = NULL;
+
+  pthread_mutex_lock(&hash_table->write_lock);
+
+  buckets = atomic_load_explicit(&hash_table->buckets, memory_order_relaxed);
+  link = &buckets->entries[hash & (zbucket_count(buckets->size_index) - 1)];
+
+  while ((entry = atomic_load_explicit(link, memory_order_relaxed))) {
+    if (entry->hash == hash && entry->key_length == key_length &&
+        memcmp(key, entry->key, key_length) == 0) {
+      break;
+    }
+    link = &entry->next;
+  }
+
+  if (entry) val = atomic_load_explicit(&entry->val, memory_order_relaxed);
+
+  if (val == ZCONCURRENT_DELETED) {
+    val = NULL;
+  } else if (entry) {
+    // without memory for a retire record the entry cannot be unlinked, so it
+    // is marked deleted instead
+    if (zretire(hash_table, (void *) entry, false)) {
+      // readers already on the entry can still follow its next pointer
+      atomic_store_explicit(link,
+          atomic_load_explicit(&entry->next, memory_order_relaxed),
+          memory_order_release);
+    } else {
+      atomic_store_explicit(&entry->val, ZCONCURRENT_DELETED,
+          memory_order_release);
+    }
+    hash_table->entry_count--;
+
+    if (buckets->size_index > 0 &&
+        hash_table->entry_count < zbucket_count(buckets->size_index) / 8) {
+      zconcurrent_rehash(hash_table, buckets->size_index - 1);
+    }
+
+    zreclaim(hash_table);
+  }
+
+  pthread_mutex_unlock(&hash_table->write_lock);
+
+  return val;
+}
+
+void *zconcurrent_hash_get(struct ZConcurrentHashTable *hash_table, char *key)
+{
+  struct ZConcurrentBuckets *buckets;
+  struct ZConcurrentEntry *entry;
+  void *val;
+
+  buckets = atomic_load_explicit(&hash_table->buckets, memory_order_acquire);
+  entry = zfind_concurrent_entry(buckets, key, strlen(key), zhash_hash(key));
+
+  if (!entry) return NULL;
+
+  val = atomic_load_explicit(&entry->val, memory_order_acquire);
+
+  return val == ZCONCURRENT_DELETED ? NULL : val;
+}
+
+bool zconcurrent_hash_exists(struct ZConcurrentHashTable *hash_table, char *key)
+{
+  struct ZConcurrentBuckets *buckets;
+  struct ZConcurrentEntry *entry;
+
+  buckets = atomic_load_explicit(&hash_table->buckets, memory_order_acquire);
+  entry = zfind_concurrent_entry(buckets, key, strlen(key), zhash_hash(key));
+
+  return entry && atomic_load_explicit(&entry->val, memory_order_acquire) !=
+    ZCONCURRENT_DELETED;
+}
+
+struct ZConcurrentReader *zconcurrent_hash_register_reader(
+    struct ZConcurrentHashTable *hash_table)
+{
+  struct ZConcurrentReader *reader;
+
+  if (!(reader = malloc(sizeof(struct ZConcurrentReader)))) return NULL;
+
+  pthread_mutex_lock(&hash_table->write_lock);
+
+  atomic_init(&reader->epoch,
+      atomic_load_explicit(&hash_table->epoch, memory_order_relaxed));
+  reader->next = hash_table->readers;
+  hash_table->readers = reader;
+
+  pthread_mutex_unlock(&hash_table->write_lock);
+
+  return reader;
+}
+
+void zconcurrent_hash_unregister_reader(struct ZConcurrentHashTable *hash_table,
+    struct ZConcurrentReader *reader)
+{
+  struct ZConcurrentReader **link;
+
+  pthread_mutex_lock(&hash_table->write_lock);
+
+  for (link = &hash_table->readers; *link != reader; link = &(*link)->next);
+  *link = reader->next;
+
+  zreclaim(hash_table);
+
+  pthread_mutex_unlock(&hash_table->write_lock);
+
+  zfree((void *) reader);
+}
+
+// the reader promises that it holds no pointers obtained from the table
+// before this call; a plain load and store, no read-modify-write
+void zconcurrent_hash_quiescent(struct ZConcurrentHashTable *hash_table,
+    struct ZConcurrentReader *reader)
+{
+  atomic_store_explicit(&reader->epoch,
+      atomic_load_explicit(&hash_table->epoch, memory_order_acquire),
+      memory_order_release);
+}
+
+// helper functions, definitions
+static struct ZConcurrentBuckets *zcreate_buckets(size_t size_index)
+{
+  struct ZConcurrentBuckets *buckets;
+  size_t size, ii;
+
+  size = zbucket_count(size_index);
+  buckets = malloc(sizeof(struct ZConcurrentBuckets) +
+      size * sizeof(_Atomic(struct ZConcurrentEntry *)));
+
+  if (!buckets) return NULL;
+
+  buckets->size_index = size_index;
+  for (ii = 0; ii < size; ii++) atomic_init(&buckets->entries[ii], NULL);
+
+  return buckets;
+}
+
+static struct ZConcurrentEntry *zcreate_concurrent_entry(char *key,
+    size_t key_length, uint64_t hash, void *val)
+{
+  struct ZConcurrentEntry *entry;
+
+  entry = malloc(sizeof(struct ZConcurrentEntry) + key_length + 1);
+
+  if (!entry) return NULL;
+
+  memcpy(entry->key, key, key_length + 1);
+  entry->key_length = key_length;
+  entry->hash = hash;
+  atomic_init(&entry->val, val);
+  atomic_init(&entry->next, NULL);
+
+  return entry;
+}
+
+static struct ZConcurrentEntry *zfind_concurrent_entry(
+    struct ZConcurrentBuckets *buckets, char *key, size_t key_length,
+    uint64_t hash)
+{
+  struct ZConcurrentEntry *entry;
+
+  entry = atomic_load_explicit(
+      &buckets->entries[hash & (zbucket_count(buckets->size_index) - 1)],
+      memory_order_acquire);
+
+  while (entry && (entry->hash != hash || entry->key_length != key_length ||
+        memcmp(key, entry->key, key_length) != 0)) {
+    entry = atomic_load_explicit(&entry->next, memory_order_acquire);
+  }
+
+  return entry;
+}
+
+// readers may be walking the old chains, so entries are copied into the new
+// bucket array instead of relinked; the old array is retired together with
+// its chains, so the old entries need no retire records of their own
+// return false, leaving the table as it is, if there is not enough memory
+static bool zconcurrent_rehash(struct ZConcurrentHashTable *hash_table,
+    size_t size_index)
+{
+  struct ZConcurrentBuckets *old_buckets, *buckets;
+  size_t old_size, size, ii;
+
+  old_buckets = atomic_load_explicit(&hash_table->buckets, memory_order_relaxed);
+  old_size = zbucket_count(old_buckets->size_index);
+  size = zbucket_count(size_index);
+
+  if (!(buckets = zcreate_buckets(size_index))) return false;
+
+  for (ii = 0; ii < old_size; ii++) {
+    struct ZConcurrentEntry *entry;
+
+    entry = atomic_load_explicit(&old_buckets->entries[ii], memory_order_relaxed);
+    while (entry) {
+      struct ZConcurrentEntry *copy;
+      _Atomic(struct ZConcurrentEntry *) *head;
+      void *val;
+
+      val = atomic_load_explicit(&entry->val, memory_order_relaxed);
+
+      if (val != ZCONCURRENT_DELETED) {
+        copy = zcreate_concurrent_entry(entry->key, entry->key_length,
+            entry->hash, val);
+
+        if (!copy) {
+          zfree_chains(buckets);
+          zfree((void *) buckets);
+          return false;
+        }
+
+        head = &buckets->entries[entry->hash & (size - 1)];
+        atomic_init(&copy->next,
+            atomic_load_explicit(head, memory_order_relaxed));
+        atomic_init(head, copy);
+      }
+
+      entry = atomic_load_explicit(&entry->next, memory_order_relaxed);
+    }
+  }
+
+  if (!zretire(hash_table, (void *) old_buckets, true)) {
+    zfree_chains(buckets);
+    zfree((void *) buckets);
+    return false;
+  }
+
+  atomic_store_explicit(&hash_table->buckets, buckets, memory_order_release);
+
+  return true;
+}
+
+// retired memory is tagged with the current epoch and freed by zreclaim
+// return false if there is no memory for the record; memory can be retired
+// before it is unlinked, since zreclaim only runs later under the same lock
+static bool zretire(struct ZConcurrentHashTable *hash_table, void *ptr,
+    bool chains)
+{
+  struct ZRetiredPointer *retired;
+
+  if (!(retired = malloc(sizeof(struct ZRetiredPointer)))) return false;
+
+  retired->ptr = ptr;
+  retired->chains = chains;
+  retired->epoch = atomic_load_explicit(&hash_table->epoch, memory_order_relaxed);
+  retired->next = hash_table->retired;
+  hash_table->retired = retired;
+
+  return true;
+}
+
+// start a new epoch, then free memory retired before the oldest epoch that a
+// reader has observed; only called with write_lock held, so the epoch can be
+// advanced with a plain store
+static void zreclaim(struct ZConcurrentHashTable *hash_table)
+{
+  struct ZConcurrentReader *reader;
+  struct ZRetiredPointer **link, *retired;
+  uint64_t epoch, min_epoch;
+
+  if (!hash_table->retired) return;
+
+  epoch = atomic_load_explicit(&hash_table->epoch, memory_order_relaxed) + 1;
+  atomic_store_explicit(&hash_table->epoch, epoch, memory_order_seq_cst);
+  min_epoch = epoch;
+
+  for (reader = hash_table->readers; reader; reader = reader->next) {
+    uint64_t reader_epoch;
+
+    reader_epoch = atomic_load_explicit(&reader->epoch, memory_order_acquire);
+    if (reader_epoch < min_epoch) min_epoch = reader_epoch;
+  }
+
+  link = &hash_table->retired;
+  while ((retired = *link)) {
+    if (retired->epoch < min_epoch) {
+      *link = retired->next;
+      zfree_retired(retired);
+    } else {
+      link = &retired->next;
+    }
+  }
+}
+
+static void zfree_retired(struct ZRetiredPointer *retired)
+{
+  if (retired->chains) zfree_chains((struct ZConcurrentBuckets *) retired->ptr);
+
+  zfree(retired->ptr);
+  zfree((void *) retired);
+}
+
+// free every entry in the chains of buckets, but not buckets itself
+static void zfree_chains(struct ZConcurrentBuckets *buckets)
+{
+  size_t size, ii;
+
+  size = zbucket_count(buckets->size_index);
+
+  for (ii = 0; ii < size; ii++) {
+    struct ZConcurrentEntry *entry, *next;
+
+    entry = atomic_load_explicit(&buckets->entries[ii], memory_order_relaxed);
+    while (entry) {
+      next = atomic_load_explicit(&entry->next, memory_order_relaxed);
+      zfree((void *) entry);
+      entry = next;
+    }
+  }
+}
+
+static size_t zbucket_count(size_t size_index)
+{
+  return (size_t) ZCONCURRENT_MIN_SIZE << size_index;
+}
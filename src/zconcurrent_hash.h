@@ -0,0 +1,94 @@
+#ifndef ZCONCURRENT_HASH_H
+#define ZCONCURRENT_HASH_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "./zhash.h"
+
+// hash table for read-mostly workloads
+// keys are strings
+// values are void *pointers
+// lookups take no locks and perform no atomic read-modify-write operations;
+// writers are serialized by a mutex and publish new entries and bucket
+// arrays with release stores
+//
+// memory that writers remove is reclaimed with quiescent-state-based
+// reclamation: every thread that reads from the table registers a reader and
+// calls zconcurrent_hash_quiescent when it holds no pointers into the table
+// (for example between requests); removed memory is freed once every
+// registered reader has passed a quiescent state
+
+// struct representing an entry in the hash table
+struct ZConcurrentEntry {
+  _Atomic(struct ZConcurrentEntry *) next;
+  _Atomic(void *) val;
+  uint64_t hash;
+  size_t key_length;
+  char key[];
+};
+
+// struct representing a bucket array; replaced as a whole when the table
+// grows or shrinks
+struct ZConcurrentBuckets {
+  size_t size_index;
+  _Atomic(struct ZConcurrentEntry *) entries[];
+};
+
+// struct representing a registered reader
+// epoch is the last global epoch the reader observed in a quiescent state
+struct ZConcurrentReader {
+  _Atomic uint64_t epoch;
+  struct ZConcurrentReader *next;
+};
+
+// struct representing memory waiting to be reclaimed
+// if chains is true, ptr is a replaced bucket array and the entries in its
+// chains are freed with it
+struct ZRetiredPointer {
+  void *ptr;
+  bool chains;
+  uint64_t epoch;
+  struct ZRetiredPointer *next;
+};
+
+// struct representing the concurrent hash table
+struct ZConcurrentHashTable {
+  _Atomic(struct ZConcurrentBuckets *) buckets;
+  _Atomic uint64_t epoch;
+  size_t entry_count;
+  pthread_mutex_t write_lock;
+  struct ZConcurrentReader *readers;
+  struct ZRetiredPointer *retired;
+};
+
+// concurrent hash table creation and destruction
+// creation returns NULL if there is not enough memory
+// zfree_concurrent_hash_table must not run concurrently with any other call
+struct ZConcurrentHashTable *zcreate_concurrent_hash_table(void);
+void zfree_concurrent_hash_table(struct ZConcurrentHashTable *hash_table);
+
+// write operations; safe to call from any number of threads
+// set returns ZHASH_NO_MEMORY, and leaves the table unchanged, if a new entry
+// could not be allocated; a table that cannot allocate a larger bucket array
+// keeps its current one
+enum ZHashStatus zconcurrent_hash_set(struct ZConcurrentHashTable *hash_table,
+    char *key, void *val);
+void *zconcurrent_hash_delete(struct ZConcurrentHashTable *hash_table, char *key);
+
+// read operations; lock-free, but only safe to call from registered readers
+void *zconcurrent_hash_get(struct ZConcurrentHashTable *hash_table, char *key);
+bool zconcurrent_hash_exists(struct ZConcurrentHashTable *hash_table, char *key);
+
+// reader registration and quiescent states
+// registration returns NULL if there is not enough memory
+struct ZConcurrentReader *zconcurrent_hash_register_reader(
+    struct ZConcurrentHashTable *hash_table);
+void zconcurrent_hash_unregister_reader(struct ZConcurrentHashTable *hash_table,
+    struct ZConcurrentReader *reader);
+void zconcurrent_hash_quiescent(struct ZConcurrentHashTable *hash_table,
+    struct ZConcurrentReader *reader);
+
+#endif
@@ -0,0 +1,349 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// ZFLAT_NO_SIMD: compare control bytes one at a time even when SSE2 is
+// available (used to test the portable path)
+#if defined(__SSE2__) && !defined(ZFLAT_NO_SIMD)
+#define ZFLAT_SSE2
+#include <emmintrin.h>
+#endif
+
+#include "./zhash.h"
+#include "./zflat_hash.h"
+#include "./zflat_hash_internal.h"
+
+// helper macros and functions, declarations
+#define zfree free
+
+static struct ZFlatHashTable *zcreate_flat_hash_table_with_size(size_t size_index);
+static size_t zflat_find(struct ZFlatHashTable *hash_table, char *key, uint64_t hash);
+static size_t zflat_find_free(struct ZFlatHashTable *hash_table, uint64_t hash);
+static bool zflat_rehash(struct ZFlatHashTable *hash_table, size_t size_index);
+static uint32_t zflat_match(const signed char *group, signed char byte);
+static uint32_t zflat_match_free(const signed char *group);
+static size_t zflat_slot_count(size_t size_index);
+static size_t zflat_first_group(struct ZFlatHashTable *hash_table, uint64_t hash);
+static signed char zflat_tag(uint64_t hash);
+static unsigned zflat_lowest_bit(uint32_t mask);
+
+// functions declared in zflat_hash.h
+struct ZFlatHashTable *zcreate_flat_hash_table(void)
+{
+  return zcreate_flat_hash_table_with_size(0);
+}
+
+void zfree_flat_hash_table(struct ZFlatHashTable *hash_table)
+{
+  size_t size, ii;
+
+  size = zflat_slot_count(hash_table->size_index);
+
+  for (ii = 0; ii < size; ii++) {
+    if (hash_table->ctrl[ii] >= 0) zfree((void *) hash_table->slots[ii].key);
+  }
+
+  zfree((void *) hash_table->ctrl);
+  zfree((void *) hash_table->slots);
+  zfree((void *) hash_table);
+}
+
+enum ZHashStatus zflat_hash_set(struct ZFlatHashTable *hash_table, char *key,
+    void *val)
+{
+  size_t size, index, key_size;
+  uint64_t hash;
+  char *key_copy;
+  struct ZFlatHashSlot *slot;
+
+  hash = zhash_hash(key);
+  index = zflat_find(hash_table, key, hash);
+
+  if (index != SIZE_MAX) {
+    hash_table->slots[index].val = val;
+    return ZHASH_OK;
+  }
+
+  // copy the key first, so that a failed allocation leaves the table as it is
+  key_size = strlen(key) + 1;
+  if (!(key_copy = (char *) malloc(key_size * sizeof(char)))) {
+    return ZHASH_NO_MEMORY;
+  }
+  memcpy(key_copy, key, key_size);
+
+  size = zflat_slot_count(hash_table->size_index);
+
+  if (hash_table->entry_count + hash_table->deleted_count + 1 > size / 8 * 7) {
+    size_t size_index;
+
+    // mostly tombstones, so rebuild at the same size to clear them
+    size_index = hash_table->size_index;
+    if (hash_table->entry_count + 1 > size / 16 * 7) size_index++;
+
+    if (!zflat_rehash(hash_table, size_index)) {
+      zfree((void *) key_copy);
+      return ZHASH_NO_MEMORY;
+    }
+  }
+
+  index = zflat_find_free(hash_table, hash);
+  slot = &hash_table->slots[index];
+
+  if (hash_table->ctrl[index] == ZFLAT_DELETED) hash_table->deleted_count--;
+
+  slot->key = key_copy;
+  slot->val = val;
+  slot->hash = hash;
+
+  hash_table->ctrl[index] = zflat_tag(hash);
+  hash_table->entry_count++;
+
+  return ZHASH_OK;
+}
+
+void *zflat_hash_get(struct ZFlatHashTable *hash_table, char *key)
+{
+  size_t index;
+
+  index = zflat_find(hash_table, key, zhash_hash(key));
+
+  return index != SIZE_MAX ? hash_table->slots[index].val : NULL;
+}
+
+void *zflat_hash_delete(struct ZFlatHashTable *hash_table, char *key)
+{
+  size_t size, index, group;
+  void *val;
+
+  index = zflat_find(hash_table, key, zhash_hash(key));
+
+  if (index == SIZE_MAX) return NULL;
+
+  val = hash_table->slots[index].val;
+  zfree((void *) hash_table->slots[index].key);
+
+  // a group that still has an empty slot never caused a probe to continue
+  // past it, so the slot can be marked empty instead of deleted
+  group = index - index % ZFLAT_GROUP_SIZE;
+  if (zflat_match(hash_table->ctrl + group, ZFLAT_EMPTY)) {
+    hash_table->ctrl[index] = ZFLAT_EMPTY;
+  } else {
+    hash_table->ctrl[index] = ZFLAT_DELETED;
+    hash_table->deleted_count++;
+  }
+  hash_table->entry_count--;
+
+  size = zflat_slot_count(hash_table->size_index);
+
+  // if the smaller arrays cannot be allocated the table keeps its size
+  if (hash_table->size_index > 0 && hash_table->entry_count < size / 8) {
+    zflat_rehash(hash_table, hash_table->size_index - 1);
+  }
+
+  return val;
+}
+
+bool zflat_hash_exists(struct ZFlatHashTable *hash_table, char *key)
+{
+  return zflat_find(hash_table, key, zhash_hash(key)) != SIZE_MAX;
+}
+
+// helper functions, definitions
+static struct ZFlatHashTable *zcreate_flat_hash_table_with_size(size_t size_index)
+{
+  struct ZFlatHashTable *hash_table;
+  size_t size;
+
+  hash_table = (struct ZFlatHashTable *) malloc(sizeof(struct ZFlatHashTable));
+  if (!hash_table) return NULL;
+
+  size = zflat_slot_count(size_index);
+
+  hash_table->size_index = size_index;
+  hash_table->entry_count = 0;
+  hash_table->deleted_count = 0;
+  hash_table->ctrl = (signed char *) malloc(size);
+  hash_table->slots = malloc(size * sizeof(struct ZFlatHashSlot));
+
+  if (!hash_table->ctrl || !hash_table->slots) {
+    zfree((void *) hash_table->ctrl);
+    zfree((void *) hash_table->slots);
+    zfree((void *) hash_table);
+    return NULL;
+  }
+
+  memset(hash_table->ctrl, ZFLAT_EMPTY, size);
+
+  return hash_table;
+}
+
+// return the slot index of key, or SIZE_MAX if it is not in the table
+// probing stops at the first group that contains an empty slot
+static size_t zflat_find(struct ZFlatHashTable *hash_table, char *key, uint64_t hash)
+{
+  size_t group_mask, group, step;
+  signed char tag;
+
+  group_mask = ((size_t) 1 << hash_table->size_index) - 1;
+  group = zflat_first_group(hash_table, hash);
+  tag = zflat_tag(hash);
+
+  for (step = 1; step <= group_mask + 1; step++) {
+    const signed char *ctrl;
+    uint32_t mask;
+
+    ctrl = hash_table->ctrl + group * ZFLAT_GROUP_SIZE;
+    mask = zflat_match(ctrl, tag);
+
+    while (mask) {
+      size_t index;
+
+      index = group * ZFLAT_GROUP_SIZE + zflat_lowest_bit(mask);
+      if (hash_table->slots[index].hash == hash &&
+          strcmp(key, hash_table->slots[index].key) == 0) {
+        return index;
+      }
+      mask &= mask - 1;
+    }
+
+    if (zflat_match(ctrl, ZFLAT_EMPTY)) break;
+
+    // triangular probing visits every group when the group count is a power of 2
+    group = (group + step) & group_mask;
+  }
+
+  return SIZE_MAX;
+}
+
+// return the index of the first empty or deleted slot in the probe sequence
+static size_t zflat_find_free(struct ZFlatHashTable *hash_table, uint64_t hash)
+{
+  size_t group_mask, group, step;
+
+  group_mask = ((size_t) 1 << hash_table->size_index) - 1;
+  group = zflat_first_group(hash_table, hash);
+
+  for (step = 1; ; step++) {
+    uint32_t mask;
+
+    mask = zflat_match_free(hash_table->ctrl + group * ZFLAT_GROUP_SIZE);
+    if (mask) return group * ZFLAT_GROUP_SIZE + zflat_lowest_bit(mask);
+
+    group = (group + step) & group_mask;
+  }
+}
+
+// move every entry to new arrays with 2^size_index groups; return false and
+// leave the table as it is if they cannot be allocated
+static bool zflat_rehash(struct ZFlatHashTable *hash_table, size_t size_index)
+{
+  size_t size, ii;
+  signed char *ctrl, *new_ctrl;
+  struct ZFlatHashSlot *slots, *new_slots;
+
+  new_ctrl = (signed char *) malloc(zflat_slot_count(size_index));
+  new_slots = malloc(zflat_slot_count(size_index) *
+      sizeof(struct ZFlatHashSlot));
+
+  if (!new_ctrl || !new_slots) {
+    zfree((void *) new_ctrl);
+    zfree((void *) new_slots);
+    return false;
+  }
+
+  size = zflat_slot_count(hash_table->size_index);
+  ctrl = hash_table->ctrl;
+  slots = hash_table->slots;
+
+  hash_table->size_index = size_index;
+  hash_table->deleted_count = 0;
+  hash_table->ctrl = new_ctrl;
+  hash_table->slots = new_slots;
+
+  memset(hash_table->ctrl, ZFLAT_EMPTY, zflat_slot_count(size_index));
+
+  for (ii = 0; ii < size; ii++) {
+    size_t index;
+
+    if (ctrl[ii] < 0) continue;
+
+    index = zflat_find_free(hash_table, slots[ii].hash);
+    hash_table->ctrl[index] = ctrl[ii];
+    hash_table->slots[index] = slots[ii];
+  }
+
+  zfree((void *) ctrl);
+  zfree((void *) slots);
+
+  return true;
+}
+
+// return a bit mask of the slots in the group whose control byte is byte
+static uint32_t zflat_match(const signed char *group, signed char byte)
+{
+#ifdef ZFLAT_SSE2
+  __m128i ctrl;
+
+  ctrl = _mm_loadu_si128((const __m128i *) group);
+
+  return (uint32_t) _mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8(byte)));
+#else
+  uint32_t mask;
+  size_t ii;
+
+  mask = 0;
+  for (ii = 0; ii < ZFLAT_GROUP_SIZE; ii++) {
+    if (group[ii] == byte) mask |= (uint32_t) 1 << ii;
+  }
+
+  return mask;
+#endif
+}
+
+// return a bit mask of the slots in the group that are empty or deleted
+static uint32_t zflat_match_free(const signed char *group)
+{
+#ifdef ZFLAT_SSE2
+  return (uint32_t) _mm_movemask_epi8(_mm_loadu_si128((const __m128i *) group));
+#else
+  uint32_t mask;
+  size_t ii;
+
+  mask = 0;
+  for (ii = 0; ii < ZFLAT_GROUP_SIZE; ii++) {
+    if (group[ii] < 0) mask |= (uint32_t) 1 << ii;
+  }
+
+  return mask;
+#endif
+}
+
+static size_t zflat_slot_count(size_t size_index)
+{
+  return (size_t) ZFLAT_GROUP_SIZE << size_index;
+}
+
+static size_t zflat_first_group(struct ZFlatHashTable *hash_table, uint64_t hash)
+{
+  return ZFLAT_FIRST_GROUP(hash, hash_table->size_index);
+}
+
+static signed char zflat_tag(uint64_t hash)
+{
+  return ZFLAT_TAG(hash);
+}
+
+static unsigned zflat_lowest_bit(uint32_t mask)
+{
+#ifdef __GNUC__
+  return (unsigned) __builtin_ctz(mask);
+#else
+  unsigned bit;
+
+  for (bit = 0; !(mask & 1); bit++) mask >>= 1;
+
+  return bit;
+#endif
+}
+
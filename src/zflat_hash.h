@@ -0,0 +1,49 @@
+#ifndef ZFLAT_HASH_H
+#define ZFLAT_HASH_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "./zhash.h"
+
+// flat hash table, uses open addressing instead of chaining
+// keys are strings
+// values are void *pointers
+// supports the same operations as zhash
+
+// number of slots whose control bytes are probed together
+#define ZFLAT_GROUP_SIZE 16
+
+// struct representing a slot in the hash table
+struct ZFlatHashSlot {
+  char *key;
+  void *val;
+  uint64_t hash;
+};
+
+// struct representing the flat hash table
+// the table has (ZFLAT_GROUP_SIZE << size_index) slots
+// ctrl holds one byte per slot: empty, deleted, or 7 bits of the key's hash
+struct ZFlatHashTable {
+  size_t size_index;
+  size_t entry_count;
+  size_t deleted_count;
+  signed char *ctrl;
+  struct ZFlatHashSlot *slots;
+};
+
+// flat hash table creation and destruction
+// creation returns NULL if there is not enough memory
+struct ZFlatHashTable *zcreate_flat_hash_table(void);
+void zfree_flat_hash_table(struct ZFlatHashTable *hash_table);
+
+// flat hash table operations
+// set returns ZHASH_NO_MEMORY and leaves the table unchanged if the key cannot
+// be copied or the table cannot grow
+enum ZHashStatus zflat_hash_set(struct ZFlatHashTable *hash_table, char *key,
+    void *val);
+void *zflat_hash_get(struct ZFlatHashTable *hash_table, char *key);
+void *zflat_hash_delete(struct ZFlatHashTable *hash_table, char *key);
+bool zflat_hash_exists(struct ZFlatHashTable *hash_table, char *key);
+
+#endif
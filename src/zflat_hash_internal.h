@@ -0,0 +1,17 @@
+#ifndef ZFLAT_HASH_INTERNAL_H
+#define ZFLAT_HASH_INTERNAL_H
+
+// encoding of the control bytes of ZFlatHashTable, shared by zflat_hash.c and
+// its tests; not part of the public interface
+
+// control byte values; full slots store the low 7 bits of the hash (0 to 127)
+#define ZFLAT_EMPTY ((signed char) -128)
+#define ZFLAT_DELETED ((signed char) -2)
+
+// the high bits of the hash pick the first group of the probe sequence in a
+// table with 2^size_index groups, the low 7 bits are the tag
+#define ZFLAT_FIRST_GROUP(hash, size_index) \
+  ((size_t) ((hash) >> 7) & (((size_t) 1 << (size_index)) - 1))
+#define ZFLAT_TAG(hash) ((signed char) ((hash) & 0x7f))
+
+#endif
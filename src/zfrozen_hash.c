@@ -0,0 +1,420 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "./zhash.h"
+#include "./zfrozen_hash.h"
+
+// helper macros and functions, declarations
+#define zfree free
+
+// average number of keys per bucket; larger buckets need less memory for
+// pilots but take longer to build
+#define ZFROZEN_BUCKET_SIZE 4
+
+// pilots tried for a bucket before its keys are put in the overflow array
+#ifndef ZFROZEN_MAX_PILOT
+#define ZFROZEN_MAX_PILOT (UINT32_MAX - 1)
+#endif
+
+// bits of the hash that are kept; tests clear most of them to make keys
+// collide
+#ifndef ZFROZEN_HASH_MASK
+#define ZFROZEN_HASH_MASK UINT64_MAX
+#endif
+
+// struct representing an entry of the table being frozen
+struct ZFrozenSource {
+  char *key;
+  size_t key_length;
+  void *val;
+  uint64_t hash;
+  size_t slot;
+};
+
+// struct used to collect the entries of the table being frozen
+struct ZFrozenSources {
+  struct ZFrozenSource *sources;
+  size_t count;
+};
+
+static void zcollect_entry(struct ZHashEntry *entry, void *ctx);
+static bool zplace_bucket(struct ZFrozenHashTable *hash_table, size_t bucket,
+    struct ZFrozenSource **sources, size_t count, bool *taken);
+static struct ZFrozenSlot *zfrozen_find(struct ZFrozenHashTable *hash_table,
+    const char *key, size_t len);
+static bool zslot_matches(struct ZFrozenHashTable *hash_table,
+    struct ZFrozenSlot *slot, const char *key, size_t len, uint64_t hash);
+static struct ZFrozenSlot *zoverflow_find(struct ZFrozenHashTable *hash_table,
+    const char *key, size_t len, uint64_t hash);
+static int zcompare_hashes(const void *a, const void *b);
+static size_t zfrozen_bucket(uint64_t hash, size_t bucket_count);
+static size_t zfrozen_slot(uint64_t hash, uint32_t pilot, size_t slot_count);
+
+// functions declared in zfrozen_hash.h
+// every array is allocated before the build starts, so that running out of
+// memory leaves nothing half built
+struct ZFrozenHashTable *zhash_freeze(struct ZHashTable *hash_table)
+{
+  struct ZFrozenHashTable *frozen;
+  struct ZFrozenSources collected;
+  struct ZFrozenSource **order, **overflow;
+  struct ZFrozenSlot *overflow_slots;
+  size_t *bucket_starts, *by_size, *size_starts;
+  size_t entry_count, bucket_count, max_size, key_bytes, overflow_count, ii;
+  bool *taken;
+  char *cursor;
+
+  entry_count = hash_table->entry_count;
+  bucket_count = entry_count / ZFROZEN_BUCKET_SIZE + 1;
+
+  collected.sources = malloc((entry_count + 1) * sizeof(struct ZFrozenSource));
+  collected.count = 0;
+  key_bytes = 0;
+
+  if (collected.sources) {
+    zhash_foreach_entry(hash_table, zcollect_entry, &collected);
+
+    for (ii = 0; ii < collected.count; ii++) {
+      key_bytes += collected.sources[ii].key_length + 1;
+    }
+  }
+
+  // the overflow array has room for every key until the number of keys that
+  // go there is known
+  if ((frozen = calloc(1, sizeof(struct ZFrozenHashTable)))) {
+    frozen->pilots = calloc(bucket_count, sizeof(uint32_t));
+    frozen->slots = malloc((entry_count + 1) * sizeof(struct ZFrozenSlot));
+    frozen->keys = malloc(key_bytes + 1);
+    frozen->overflow = malloc((entry_count + 1) * sizeof(struct ZFrozenSlot));
+  }
+
+  bucket_starts = calloc(bucket_count + 1, sizeof(size_t));
+  order = malloc((entry_count + 1) * sizeof(struct ZFrozenSource *));
+  size_starts = calloc(entry_count + 2, sizeof(size_t));
+  by_size = malloc(bucket_count * sizeof(size_t));
+  taken = calloc(entry_count + 1, sizeof(bool));
+  overflow = malloc((entry_count + 1) * sizeof(struct ZFrozenSource *));
+
+  if (!collected.sources || !frozen || !frozen->pilots || !frozen->slots ||
+      !frozen->keys || !frozen->overflow || !bucket_starts || !order ||
+      !size_starts || !by_size || !taken || !overflow) {
+    if (frozen) zfree_frozen_hash_table(frozen);
+    zfree(taken);
+    zfree(overflow);
+    zfree(by_size);
+    zfree(size_starts);
+    zfree(order);
+    zfree(bucket_starts);
+    zfree(collected.sources);
+    return NULL;
+  }
+
+  frozen->entry_count = collected.count;
+  frozen->bucket_count = bucket_count;
+
+  // group the keys by bucket with a counting sort
+  for (ii = 0; ii < collected.count; ii++) {
+    bucket_starts[zfrozen_bucket(collected.sources[ii].hash,
+        frozen->bucket_count) + 1]++;
+  }
+
+  max_size = 0;
+  for (ii = 0; ii < frozen->bucket_count; ii++) {
+    if (bucket_starts[ii + 1] > max_size) max_size = bucket_starts[ii + 1];
+    bucket_starts[ii + 1] += bucket_starts[ii];
+  }
+
+  for (ii = 0; ii < collected.count; ii++) {
+    size_t bucket;
+
+    bucket = zfrozen_bucket(collected.sources[ii].hash, frozen->bucket_count);
+    order[bucket_starts[bucket]++] = &collected.sources[ii];
+  }
+
+  memmove(bucket_starts + 1, bucket_starts,
+      frozen->bucket_count * sizeof(size_t));
+  bucket_starts[0] = 0;
+
+  // place the largest buckets first, while most slots are free
+  for (ii = 0; ii < frozen->bucket_count; ii++) {
+    size_starts[max_size - (bucket_starts[ii + 1] - bucket_starts[ii]) + 1]++;
+  }
+  for (ii = 0; ii <= max_size; ii++) size_starts[ii + 1] += size_starts[ii];
+  for (ii = 0; ii < frozen->bucket_count; ii++) {
+    by_size[size_starts[max_size -
+      (bucket_starts[ii + 1] - bucket_starts[ii])]++] = ii;
+  }
+
+  overflow_count = 0;
+
+  for (ii = 0; ii < frozen->bucket_count; ii++) {
+    size_t bucket, start, count, jj, kk;
+
+    bucket = by_size[ii];
+    start = bucket_starts[bucket];
+    count = bucket_starts[bucket + 1] - start;
+
+    // no pilot can separate keys with the same hash, so all but one of them
+    // go to the overflow array
+    for (jj = 1; jj < count; jj++) {
+      for (kk = 0; kk < jj; kk++) {
+        if (order[start + kk]->hash == order[start + jj]->hash) break;
+      }
+
+      if (kk < jj) {
+        overflow[overflow_count++] = order[start + jj];
+        order[start + jj] = order[start + count - 1];
+        count--;
+        jj--;
+      }
+    }
+
+    if (!zplace_bucket(frozen, bucket, order + start, count, taken)) {
+      frozen->pilots[bucket] = ZFROZEN_NO_PILOT;
+
+      for (jj = 0; jj < count; jj++) {
+        overflow[overflow_count++] = order[start + jj];
+      }
+    }
+  }
+
+  // the overflow array is sorted by hash, so the keys that share a hash are
+  // next to each other and found by a binary search
+  qsort(overflow, overflow_count, sizeof(struct ZFrozenSource *),
+      zcompare_hashes);
+
+  // shrinking cannot lose the contents, so a failed realloc keeps the larger
+  // array
+  frozen->overflow_count = overflow_count;
+  overflow_slots = realloc(frozen->overflow,
+      (overflow_count + 1) * sizeof(struct ZFrozenSlot));
+  if (overflow_slots) frozen->overflow = overflow_slots;
+
+  for (ii = 0; ii < collected.count; ii++) {
+    frozen->slots[ii].hash = 0;
+    frozen->slots[ii].key_offset = 0;
+    frozen->slots[ii].key_length = SIZE_MAX;
+    frozen->slots[ii].val = NULL;
+  }
+
+  // order now maps each taken slot to its key
+  for (ii = 0; ii < collected.count; ii++) {
+    struct ZFrozenSource *source;
+
+    source = &collected.sources[ii];
+    if (source->slot != SIZE_MAX) order[source->slot] = source;
+  }
+
+  // copy the keys in slot order, then the keys of the overflow array
+  cursor = frozen->keys;
+
+  for (ii = 0; ii < collected.count + overflow_count; ii++) {
+    struct ZFrozenSource *source;
+    struct ZFrozenSlot *slot;
+
+    if (ii < collected.count) {
+      if (!taken[ii]) continue;
+
+      source = order[ii];
+      slot = &frozen->slots[ii];
+    } else {
+      source = overflow[ii - collected.count];
+      slot = &frozen->overflow[ii - collected.count];
+    }
+
+    slot->hash = source->hash;
+    slot->key_offset = (size_t) (cursor - frozen->keys);
+    slot->key_length = source->key_length;
+    slot->val = source->val;
+
+    memcpy(cursor, source->key, source->key_length);
+    cursor[source->key_length] = '\0';
+    cursor += source->key_length + 1;
+  }
+
+  zfree(taken);
+  zfree(overflow);
+  zfree(by_size);
+  zfree(size_starts);
+  zfree(order);
+  zfree(bucket_starts);
+  zfree(collected.sources);
+
+  return frozen;
+}
+
+void zfree_frozen_hash_table(struct ZFrozenHashTable *hash_table)
+{
+  zfree(hash_table->pilots);
+  zfree(hash_table->slots);
+  zfree(hash_table->keys);
+  zfree(hash_table->overflow);
+  zfree(hash_table);
+}
+
+void *zfrozen_hash_get(struct ZFrozenHashTable *hash_table, char *key)
+{
+  struct ZFrozenSlot *slot;
+
+  slot = zfrozen_find(hash_table, key, strlen(key));
+
+  return slot ? slot->val : NULL;
+}
+
+bool zfrozen_hash_exists(struct ZFrozenHashTable *hash_table, char *key)
+{
+  return zfrozen_find(hash_table, key, strlen(key)) ? true : false;
+}
+
+size_t zfrozen_hash_count(struct ZFrozenHashTable *hash_table)
+{
+  return hash_table->entry_count;
+}
+
+// helper functions, definitions
+// the hash cached in the entry is reused instead of hashing the key again
+static void zcollect_entry(struct ZHashEntry *entry, void *ctx)
+{
+  struct ZFrozenSources *collected;
+  struct ZFrozenSource *source;
+
+  collected = (struct ZFrozenSources *) ctx;
+  source = &collected->sources[collected->count++];
+
+  source->key = entry->key;
+  source->key_length = entry->key_length;
+  source->val = entry->val;
+  source->hash = entry->hash & ZFROZEN_HASH_MASK;
+  source->slot = SIZE_MAX;
+}
+
+// find a pilot that sends every key of the bucket to a free slot, and take
+// those slots; return false if there is none
+static bool zplace_bucket(struct ZFrozenHashTable *hash_table, size_t bucket,
+    struct ZFrozenSource **sources, size_t count, bool *taken)
+{
+  uint32_t pilot;
+  size_t ii;
+
+  if (count == 0) return true;
+
+  for (pilot = 0; ; pilot++) {
+    for (ii = 0; ii < count; ii++) {
+      size_t slot;
+
+      slot = zfrozen_slot(sources[ii]->hash, pilot, hash_table->entry_count);
+      if (taken[slot]) break;
+
+      taken[slot] = true;
+      sources[ii]->slot = slot;
+    }
+
+    if (ii == count) {
+      hash_table->pilots[bucket] = pilot;
+      return true;
+    }
+
+    while (ii-- > 0) taken[sources[ii]->slot] = false;
+
+    if (pilot == ZFROZEN_MAX_PILOT) break;
+  }
+
+  for (ii = 0; ii < count; ii++) sources[ii]->slot = SIZE_MAX;
+
+  return false;
+}
+
+// every key is compared once, with the key in the slot its pilot gives it
+// a key in the overflow array has the hash of the key in that slot, or a
+// bucket without a pilot, so only those lookups search the overflow array
+static struct ZFrozenSlot *zfrozen_find(struct ZFrozenHashTable *hash_table,
+    const char *key, size_t len)
+{
+  struct ZFrozenSlot *slot;
+  uint64_t hash;
+  uint32_t pilot;
+
+  if (hash_table->entry_count == 0) return NULL;
+
+  hash = zhash_hash_n(key, len) & ZFROZEN_HASH_MASK;
+  pilot = hash_table->pilots[zfrozen_bucket(hash, hash_table->bucket_count)];
+
+  if (pilot != ZFROZEN_NO_PILOT) {
+    slot = &hash_table->slots[zfrozen_slot(hash, pilot,
+        hash_table->entry_count)];
+
+    if (zslot_matches(hash_table, slot, key, len, hash)) return slot;
+    if (slot->hash != hash || slot->key_length == SIZE_MAX) return NULL;
+  }
+
+  return zoverflow_find(hash_table, key, len, hash);
+}
+
+// binary search for the first overflow key with hash, then compare the keys
+// that share it
+static struct ZFrozenSlot *zoverflow_find(struct ZFrozenHashTable *hash_table,
+    const char *key, size_t len, uint64_t hash)
+{
+  size_t low, high, middle;
+
+  low = 0;
+  high = hash_table->overflow_count;
+
+  while (low < high) {
+    middle = low + (high - low) / 2;
+
+    if (hash_table->overflow[middle].hash < hash) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+
+  for (; low < hash_table->overflow_count &&
+      hash_table->overflow[low].hash == hash; low++) {
+    if (zslot_matches(hash_table, &hash_table->overflow[low], key, len, hash)) {
+      return &hash_table->overflow[low];
+    }
+  }
+
+  return NULL;
+}
+
+static int zcompare_hashes(const void *a, const void *b)
+{
+  uint64_t hash_a, hash_b;
+
+  hash_a = (*(struct ZFrozenSource * const *) a)->hash;
+  hash_b = (*(struct ZFrozenSource * const *) b)->hash;
+
+  return (hash_a > hash_b) - (hash_a < hash_b);
+}
+
+static bool zslot_matches(struct ZFrozenHashTable *hash_table,
+    struct ZFrozenSlot *slot, const char *key, size_t len, uint64_t hash)
+{
+  return slot->hash == hash && slot->key_length == len &&
+    memcmp(hash_table->keys + slot->key_offset, key, len) == 0;
+}
+
+// the high 32 bits of the hash pick the bucket
+static size_t zfrozen_bucket(uint64_t hash, size_t bucket_count)
+{
+  return (size_t) (((hash >> 32) * (uint64_t) bucket_count) >> 32);
+}
+
+// the slot is the hash mixed with the pilot (murmur3's finalizer), modulo the
+// number of slots
+static size_t zfrozen_slot(uint64_t hash, uint32_t pilot, size_t slot_count)
+{
+  hash ^= ((uint64_t) pilot + 1) * 0x9e3779b97f4a7c15ull;
+  hash ^= hash >> 33;
+  hash *= 0xff51afd7ed558ccdull;
+  hash ^= hash >> 33;
+  hash *= 0xc4ceb9fe1a85ec53ull;
+  hash ^= hash >> 33;
+
+  return (size_t) (hash % slot_count);
+}
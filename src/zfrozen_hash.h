@@ -0,0 +1,59 @@
+#ifndef ZFROZEN_HASH_H
+#define ZFROZEN_HASH_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "./zhash.h"
+
+// frozen hash table, an immutable copy of a ZHashTable
+// keys are strings
+// values are void *pointers
+// the table is built with a minimal perfect hash function (CHD style hash and
+// displace): keys are split into buckets by their hash, and each bucket is
+// given a pilot value such that hashing its keys with the pilot moves every
+// key of the table to a different slot; there are exactly as many slots as
+// keys, so a lookup reads one pilot and one slot and compares one key
+
+// pilot of a bucket whose keys are all in the overflow array
+#define ZFROZEN_NO_PILOT UINT32_MAX
+
+// struct representing a slot in the frozen hash table
+// key is in the keys array of the table; key_length is SIZE_MAX for a slot
+// without a key
+struct ZFrozenSlot {
+  uint64_t hash;
+  size_t key_offset;
+  size_t key_length;
+  void *val;
+};
+
+// struct representing the frozen hash table
+// slots has entry_count slots and pilots has one pilot per bucket
+// keys holds every key followed by a NUL byte, in slot order
+// the rare keys that could not be given a slot (because another key has the
+// same 64-bit hash, or no pilot fits their bucket) are in overflow, sorted by
+// hash; it is only searched when the slot holds a key with the same hash, or
+// when the bucket's pilot is ZFROZEN_NO_PILOT, so a miss stays O(1)
+struct ZFrozenHashTable {
+  size_t entry_count;
+  size_t bucket_count;
+  uint32_t *pilots;
+  struct ZFrozenSlot *slots;
+  char *keys;
+  size_t overflow_count;
+  struct ZFrozenSlot *overflow;
+};
+
+// build a frozen copy of hash_table; hash_table is not changed
+// keys are copied, values are not; return NULL if there is not enough memory
+struct ZFrozenHashTable *zhash_freeze(struct ZHashTable *hash_table);
+void zfree_frozen_hash_table(struct ZFrozenHashTable *hash_table);
+
+// frozen hash table operations; these behave the same as zhash_get and
+// zhash_exists
+void *zfrozen_hash_get(struct ZFrozenHashTable *hash_table, char *key);
+bool zfrozen_hash_exists(struct ZFrozenHashTable *hash_table, char *key);
+size_t zfrozen_hash_count(struct ZFrozenHashTable *hash_table);
+
+#endif
@@ -1,6 +1,13 @@
+// clock_gettime and CLOCK_MONOTONIC with -std=c11
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 199309L
+#endif
+
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 #include "./zhash.h"
 
@@ -8,15 +15,123 @@
 #define ZCOUNT_OF(arr) (sizeof(arr) / sizeof(*arr))
 #define zfree free
 
-static struct ZHashEntry *zcreate_entry(char *key, void *val);
-static void zfree_entry(struct ZHashEntry *entry, bool recursive);
-static size_t zgenerate_hash(struct ZHashTable *hash_table, char *key);
-static void zhash_rehash(struct ZHashTable *hash_table, size_t size_index);
-static size_t znext_size_index(size_t size_index);
+// number of buckets moved per operation while an incremental rehash is running
+#define ZREHASH_STEP 16
+
+// zhash_scan cursors of prime sized tables with this bit set are buckets of
+// old_entries
+#define ZSCAN_OLD (~(SIZE_MAX >> 1))
+
+// number of keys whose memory accesses are overlapped by zhash_get_many
+#define ZPREFETCH_GROUP 16
+
+// ZHASH_PROBE_STATS: count lookups and the entries they compare
+// lookups may run concurrently under a read lock (see zsharded_hash.c), so the
+// counters are incremented atomically
+#if defined(ZHASH_PROBE_STATS) && defined(__GNUC__)
+#define zcount_probe(hash_table, field) \
+  ((void) __atomic_fetch_add(&(hash_table)->field, 1, __ATOMIC_RELAXED))
+#elif defined(ZHASH_PROBE_STATS)
+#define zcount_probe(hash_table, field) ((hash_table)->field++)
+#else
+#define zcount_probe(hash_table, field) ((void) (hash_table))
+#endif
+
+#ifdef __GNUC__
+#define zprefetch(addr) __builtin_prefetch(addr)
+#else
+#define zprefetch(addr) ((void) (addr))
+#endif
+
+// slab pages start small and double up to the maximum size
+#define ZSLAB_MIN_PAGE_SIZE 1024
+#define ZSLAB_MAX_PAGE_SIZE 65536
+
+// blocks allocated individually start with a list header, padded so that the
+// block after it stays aligned
+#define ZSLAB_LARGE_HEADER ((sizeof(struct ZSlabLarge) + ZSLAB_ALIGN - 1) / \
+    ZSLAB_ALIGN * ZSLAB_ALIGN)
+
+static struct ZHashEntry *zcreate_entry(struct ZHashTable *hash_table,
+    const void *key, size_t key_length, uint64_t hash, void *val);
+static void zfree_entry(struct ZHashTable *hash_table, struct ZHashEntry *entry);
+static size_t zentry_size(size_t key_length);
+static void zslab_init(struct ZSlab *slab, const struct ZAllocator *allocator);
+static void *zslab_alloc(struct ZSlab *slab, size_t size);
+static void zslab_free(struct ZSlab *slab, void *ptr, size_t size);
+static void zslab_release(struct ZSlab *slab);
+static enum ZHashStatus zhash_set_hashed(struct ZHashTable *hash_table,
+    const void *key, size_t len, uint64_t hash, void *val);
+static void *zhash_get_hashed(struct ZHashTable *hash_table, const void *key,
+    size_t len, uint64_t hash);
+static void *zhash_delete_hashed(struct ZHashTable *hash_table,
+    const void *key, size_t len, uint64_t hash);
+static bool zhash_exists_hashed(struct ZHashTable *hash_table,
+    const void *key, size_t len, uint64_t hash);
+static void zhash_lookup_group(struct ZHashTable *hash_table, char **keys,
+    size_t n, struct ZHashEntry **found);
+static struct ZHashEntry *zhash_upsert(struct ZHashTable *hash_table,
+    const void *key, size_t len, uint64_t hash, bool *created);
+static struct ZHashEntry *zhash_unlink(struct ZHashTable *hash_table,
+    const void *key, size_t len, uint64_t hash);
+static struct ZHashEntry *zinsert_entry(struct ZHashTable *hash_table,
+    const void *key, size_t len, uint64_t hash, void *val);
+static struct ZHashEntry **zfind_link(struct ZHashTable *hash_table,
+    struct ZHashEntry *entry);
+static void zremove_link(struct ZHashTable *hash_table,
+    struct ZHashEntry **link);
+static struct ZHashEntry **zfind_entry(struct ZHashTable *hash_table,
+    const void *key, size_t key_length, uint64_t hash);
+static void zvisit_chain(struct ZHashEntry *entry, ZHashVisitor visitor,
+    void *ctx);
+static void zvisit_entry_chain(struct ZHashEntry *entry,
+    ZHashEntryVisitor visitor, void *ctx);
+static size_t zscan_prime(struct ZHashTable *hash_table, size_t cursor,
+    ZHashVisitor visitor, void *ctx);
+static size_t zscan_next(size_t cursor, size_t mask);
+static size_t zreverse_bits(size_t bits);
+static struct ZHashEntry **zfind_in_chain(struct ZHashTable *hash_table,
+    struct ZHashEntry **link, const void *key, size_t key_length,
+    uint64_t hash);
+static void zstats_chains(struct ZHashTable *hash_table,
+    struct ZHashEntry **entries, size_t start, size_t end,
+    struct ZHashStats *stats);
+static uint64_t znow_ns(void);
+static uint64_t zgenerate_hash(const void *key, size_t key_length);
+static size_t zbucket_index(struct ZHashTable *hash_table, uint64_t hash,
+    size_t size_index);
+static size_t zsize(unsigned flags, size_t size_index);
+static uint64_t zmix(uint64_t a, uint64_t b);
+static uint64_t zread8(const unsigned char *ptr);
+static uint64_t zread4(const unsigned char *ptr);
+static bool zhash_rehash(struct ZHashTable *hash_table, size_t size_index);
+static void zhash_rehash_step(struct ZHashTable *hash_table);
+static void zfinish_rehash(struct ZHashTable *hash_table);
+static void zmigrate_buckets(struct ZHashTable *hash_table, size_t bucket_count);
+static size_t zcapacity_size_index(unsigned flags,
+    const struct ZHashPolicy *policy, size_t capacity);
+static void zupdate_thresholds(struct ZHashTable *hash_table);
+static size_t zmax_size_index(unsigned flags);
+static size_t znext_size_index(unsigned flags,
+    const struct ZHashPolicy *policy, size_t size_index);
+static bool zpolicy_valid(unsigned flags, const struct ZHashPolicy *policy);
 static size_t zprevious_size_index(size_t size_index);
-static struct ZHashTable *zcreate_hash_table_with_size(size_t size_index);
-static void *zmalloc(size_t size);
-static void *zcalloc(size_t num, size_t size);
+static struct ZHashTable *zcreate_hash_table_with_size(size_t size_index,
+    unsigned flags, const struct ZAllocator *allocator);
+static void *zmalloc(const struct ZAllocator *allocator, size_t size);
+static void *zcalloc(const struct ZAllocator *allocator, size_t num,
+    size_t size);
+static void zrelease(const struct ZAllocator *allocator, void *ptr);
+static void *zdefault_alloc(size_t size, void *ctx);
+static void *zdefault_calloc(size_t num, size_t size, void *ctx);
+static void zdefault_free(void *ptr, void *ctx);
+
+// largest max_load accepted by zhash_set_policy
+#define ZMAX_LOAD 64.0
+
+// power of 2 tables have (ZPOW2_MIN_SIZE << size_index) buckets, up to 2^31
+#define ZPOW2_MIN_SIZE ((size_t) 64)
+#define ZPOW2_MAX_SIZE_INDEX 25
 
 // possible sizes for hash table; must be prime numbers
 static const size_t hash_sizes[] = {
@@ -25,218 +140,1258 @@ static const size_t hash_sizes[] = {
   25000009, 50000047, 104395301, 217645177, 512927357, 1000000007
 };
 
+// grow above 50% load, shrink below 12.5% load, double when growing
+static const struct ZHashPolicy default_policy = { 0.5, 0.125, 2 };
+
+static const struct ZAllocator default_allocator = {
+  zdefault_alloc, zdefault_calloc, zdefault_free, NULL
+};
+
+// secrets for zgenerate_hash (taken from wyhash)
+static const uint64_t hash_secrets[] = {
+  0x2d358dccaa6c78a5ull, 0x8bb84b93962eacc9ull,
+  0x4b33a62ed433d4a3ull, 0x4d5a2da51de1aa47ull
+};
+
 // functions declared in zhash.h
 struct ZHashTable *zcreate_hash_table(void)
 {
-  return zcreate_hash_table_with_size(0);
+  return zcreate_hash_table_with_size(0, 0, &default_allocator);
+}
+
+struct ZHashTable *zcreate_hash_table_with_flags(unsigned flags)
+{
+  return zcreate_hash_table_with_size(0, flags, &default_allocator);
+}
+
+struct ZHashTable *zcreate_hash_table_with_capacity(unsigned flags,
+    size_t capacity)
+{
+  return zcreate_hash_table_with_size(
+      zcapacity_size_index(flags, &default_policy, capacity), flags,
+      &default_allocator);
 }
 
 void zfree_hash_table(struct ZHashTable *hash_table)
+{
+  struct ZAllocator allocator;
+
+  // every entry is released with the slab, so the chains are not walked
+  zrelease(&hash_table->allocator, (void *) hash_table->entries);
+  if (hash_table->old_entries) {
+    zrelease(&hash_table->allocator, (void *) hash_table->old_entries);
+  }
+
+  zslab_release(&hash_table->slab);
+
+  // the allocator is part of the table being freed
+  allocator = hash_table->allocator;
+  zrelease(&allocator, (void *) hash_table);
+}
+
+struct ZHashTable *zcreate_hash_table_with_allocator(unsigned flags,
+    size_t entry_prefix, const struct ZAllocator *allocator)
+{
+  struct ZHashTable *hash_table;
+
+  hash_table = zcreate_hash_table_with_size(0, flags,
+      allocator ? allocator : &default_allocator);
+
+  if (hash_table) {
+    hash_table->entry_prefix = (entry_prefix + sizeof(void *) - 1) /
+      sizeof(void *) * sizeof(void *);
+  }
+
+  return hash_table;
+}
+
+enum ZHashStatus zhash_set(struct ZHashTable *hash_table, char *key, void *val)
+{
+  return zhash_set_n(hash_table, key, strlen(key), val);
+}
+
+void *zhash_get(struct ZHashTable *hash_table, char *key)
+{
+  return zhash_get_n(hash_table, key, strlen(key));
+}
+
+void *zhash_delete(struct ZHashTable *hash_table, char *key)
+{
+  return zhash_delete_n(hash_table, key, strlen(key));
+}
+
+bool zhash_exists(struct ZHashTable *hash_table, char *key)
+{
+  return zhash_exists_n(hash_table, key, strlen(key));
+}
+
+enum ZHashStatus zhash_set_n(struct ZHashTable *hash_table, const void *key,
+    size_t len, void *val)
+{
+  return zhash_set_hashed(hash_table, key, len, zgenerate_hash(key, len), val);
+}
+
+void *zhash_get_n(struct ZHashTable *hash_table, const void *key, size_t len)
+{
+  return zhash_get_hashed(hash_table, key, len, zgenerate_hash(key, len));
+}
+
+void *zhash_delete_n(struct ZHashTable *hash_table, const void *key, size_t len)
+{
+  return zhash_delete_hashed(hash_table, key, len, zgenerate_hash(key, len));
+}
+
+bool zhash_exists_n(struct ZHashTable *hash_table, const void *key, size_t len)
+{
+  return zhash_exists_hashed(hash_table, key, len, zgenerate_hash(key, len));
+}
+
+enum ZHashStatus zhash_set_prehashed(struct ZHashTable *hash_table, char *key,
+    uint64_t hash, void *val)
+{
+  return zhash_set_hashed(hash_table, key, strlen(key), hash, val);
+}
+
+void *zhash_get_prehashed(struct ZHashTable *hash_table, char *key,
+    uint64_t hash)
+{
+  return zhash_get_hashed(hash_table, key, strlen(key), hash);
+}
+
+void *zhash_delete_prehashed(struct ZHashTable *hash_table, char *key,
+    uint64_t hash)
+{
+  return zhash_delete_hashed(hash_table, key, strlen(key), hash);
+}
+
+bool zhash_exists_prehashed(struct ZHashTable *hash_table, char *key,
+    uint64_t hash)
+{
+  return zhash_exists_hashed(hash_table, key, strlen(key), hash);
+}
+
+void zhash_get_many(struct ZHashTable *hash_table, char **keys, size_t n,
+    void **vals)
+{
+  struct ZHashEntry *found[ZPREFETCH_GROUP];
+  size_t ii, jj, group_size;
+
+  for (ii = 0; ii < n; ii += group_size) {
+    group_size = n - ii < ZPREFETCH_GROUP ? n - ii : ZPREFETCH_GROUP;
+
+    zhash_lookup_group(hash_table, keys + ii, group_size, found);
+
+    for (jj = 0; jj < group_size; jj++) {
+      vals[ii + jj] = found[jj] ? found[jj]->val : NULL;
+    }
+  }
+}
+
+void zhash_exists_many(struct ZHashTable *hash_table, char **keys, size_t n,
+    bool *exists)
+{
+  struct ZHashEntry *found[ZPREFETCH_GROUP];
+  size_t ii, jj, group_size;
+
+  for (ii = 0; ii < n; ii += group_size) {
+    group_size = n - ii < ZPREFETCH_GROUP ? n - ii : ZPREFETCH_GROUP;
+
+    zhash_lookup_group(hash_table, keys + ii, group_size, found);
+
+    for (jj = 0; jj < group_size; jj++) {
+      exists[ii + jj] = found[jj] ? true : false;
+    }
+  }
+}
+
+enum ZHashStatus zhash_reserve(struct ZHashTable *hash_table, size_t capacity)
+{
+  size_t size_index;
+
+  size_index = zcapacity_size_index(hash_table->flags, &hash_table->policy,
+      capacity);
+
+  if (size_index > hash_table->size_index &&
+      !zhash_rehash(hash_table, size_index)) {
+    return ZHASH_NO_MEMORY;
+  }
+
+  return ZHASH_OK;
+}
+
+enum ZHashStatus zhash_bulk_load(struct ZHashTable *hash_table, char **keys,
+    void **vals, size_t n)
+{
+  size_t ii;
+
+  // without the larger bucket array every insert below would go into the
+  // current one, far above max_load
+  if (zhash_reserve(hash_table, hash_table->entry_count + n) != ZHASH_OK) {
+    return ZHASH_NO_MEMORY;
+  }
+
+  // finish any incremental rehash so that the inserts below never move buckets
+  zfinish_rehash(hash_table);
+
+  for (ii = 0; ii < n; ii++) {
+    struct ZHashEntry **link;
+    size_t len;
+    uint64_t hash;
+
+    len = strlen(keys[ii]);
+    hash = zgenerate_hash(keys[ii], len);
+    link = zfind_entry(hash_table, keys[ii], len, hash);
+
+    if (*link) {
+      (*link)->val = vals[ii];
+    } else if (!zinsert_entry(hash_table, keys[ii], len, hash, vals[ii])) {
+      return ZHASH_NO_MEMORY;
+    }
+  }
+
+  return ZHASH_OK;
+}
+
+bool zhash_set_policy(struct ZHashTable *hash_table,
+    const struct ZHashPolicy *policy)
+{
+  if (!zpolicy_valid(hash_table->flags, policy)) return false;
+
+  hash_table->policy = *policy;
+  zupdate_thresholds(hash_table);
+
+  return true;
+}
+
+void zhash_shrink_to_fit(struct ZHashTable *hash_table)
+{
+  size_t size_index;
+
+  size_index = zcapacity_size_index(hash_table->flags, &hash_table->policy,
+      hash_table->entry_count);
+
+  if (size_index < hash_table->size_index) zhash_rehash(hash_table, size_index);
+}
+
+void zhash_foreach(struct ZHashTable *hash_table, ZHashVisitor visitor,
+    void *ctx)
 {
   size_t size, ii;
 
-  size = hash_sizes[hash_table->size_index];
+  size = zsize(hash_table->flags, hash_table->size_index);
 
   for (ii = 0; ii < size; ii++) {
-    struct ZHashEntry *entry;
+    zvisit_chain(hash_table->entries[ii], visitor, ctx);
+  }
+
+  if (hash_table->old_entries) {
+    size = zsize(hash_table->flags, hash_table->old_size_index);
+
+    for (ii = hash_table->rehash_index; ii < size; ii++) {
+      zvisit_chain(hash_table->old_entries[ii], visitor, ctx);
+    }
+  }
+}
+
+// visit the buckets at cursor and return the cursor for the next call
+// for power of 2 tables the cursor is incremented from its high bits down
+// (reverse binary), as in Redis SCAN: when the table doubles, bucket b splits
+// into b and b + size, and both come after every bucket already visited, so
+// resizing between calls never makes the scan skip a key
+size_t zhash_scan(struct ZHashTable *hash_table, size_t cursor,
+    ZHashVisitor visitor, void *ctx)
+{
+  size_t small_mask, large_mask;
+  struct ZHashEntry **small_entries, **large_entries;
+
+  if (!(hash_table->flags & ZHASH_POW2)) {
+    return zscan_prime(hash_table, cursor, visitor, ctx);
+  }
+
+  large_mask = zsize(hash_table->flags, hash_table->size_index) - 1;
+  large_entries = hash_table->entries;
 
-    if ((entry = hash_table->entries[ii])) zfree_entry(entry, true);
+  if (!hash_table->old_entries) {
+    zvisit_chain(large_entries[cursor & large_mask], visitor, ctx);
+
+    return zscan_next(cursor, large_mask);
   }
 
-  zfree((void *) hash_table->entries);
-  zfree((void *) hash_table);
+  small_mask = zsize(hash_table->flags, hash_table->old_size_index) - 1;
+  small_entries = hash_table->old_entries;
+
+  if (small_mask > large_mask) {
+    size_t mask;
+    struct ZHashEntry **entries;
+
+    mask = small_mask;
+    small_mask = large_mask;
+    large_mask = mask;
+
+    entries = small_entries;
+    small_entries = large_entries;
+    large_entries = entries;
+  }
+
+  // visit the bucket of the smaller table, then every bucket of the larger
+  // table that its entries can move to
+  zvisit_chain(small_entries[cursor & small_mask], visitor, ctx);
+
+  do {
+    zvisit_chain(large_entries[cursor & large_mask], visitor, ctx);
+    cursor = zscan_next(cursor, large_mask);
+  } while (cursor & (small_mask ^ large_mask));
+
+  return cursor;
 }
 
-void zhash_set(struct ZHashTable *hash_table, char *key, void *val)
+struct ZHashTable *zcreate_hash_table_with_prefix(unsigned flags,
+    size_t entry_prefix)
 {
-  size_t size, hash;
-  struct ZHashEntry *entry;
+  return zcreate_hash_table_with_allocator(flags, entry_prefix, NULL);
+}
+
+struct ZHashEntry *zhash_find_entry(struct ZHashTable *hash_table,
+    const void *key, size_t len)
+{
+  zhash_rehash_step(hash_table);
 
-  hash = zgenerate_hash(hash_table, key);
-  entry = hash_table->entries[hash];
+  return *zfind_entry(hash_table, key, len, zgenerate_hash(key, len));
+}
 
-  while (entry) {
-    if (strcmp(key, entry->key) == 0) {
-      entry->val = val;
-      return;
+struct ZHashEntry *zhash_upsert_entry(struct ZHashTable *hash_table,
+    const void *key, size_t len, bool *created)
+{
+  return zhash_upsert(hash_table, key, len, zgenerate_hash(key, len), created);
+}
+
+struct ZHashEntry *zhash_unlink_entry(struct ZHashTable *hash_table,
+    const void *key, size_t len)
+{
+  return zhash_unlink(hash_table, key, len, zgenerate_hash(key, len));
+}
+
+void zhash_remove_entry(struct ZHashTable *hash_table,
+    struct ZHashEntry *entry)
+{
+  zhash_rehash_step(hash_table);
+  zremove_link(hash_table, zfind_link(hash_table, entry));
+}
+
+void zhash_free_entry(struct ZHashTable *hash_table, struct ZHashEntry *entry)
+{
+  zfree_entry(hash_table, entry);
+}
+
+void zhash_foreach_entry(struct ZHashTable *hash_table,
+    ZHashEntryVisitor visitor, void *ctx)
+{
+  size_t size, ii;
+
+  size = zsize(hash_table->flags, hash_table->size_index);
+
+  for (ii = 0; ii < size; ii++) {
+    zvisit_entry_chain(hash_table->entries[ii], visitor, ctx);
+  }
+
+  if (hash_table->old_entries) {
+    size = zsize(hash_table->flags, hash_table->old_size_index);
+
+    for (ii = hash_table->rehash_index; ii < size; ii++) {
+      zvisit_entry_chain(hash_table->old_entries[ii], visitor, ctx);
     }
-    entry = entry->next;
   }
+}
 
-  entry = zcreate_entry(key, val);
+bool zhash_rehashing(struct ZHashTable *hash_table)
+{
+  return hash_table->old_entries ? true : false;
+}
 
-  entry->next = hash_table->entries[hash];
-  hash_table->entries[hash] = entry;
-  hash_table->entry_count++;
+void zhash_stats(struct ZHashTable *hash_table, struct ZHashStats *stats)
+{
+  size_t size;
+
+  memset(stats, 0, sizeof(*stats));
+
+  size = zsize(hash_table->flags, hash_table->size_index);
 
-  size = hash_sizes[hash_table->size_index];
+  stats->bucket_count = size;
+  stats->entry_count = hash_table->entry_count;
+  stats->load_factor = (double) hash_table->entry_count / (double) size;
+  stats->bucket_bytes = size * sizeof(void *);
 
-  if (hash_table->entry_count > size / 2) {
-    zhash_rehash(hash_table, znext_size_index(hash_table->size_index));
+  zstats_chains(hash_table, hash_table->entries, 0, size, stats);
+
+  if (hash_table->old_entries) {
+    size = zsize(hash_table->flags, hash_table->old_size_index);
+    stats->bucket_bytes += size * sizeof(void *);
+    zstats_chains(hash_table, hash_table->old_entries,
+        hash_table->rehash_index, size, stats);
   }
+
+  stats->rehash_count = hash_table->rehash_count;
+  stats->rehash_ns = hash_table->rehash_ns;
+  stats->slab_bytes = hash_table->slab.page_bytes +
+    hash_table->slab.large_bytes;
+  stats->lookup_count = hash_table->lookup_count;
+  stats->probe_count = hash_table->probe_count;
 }
 
-void *zhash_get(struct ZHashTable *hash_table, char *key)
+uint64_t zhash_hash(char *key)
+{
+  return zgenerate_hash(key, strlen(key));
+}
+
+uint64_t zhash_hash_n(const void *key, size_t len)
+{
+  return zgenerate_hash(key, len);
+}
+
+// helper functions, definitions
+static enum ZHashStatus zhash_set_hashed(struct ZHashTable *hash_table,
+    const void *key, size_t len, uint64_t hash, void *val)
+{
+  struct ZHashEntry *entry;
+  bool created;
+
+  if (!(entry = zhash_upsert(hash_table, key, len, hash, &created))) {
+    return ZHASH_NO_MEMORY;
+  }
+
+  entry->val = val;
+
+  return ZHASH_OK;
+}
+
+static void *zhash_get_hashed(struct ZHashTable *hash_table, const void *key,
+    size_t len, uint64_t hash)
 {
-  size_t hash;
   struct ZHashEntry *entry;
 
-  hash = zgenerate_hash(hash_table, key);
-  entry = hash_table->entries[hash];
+  zhash_rehash_step(hash_table);
 
-  while (entry && strcmp(key, entry->key) != 0) entry = entry->next;
+  entry = *zfind_entry(hash_table, key, len, hash);
 
   return entry ? entry->val : NULL;
 }
 
-void *zhash_delete(struct ZHashTable *hash_table, char *key)
+static void *zhash_delete_hashed(struct ZHashTable *hash_table,
+    const void *key, size_t len, uint64_t hash)
 {
-  size_t size, hash;
   struct ZHashEntry *entry;
   void *val;
 
-  hash = zgenerate_hash(hash_table, key);
-  entry = hash_table->entries[hash];
+  if (!(entry = zhash_unlink(hash_table, key, len, hash))) return NULL;
 
-  if (entry && strcmp(key, entry->key) == 0) {
-    hash_table->entries[hash] = entry->next;
-  } else {
-    while (entry) {
-      if (entry->next && strcmp(key, entry->next->key) == 0) {
-        struct ZHashEntry *deleted_entry;
+  val = entry->val;
+  zfree_entry(hash_table, entry);
 
-        deleted_entry = entry->next;
-        entry->next = entry->next->next;
-        entry = deleted_entry;
-        break;
-      }
-      entry = entry->next;
-    }
+  return val;
+}
+
+// return the entry for key, adding one (with a NULL value) if there is none,
+// or NULL if the entry could not be allocated
+// entries never move, so the returned entry stays valid until it is deleted
+static struct ZHashEntry *zhash_upsert(struct ZHashTable *hash_table,
+    const void *key, size_t len, uint64_t hash, bool *created)
+{
+  struct ZHashEntry *entry;
+
+  zhash_rehash_step(hash_table);
+
+  if ((entry = *zfind_entry(hash_table, key, len, hash))) {
+    *created = false;
+    return entry;
   }
 
-  if (!entry) return NULL;
+  if (!(entry = zinsert_entry(hash_table, key, len, hash, NULL))) return NULL;
 
-  val = entry->val;
-  zfree_entry(entry, false);
-  hash_table->entry_count--;
+  *created = true;
 
-  size = hash_sizes[hash_table->size_index];
+  if (hash_table->entry_count > hash_table->grow_at) {
+    zhash_rehash(hash_table, znext_size_index(hash_table->flags,
+          &hash_table->policy, hash_table->size_index));
+  }
 
-  if (hash_table->entry_count < size / 8) {
-    zhash_rehash(hash_table, zprevious_size_index(hash_table->size_index));
+  return entry;
+}
+
+// remove the entry for key from its chain without freeing it
+static struct ZHashEntry *zhash_unlink(struct ZHashTable *hash_table,
+    const void *key, size_t len, uint64_t hash)
+{
+  struct ZHashEntry **link, *entry;
+
+  zhash_rehash_step(hash_table);
+
+  link = zfind_entry(hash_table, key, len, hash);
+
+  if (!(entry = *link)) return NULL;
+
+  zremove_link(hash_table, link);
+
+  return entry;
+}
+
+static bool zhash_exists_hashed(struct ZHashTable *hash_table,
+    const void *key, size_t len, uint64_t hash)
+{
+  zhash_rehash_step(hash_table);
+
+  return *zfind_entry(hash_table, key, len, hash) ? true : false;
+}
+
+// look up n (at most ZPREFETCH_GROUP) keys at once
+// every key is hashed and its bucket prefetched, then every chain head is
+// prefetched, and only then are the chains walked, so the cache misses of the
+// keys overlap instead of happening one after another
+static void zhash_lookup_group(struct ZHashTable *hash_table, char **keys,
+    size_t n, struct ZHashEntry **found)
+{
+  size_t lengths[ZPREFETCH_GROUP];
+  uint64_t hashes[ZPREFETCH_GROUP];
+  struct ZHashEntry **buckets[ZPREFETCH_GROUP];
+  size_t ii;
+
+  zhash_rehash_step(hash_table);
+
+  for (ii = 0; ii < n; ii++) {
+    lengths[ii] = strlen(keys[ii]);
+    hashes[ii] = zgenerate_hash(keys[ii], lengths[ii]);
+    buckets[ii] = &hash_table->entries[zbucket_index(hash_table, hashes[ii],
+        hash_table->size_index)];
+    zprefetch(buckets[ii]);
   }
 
-  return val;
+  for (ii = 0; ii < n; ii++) {
+    if (*buckets[ii]) zprefetch(*buckets[ii]);
+  }
+
+  for (ii = 0; ii < n; ii++) {
+    found[ii] = *zfind_entry(hash_table, keys[ii], lengths[ii], hashes[ii]);
+  }
 }
 
-bool zhash_exists(struct ZHashTable *hash_table, char *key)
+// add a new entry for key without checking whether the table should grow
+static struct ZHashEntry *zinsert_entry(struct ZHashTable *hash_table,
+    const void *key, size_t len, uint64_t hash, void *val)
 {
-  size_t hash;
-  struct ZHashEntry *entry;
+  struct ZHashEntry **link, *entry;
+
+  link = &hash_table->entries[zbucket_index(hash_table, hash,
+      hash_table->size_index)];
+  if (!(entry = zcreate_entry(hash_table, key, len, hash, val))) return NULL;
 
-  hash = zgenerate_hash(hash_table, key);
-  entry = hash_table->entries[hash];
+  entry->next = *link;
+  *link = entry;
+  hash_table->entry_count++;
+
+  return entry;
+}
 
-  while (entry && strcmp(key, entry->key) != 0) entry = entry->next;
+static void zvisit_chain(struct ZHashEntry *entry, ZHashVisitor visitor,
+    void *ctx)
+{
+  while (entry) {
+    struct ZHashEntry *next;
 
-  return entry ? true : false;
+    next = entry->next;
+    visitor(entry->key, entry->key_length, entry->val, ctx);
+    entry = next;
+  }
 }
 
-// helper functions, definitions
-static struct ZHashTable *zcreate_hash_table_with_size(size_t size_index)
+static void zvisit_entry_chain(struct ZHashEntry *entry,
+    ZHashEntryVisitor visitor, void *ctx)
+{
+  while (entry) {
+    struct ZHashEntry *next;
+
+    next = entry->next;
+    visitor(entry, ctx);
+    entry = next;
+  }
+}
+
+// increment the bits of cursor covered by mask, starting from the highest bit
+// prime sizes have no relation between old and new buckets, so while a
+// rehash is running the scan first walks old_entries (with ZSCAN_OLD cursors)
+// and then entries; an entry that is moved before its old bucket is visited
+// is in entries by the time they are walked, and no entry moves back
+static size_t zscan_prime(struct ZHashTable *hash_table, size_t cursor,
+    ZHashVisitor visitor, void *ctx)
+{
+  size_t size;
+
+  if (cursor == 0 && hash_table->old_entries) cursor = ZSCAN_OLD;
+
+  if (cursor & ZSCAN_OLD) {
+    size_t index;
+
+    index = cursor & ~ZSCAN_OLD;
+
+    if (hash_table->old_entries) {
+      size = zsize(hash_table->flags, hash_table->old_size_index);
+
+      if (index < size) {
+        zvisit_chain(hash_table->old_entries[index], visitor, ctx);
+      }
+
+      if (index + 1 < size) return cursor + 1;
+    }
+
+    // the old buckets are done, or the rehash finished and they are all in
+    // entries; walk entries from its first bucket
+    cursor = 0;
+  }
+
+  size = zsize(hash_table->flags, hash_table->size_index);
+  if (cursor < size) zvisit_chain(hash_table->entries[cursor], visitor, ctx);
+
+  return cursor + 1 < size ? cursor + 1 : 0;
+}
+
+static size_t zscan_next(size_t cursor, size_t mask)
+{
+  cursor |= ~mask;
+  cursor = zreverse_bits(cursor);
+  cursor++;
+
+  return zreverse_bits(cursor);
+}
+
+static size_t zreverse_bits(size_t bits)
+{
+  size_t reversed, ii;
+
+  reversed = 0;
+
+  for (ii = 0; ii < sizeof(size_t) * 8; ii++) {
+    reversed = (reversed << 1) | (bits & 1);
+    bits >>= 1;
+  }
+
+  return reversed;
+}
+
+static struct ZHashTable *zcreate_hash_table_with_size(size_t size_index,
+    unsigned flags, const struct ZAllocator *allocator)
 {
   struct ZHashTable *hash_table;
 
-  hash_table = (struct ZHashTable *) zmalloc(sizeof(struct ZHashTable));
+  hash_table = (struct ZHashTable *) zmalloc(allocator,
+      sizeof(struct ZHashTable));
+
+  if (!hash_table) return NULL;
+
+  hash_table->allocator = *allocator;
+  hash_table->entries = zcalloc(allocator, zsize(flags, size_index),
+      sizeof(void *));
+
+  if (!hash_table->entries) {
+    zrelease(allocator, (void *) hash_table);
+    return NULL;
+  }
 
   hash_table->size_index = size_index;
   hash_table->entry_count = 0;
-  hash_table->entries = zcalloc(hash_sizes[size_index], sizeof(void *));
+  hash_table->flags = flags;
+  hash_table->old_size_index = 0;
+  hash_table->old_entries = NULL;
+  hash_table->rehash_index = 0;
+  hash_table->policy = default_policy;
+  hash_table->entry_prefix = 0;
+  hash_table->rehash_count = 0;
+  hash_table->rehash_ns = 0;
+  hash_table->lookup_count = 0;
+  hash_table->probe_count = 0;
+
+  zslab_init(&hash_table->slab, &hash_table->allocator);
+  zupdate_thresholds(hash_table);
 
   return hash_table;
 }
 
-static struct ZHashEntry *zcreate_entry(char *key, void *val)
+// return the link (bucket or next pointer) that points to entry, which must be
+// in the table; chains are searched by address, using the cached hash
+static struct ZHashEntry **zfind_link(struct ZHashTable *hash_table,
+    struct ZHashEntry *entry)
+{
+  struct ZHashEntry **link;
+
+  link = &hash_table->entries[zbucket_index(hash_table, entry->hash,
+      hash_table->size_index)];
+
+  while (*link && *link != entry) link = &(*link)->next;
+
+  if (!*link) {
+    link = &hash_table->old_entries[zbucket_index(hash_table, entry->hash,
+        hash_table->old_size_index)];
+
+    while (*link != entry) link = &(*link)->next;
+  }
+
+  return link;
+}
+
+// unlink the entry that link points to, and shrink the table if it is now
+// below its policy's minimum load
+static void zremove_link(struct ZHashTable *hash_table,
+    struct ZHashEntry **link)
+{
+  *link = (*link)->next;
+  hash_table->entry_count--;
+
+  if (hash_table->entry_count < hash_table->shrink_at) {
+    zhash_rehash(hash_table, zprevious_size_index(hash_table->size_index));
+  }
+}
+
+// return the link (bucket or next pointer) that points to the entry for key
+// if key is not in the table, the returned link points to NULL
+static struct ZHashEntry **zfind_entry(struct ZHashTable *hash_table,
+    const void *key, size_t key_length, uint64_t hash)
+{
+  struct ZHashEntry **link;
+
+  zcount_probe(hash_table, lookup_count);
+
+  link = zfind_in_chain(hash_table,
+      &hash_table->entries[zbucket_index(hash_table, hash,
+        hash_table->size_index)],
+      key, key_length, hash);
+
+  // buckets before rehash_index have already been moved to entries
+  if (!*link && hash_table->old_entries) {
+    size_t index;
+
+    index = zbucket_index(hash_table, hash, hash_table->old_size_index);
+    if (index >= hash_table->rehash_index) {
+      struct ZHashEntry **old_link;
+
+      old_link = zfind_in_chain(hash_table, &hash_table->old_entries[index],
+          key, key_length, hash);
+      if (*old_link) link = old_link;
+    }
+  }
+
+  return link;
+}
+
+static struct ZHashEntry **zfind_in_chain(struct ZHashTable *hash_table,
+    struct ZHashEntry **link, const void *key, size_t key_length,
+    uint64_t hash)
+{
+  while (*link) {
+    zcount_probe(hash_table, probe_count);
+
+    if ((*link)->hash == hash && (*link)->key_length == key_length &&
+        memcmp(key, (*link)->key, key_length) == 0) {
+      break;
+    }
+
+    link = &(*link)->next;
+  }
+
+  return link;
+}
+
+// add the chains of buckets start to end - 1 to stats
+static void zstats_chains(struct ZHashTable *hash_table,
+    struct ZHashEntry **entries, size_t start, size_t end,
+    struct ZHashStats *stats)
+{
+  size_t ii;
+
+  for (ii = start; ii < end; ii++) {
+    struct ZHashEntry *entry;
+    size_t length;
+
+    for (length = 0, entry = entries[ii]; entry; entry = entry->next) {
+      length++;
+      stats->entry_bytes += hash_table->entry_prefix +
+        zentry_size(entry->key_length);
+      stats->key_bytes += entry->key_length + 1;
+    }
+
+    stats->chain_lengths[length < ZHASH_STATS_CHAIN_COUNT ?
+      length : ZHASH_STATS_CHAIN_COUNT - 1]++;
+    if (length > stats->max_chain_length) stats->max_chain_length = length;
+  }
+}
+
+static uint64_t znow_ns(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return (uint64_t) ts.tv_sec * 1000000000ull + (uint64_t) ts.tv_nsec;
+}
+
+// the key is followed by a NUL byte so it can also be read as a string
+// return NULL if the entry could not be allocated
+static struct ZHashEntry *zcreate_entry(struct ZHashTable *hash_table,
+    const void *key, size_t key_length, uint64_t hash, void *val)
 {
   struct ZHashEntry *entry;
-  char *key_cpy;
+  char *block;
+
+  block = (char *) zslab_alloc(&hash_table->slab,
+      hash_table->entry_prefix + zentry_size(key_length));
 
-  key_cpy = (char *) zmalloc((strlen(key) + 1) * sizeof(char));
-  entry = (struct ZHashEntry *) zmalloc(sizeof(struct ZHashEntry));
+  if (!block) return NULL;
 
-  strcpy(key_cpy, key);
-  entry->key = key_cpy;
+  // the prefix is reserved directly before the entry
+  entry = (struct ZHashEntry *) (block + hash_table->entry_prefix);
+
+  memcpy(entry->key, key, key_length);
+  entry->key[key_length] = '\0';
+  entry->key_length = key_length;
   entry->val = val;
+  entry->hash = hash;
 
   return entry;
 }
 
-static void zfree_entry(struct ZHashEntry *entry, bool recursive)
+static void zfree_entry(struct ZHashTable *hash_table, struct ZHashEntry *entry)
 {
-  struct ZHashEntry *next;
+  zslab_free(&hash_table->slab, (char *) entry - hash_table->entry_prefix,
+      hash_table->entry_prefix + zentry_size(entry->key_length));
+}
 
-  if (!recursive) entry->next = NULL;
+static size_t zentry_size(size_t key_length)
+{
+  return sizeof(struct ZHashEntry) + (key_length + 1) * sizeof(char);
+}
 
-  while (entry) {
-    next = entry->next;
+static void zslab_init(struct ZSlab *slab, const struct ZAllocator *allocator)
+{
+  size_t ii;
+
+  slab->allocator = allocator;
+  slab->pages = NULL;
+  slab->cursor = NULL;
+  slab->remaining = 0;
+  slab->page_size = ZSLAB_MIN_PAGE_SIZE;
+  slab->page_bytes = 0;
+  slab->large = NULL;
+  slab->large_bytes = 0;
+
+  for (ii = 0; ii < ZSLAB_CLASS_COUNT; ii++) slab->free_lists[ii] = NULL;
+}
 
-    zfree((void *) entry->key);
-    zfree((void *) entry);
+// allocate size bytes, from the free list of the size class if possible,
+// otherwise from the newest page
+static void *zslab_alloc(struct ZSlab *slab, size_t size)
+{
+  size_t class_index;
+  void *ptr;
 
-    entry = next;
+  size = (size + ZSLAB_ALIGN - 1) / ZSLAB_ALIGN * ZSLAB_ALIGN;
+  class_index = size / ZSLAB_ALIGN - 1;
+
+  if (class_index >= ZSLAB_CLASS_COUNT) {
+    struct ZSlabLarge *large;
+
+    large = (struct ZSlabLarge *) zmalloc(slab->allocator,
+        ZSLAB_LARGE_HEADER + size);
+
+    if (!large) return NULL;
+
+    large->prev = NULL;
+    large->next = slab->large;
+    if (slab->large) slab->large->prev = large;
+    slab->large = large;
+    slab->large_bytes += ZSLAB_LARGE_HEADER + size;
+
+    return (char *) large + ZSLAB_LARGE_HEADER;
+  }
+
+  if ((ptr = slab->free_lists[class_index])) {
+    slab->free_lists[class_index] = *(void **) ptr;
+    return ptr;
+  }
+
+  if (slab->remaining < size) {
+    struct ZSlabPage *page;
+
+    page = (struct ZSlabPage *) zmalloc(slab->allocator, slab->page_size);
+
+    if (!page) return NULL;
+
+    page->next = slab->pages;
+    slab->pages = page;
+    slab->page_bytes += slab->page_size;
+
+    // the page header takes up the first block of the page
+    slab->cursor = (char *) page + ZSLAB_ALIGN;
+    slab->remaining = slab->page_size - ZSLAB_ALIGN;
+
+    if (slab->page_size < ZSLAB_MAX_PAGE_SIZE) slab->page_size *= 2;
   }
+
+  ptr = (void *) slab->cursor;
+  slab->cursor += size;
+  slab->remaining -= size;
+
+  return ptr;
 }
 
-static size_t zgenerate_hash(struct ZHashTable *hash_table, char *key)
+static void zslab_free(struct ZSlab *slab, void *ptr, size_t size)
 {
-  size_t size, hash;
-  char ch;
+  size_t class_index;
 
-  size = hash_sizes[hash_table->size_index];
-  hash = 0;
+  size = (size + ZSLAB_ALIGN - 1) / ZSLAB_ALIGN * ZSLAB_ALIGN;
+  class_index = size / ZSLAB_ALIGN - 1;
 
-  while ((ch = *key++)) hash = (17 * hash + ch) % size;
+  if (class_index >= ZSLAB_CLASS_COUNT) {
+    struct ZSlabLarge *large;
 
-  return hash;
+    large = (struct ZSlabLarge *) ((char *) ptr - ZSLAB_LARGE_HEADER);
+
+    if (large->prev) {
+      large->prev->next = large->next;
+    } else {
+      slab->large = large->next;
+    }
+    if (large->next) large->next->prev = large->prev;
+
+    slab->large_bytes -= ZSLAB_LARGE_HEADER + size;
+    zrelease(slab->allocator, (void *) large);
+    return;
+  }
+
+  *(void **) ptr = slab->free_lists[class_index];
+  slab->free_lists[class_index] = ptr;
 }
 
-static void zhash_rehash(struct ZHashTable *hash_table, size_t size_index)
+// free every page and every individually allocated block at once
+static void zslab_release(struct ZSlab *slab)
+{
+  struct ZSlabPage *page, *next;
+  struct ZSlabLarge *large, *next_large;
+
+  for (page = slab->pages; page; page = next) {
+    next = page->next;
+    zrelease(slab->allocator, (void *) page);
+  }
+
+  for (large = slab->large; large; large = next_large) {
+    next_large = large->next;
+    zrelease(slab->allocator, (void *) large);
+  }
+
+  zslab_init(slab, slab->allocator);
+}
+
+// 64-bit hash of the key, based on wyhash
+// reads the key 8 or 16 bytes at a time and never divides
+static uint64_t zgenerate_hash(const void *key, size_t len)
+{
+  const unsigned char *ptr;
+  size_t remaining;
+  uint64_t seed, a, b;
+
+  ptr = (const unsigned char *) key;
+  seed = zmix(hash_secrets[0], hash_secrets[1]);
+
+  if (len <= 16) {
+    if (len >= 4) {
+      a = (zread4(ptr) << 32) | zread4(ptr + ((len >> 3) << 2));
+      b = (zread4(ptr + len - 4) << 32) |
+        zread4(ptr + len - 4 - ((len >> 3) << 2));
+    } else if (len > 0) {
+      a = ((uint64_t) ptr[0] << 16) | ((uint64_t) ptr[len >> 1] << 8) |
+        ptr[len - 1];
+      b = 0;
+    } else {
+      a = b = 0;
+    }
+  } else {
+    remaining = len;
+
+    if (remaining > 48) {
+      uint64_t seed1, seed2;
+
+      seed1 = seed2 = seed;
+      do {
+        seed = zmix(zread8(ptr) ^ hash_secrets[1], zread8(ptr + 8) ^ seed);
+        seed1 = zmix(zread8(ptr + 16) ^ hash_secrets[2],
+            zread8(ptr + 24) ^ seed1);
+        seed2 = zmix(zread8(ptr + 32) ^ hash_secrets[3],
+            zread8(ptr + 40) ^ seed2);
+        ptr += 48;
+        remaining -= 48;
+      } while (remaining > 48);
+      seed ^= seed1 ^ seed2;
+    }
+
+    while (remaining > 16) {
+      seed = zmix(zread8(ptr) ^ hash_secrets[1], zread8(ptr + 8) ^ seed);
+      ptr += 16;
+      remaining -= 16;
+    }
+
+    a = zread8(ptr + remaining - 16);
+    b = zread8(ptr + remaining - 8);
+  }
+
+  return zmix(hash_secrets[1] ^ len, zmix(a ^ hash_secrets[1], b ^ seed));
+}
+
+// power of 2 tables take the low bits of the hash instead of dividing
+static size_t zbucket_index(struct ZHashTable *hash_table, uint64_t hash,
+    size_t size_index)
+{
+  if (hash_table->flags & ZHASH_POW2) {
+    return (size_t) hash & ((ZPOW2_MIN_SIZE << size_index) - 1);
+  }
+
+  return (size_t) (hash % hash_sizes[size_index]);
+}
+
+// number of buckets of a table with the given flags and size index
+static size_t zsize(unsigned flags, size_t size_index)
+{
+  if (flags & ZHASH_POW2) return ZPOW2_MIN_SIZE << size_index;
+
+  return hash_sizes[size_index];
+}
+
+// multiply a and b to 128 bits and fold the halves together
+static uint64_t zmix(uint64_t a, uint64_t b)
+{
+#ifdef __SIZEOF_INT128__
+  __uint128_t product;
+
+  product = (__uint128_t) a * b;
+
+  return (uint64_t) product ^ (uint64_t) (product >> 64);
+#else
+  uint64_t a_hi, a_lo, b_hi, b_lo, hi_hi, hi_lo, lo_hi, lo_lo, mid, lo, hi;
+
+  a_hi = a >> 32;
+  a_lo = (uint32_t) a;
+  b_hi = b >> 32;
+  b_lo = (uint32_t) b;
+
+  hi_hi = a_hi * b_hi;
+  hi_lo = a_hi * b_lo;
+  lo_hi = a_lo * b_hi;
+  lo_lo = a_lo * b_lo;
+
+  mid = (lo_lo >> 32) + (uint32_t) hi_lo + (uint32_t) lo_hi;
+  lo = (mid << 32) | (uint32_t) lo_lo;
+  hi = hi_hi + (hi_lo >> 32) + (lo_hi >> 32) + (mid >> 32);
+
+  return lo ^ hi;
+#endif
+}
+
+static uint64_t zread8(const unsigned char *ptr)
+{
+  uint64_t val;
+
+  memcpy(&val, ptr, sizeof(val));
+
+  return val;
+}
+
+static uint64_t zread4(const unsigned char *ptr)
+{
+  uint32_t val;
+
+  memcpy(&val, ptr, sizeof(val));
+
+  return val;
+}
+
+// start moving the entries into a table with zsize(size_index) buckets
+// unless the table is incremental, this finishes the move immediately
+// if the new bucket array cannot be allocated, the table keeps its size and
+// the thresholds are left as they are, so the resize is tried again later, and
+// false is returned
+static bool zhash_rehash(struct ZHashTable *hash_table, size_t size_index)
 {
-  size_t hash, size, ii;
   struct ZHashEntry **entries;
 
-  if (size_index == hash_table->size_index) return;
+  if (size_index == hash_table->size_index) return true;
 
-  size = hash_sizes[hash_table->size_index];
-  entries = hash_table->entries;
+  entries = zcalloc(&hash_table->allocator,
+      zsize(hash_table->flags, size_index), sizeof(void *));
+
+  if (!entries) return false;
+
+  // only one move can be in progress at a time
+  zfinish_rehash(hash_table);
+
+  hash_table->old_size_index = hash_table->size_index;
+  hash_table->old_entries = hash_table->entries;
+  hash_table->rehash_index = 0;
+  hash_table->rehash_count++;
 
   hash_table->size_index = size_index;
-  hash_table->entries = zcalloc(hash_sizes[size_index], sizeof(void *));
+  hash_table->entries = entries;
 
-  for (ii = 0; ii < size; ii++) {
+  zupdate_thresholds(hash_table);
+
+  if (!(hash_table->flags & ZHASH_INCREMENTAL)) zfinish_rehash(hash_table);
+
+  return true;
+}
+
+// steps are only timed with ZHASH_PROBE_STATS, since reading the clock would
+// otherwise double the cost of a step
+static void zhash_rehash_step(struct ZHashTable *hash_table)
+{
+#ifdef ZHASH_PROBE_STATS
+  uint64_t start;
+
+  if (!hash_table->old_entries) return;
+
+  start = znow_ns();
+  zmigrate_buckets(hash_table, ZREHASH_STEP);
+  hash_table->rehash_ns += znow_ns() - start;
+#else
+  if (hash_table->old_entries) zmigrate_buckets(hash_table, ZREHASH_STEP);
+#endif
+}
+
+// move every bucket left in old_entries, if a rehash is running
+static void zfinish_rehash(struct ZHashTable *hash_table)
+{
+  uint64_t start;
+
+  if (!hash_table->old_entries) return;
+
+  start = znow_ns();
+  zmigrate_buckets(hash_table,
+      zsize(hash_table->flags, hash_table->old_size_index));
+  hash_table->rehash_ns += znow_ns() - start;
+}
+
+// move up to bucket_count buckets from old_entries to entries
+// old_entries is freed once every bucket has been moved
+static void zmigrate_buckets(struct ZHashTable *hash_table, size_t bucket_count)
+{
+  size_t old_size, index;
+
+  old_size = zsize(hash_table->flags, hash_table->old_size_index);
+
+  while (bucket_count-- && hash_table->rehash_index < old_size) {
     struct ZHashEntry *entry;
 
-    entry = entries[ii];
+    entry = hash_table->old_entries[hash_table->rehash_index];
+    hash_table->old_entries[hash_table->rehash_index++] = NULL;
+
     while (entry) {
       struct ZHashEntry *next_entry;
 
-      hash = zgenerate_hash(hash_table, entry->key);
+      index = zbucket_index(hash_table, entry->hash, hash_table->size_index);
       next_entry = entry->next;
-      entry->next = hash_table->entries[hash];
-      hash_table->entries[hash] = entry;
+      entry->next = hash_table->entries[index];
+      hash_table->entries[index] = entry;
 
       entry = next_entry;
     }
   }
 
-  zfree((void *) entries);
+  if (hash_table->rehash_index == old_size) {
+    zrelease(&hash_table->allocator, (void *) hash_table->old_entries);
+    hash_table->old_entries = NULL;
+    hash_table->rehash_index = 0;
+  }
+}
+
+// smallest size index whose table holds capacity entries without growing
+static size_t zcapacity_size_index(unsigned flags,
+    const struct ZHashPolicy *policy, size_t capacity)
+{
+  size_t size_index;
+
+  for (size_index = 0; size_index < zmax_size_index(flags); size_index++) {
+    if (capacity <= (size_t) (zsize(flags, size_index) * policy->max_load)) {
+      break;
+    }
+  }
+
+  return size_index;
 }
 
-static size_t znext_size_index(size_t size_index)
+// the load factors are turned into entry counts once per resize, so set and
+// delete only compare integers
+static void zupdate_thresholds(struct ZHashTable *hash_table)
 {
-  if (size_index == ZCOUNT_OF(hash_sizes)) return size_index;
+  size_t size;
 
-  return size_index + 1;
+  size = zsize(hash_table->flags, hash_table->size_index);
+
+  hash_table->grow_at = (size_t) (size * hash_table->policy.max_load);
+  hash_table->shrink_at = (size_t) (size * hash_table->policy.min_load);
+}
+
+static size_t zmax_size_index(unsigned flags)
+{
+  if (flags & ZHASH_POW2) return ZPOW2_MAX_SIZE_INDEX;
+
+  return ZCOUNT_OF(hash_sizes) - 1;
+}
+
+// each size index roughly doubles the number of buckets, so a growth factor of
+// 2^n moves up n size indexes
+static size_t znext_size_index(unsigned flags,
+    const struct ZHashPolicy *policy, size_t size_index)
+{
+  size_t next_size_index, max_size_index, factor;
+
+  next_size_index = size_index;
+  max_size_index = zmax_size_index(flags);
+
+  for (factor = policy->growth_factor; factor > 1; factor /= 2) {
+    if (next_size_index < max_size_index) next_size_index++;
+  }
+
+  if (next_size_index == size_index && next_size_index < max_size_index) {
+    next_size_index++;
+  }
+
+  return next_size_index;
+}
+
+// a policy is valid if, at every size, a table that just grew does not shrink
+// on the next deletion and a table that just shrank does not grow on the next
+// insertion; the thresholds are computed as in zupdate_thresholds, so the
+// uneven steps between prime sizes are taken into account
+static bool zpolicy_valid(unsigned flags, const struct ZHashPolicy *policy)
+{
+  size_t size_index, max_size_index;
+
+  // the negated comparisons also reject NaN
+  if (!(policy->max_load > 0 && policy->max_load <= ZMAX_LOAD) ||
+      !(policy->min_load >= 0 && policy->min_load < policy->max_load)) {
+    return false;
+  }
+
+  max_size_index = zmax_size_index(flags);
+
+  for (size_index = 0; size_index < max_size_index; size_index++) {
+    size_t grow_at, shrink_at, next_size_index;
+
+    grow_at = (size_t) (zsize(flags, size_index) * policy->max_load);
+    next_size_index = znext_size_index(flags, policy, size_index);
+
+    if (grow_at < (size_t) (zsize(flags, next_size_index) * policy->min_load)) {
+      return false;
+    }
+
+    shrink_at = (size_t) (zsize(flags, size_index + 1) * policy->min_load);
+
+    if (shrink_at > grow_at) return false;
+  }
+
+  return true;
 }
 
 static size_t zprevious_size_index(size_t size_index)
@@ -246,24 +1401,49 @@ static size_t zprevious_size_index(size_t size_index)
   return size_index - 1;
 }
 
-static void *zmalloc(size_t size)
+static void *zmalloc(const struct ZAllocator *allocator, size_t size)
+{
+  return allocator->alloc(size, allocator->ctx);
+}
+
+static void *zcalloc(const struct ZAllocator *allocator, size_t num,
+    size_t size)
 {
   void *ptr;
 
-  ptr = malloc(size);
+  if (allocator->calloc) return allocator->calloc(num, size, allocator->ctx);
+
+  if (size != 0 && num > SIZE_MAX / size) return NULL;
 
-  if (!ptr) exit(EXIT_FAILURE);
+  if ((ptr = allocator->alloc(num * size, allocator->ctx))) {
+    memset(ptr, 0, num * size);
+  }
 
   return ptr;
 }
 
-static void *zcalloc(size_t num, size_t size)
+static void zrelease(const struct ZAllocator *allocator, void *ptr)
 {
-  void *ptr;
+  if (allocator->free) allocator->free(ptr, allocator->ctx);
+}
+
+static void *zdefault_alloc(size_t size, void *ctx)
+{
+  (void) ctx;
 
-  ptr = calloc(num, size);
+  return malloc(size);
+}
 
-  if (!ptr) exit(EXIT_FAILURE);
+static void *zdefault_calloc(size_t num, size_t size, void *ctx)
+{
+  (void) ctx;
 
-  return ptr;
+  return calloc(num, size);
+}
+
+static void zdefault_free(void *ptr, void *ctx)
+{
+  (void) ctx;
+
+  free(ptr);
 }
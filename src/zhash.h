@@ -2,6 +2,7 @@
 #define ZHASH_H
 
 #include <stdbool.h>
+#include <stdint.h>
 
 // hash table
 // keys are strings
@@ -11,28 +12,300 @@
 #define zfree free
 
 // struct representing an entry in the hash table
+// hash is the full 64-bit hash of the key; it is computed once on insertion
+// the key is stored inline, directly after the entry, followed by a NUL byte
+// key_length does not include the NUL byte; keys may contain zero bytes
 struct ZHashEntry {
-  char *key;
-  void *val;
   struct ZHashEntry *next;
+  void *val;
+  uint64_t hash;
+  size_t key_length;
+  char key[];
+};
+
+// entries are carved out of pages owned by the table
+// blocks are rounded up to multiples of ZSLAB_ALIGN bytes and freed blocks are
+// kept in one free list per size; blocks larger than the largest size class
+// are allocated individually
+#define ZSLAB_ALIGN 16
+#define ZSLAB_CLASS_COUNT 16
+
+// struct representing where a table gets its memory
+// alloc and calloc return NULL when they fail; calloc may be NULL, in which
+// case memory from alloc is zeroed; free may be NULL for allocators that
+// release all of their memory at once (such as an arena dropped at the end of
+// a request), and then the table does not need to be freed at all
+// ctx is passed to every call
+struct ZAllocator {
+  void *(*alloc)(size_t size, void *ctx);
+  void *(*calloc)(size_t num, size_t size, void *ctx);
+  void (*free)(void *ptr, void *ctx);
+  void *ctx;
+};
+
+// result of operations that allocate memory
+// when an operation fails with ZHASH_NO_MEMORY or ZHASH_FULL the table is left
+// unchanged; ZHASH_FULL is only returned by open addressing tables (see
+// zhash_define.h) that are at their maximum size and load
+enum ZHashStatus {
+  ZHASH_OK,
+  ZHASH_NO_MEMORY,
+  ZHASH_FULL
+};
+
+// struct at the start of each page
+struct ZSlabPage {
+  struct ZSlabPage *next;
+};
+
+// struct at the start of each block allocated individually; the blocks are
+// linked so that they can be freed without finding their entries
+struct ZSlabLarge {
+  struct ZSlabLarge *next;
+  struct ZSlabLarge *prev;
+};
+
+// struct representing the pages and free lists of a table
+// cursor and remaining describe the unused part of the newest page
+// large is the list of blocks allocated individually
+// page_bytes and large_bytes are the bytes held in pages and in blocks
+// allocated individually
+struct ZSlab {
+  const struct ZAllocator *allocator;
+  struct ZSlabPage *pages;
+  char *cursor;
+  size_t remaining;
+  size_t page_size;
+  size_t page_bytes;
+  struct ZSlabLarge *large;
+  size_t large_bytes;
+  void *free_lists[ZSLAB_CLASS_COUNT];
+};
+
+// flags for zcreate_hash_table_with_flags
+// ZHASH_INCREMENTAL: instead of moving every entry at once when the table
+// grows or shrinks, move a few buckets on each operation
+#define ZHASH_INCREMENTAL 0x1u
+// ZHASH_POW2: use power of 2 numbers of buckets (64, 128, 256, ...) and pick
+// the bucket from the low bits of the hash instead of the hash modulo a prime
+#define ZHASH_POW2 0x2u
+
+// struct representing when a hash table is resized
+// the table grows once entry_count > max_load * number of buckets and shrinks
+// once entry_count < min_load * number of buckets (0 disables shrinking)
+// growth_factor is rounded down to a power of 2 (at least 2) and is how many
+// times larger the table becomes when it grows (approximately, for prime
+// sizes)
+// zhash_set_policy rejects policies under which a table that just grew would
+// shrink on the next deletion, or a table that just shrank would grow on the
+// next insertion: max_load must be in (0, 64] and min_load * growth_factor at
+// most max_load; prime sizes are up to about 3 times apart, so prime tables
+// need more room (the check uses the actual sizes)
+struct ZHashPolicy {
+  double max_load;
+  double min_load;
+  size_t growth_factor;
 };
 
 // struct representing the hash table
-// size_index is an index into the hash_sizes array in hash.c
+// size_index is an index into the hash_sizes array in hash.c, or the power of
+// 2 above the minimum size for ZHASH_POW2 tables
+// while an incremental rehash is running, buckets of old_entries before
+// rehash_index have been moved to entries and the rest have not
+// grow_at and shrink_at are the entry counts at which policy resizes the table
+// entry_prefix bytes are reserved directly before every entry for tables built
+// on top of zhash (see zhash_upsert_entry below)
+// rehash_count, rehash_ns, lookup_count and probe_count are reported by
+// zhash_stats
+// all of the table's memory, including the table itself, comes from allocator
 struct ZHashTable {
   size_t size_index;
   size_t entry_count;
   struct ZHashEntry **entries;
+  unsigned flags;
+  size_t old_size_index;
+  struct ZHashEntry **old_entries;
+  size_t rehash_index;
+  struct ZHashPolicy policy;
+  size_t grow_at;
+  size_t shrink_at;
+  size_t entry_prefix;
+  size_t rehash_count;
+  uint64_t rehash_ns;
+  uint64_t lookup_count;
+  uint64_t probe_count;
+  struct ZAllocator allocator;
+  struct ZSlab slab;
+};
+
+// number of chain lengths counted separately by zhash_stats; longer chains are
+// counted with the longest
+#define ZHASH_STATS_CHAIN_COUNT 16
+
+// struct filled in by zhash_stats
+// chain_lengths[n] is the number of buckets holding n entries (the last one
+// counts every longer chain too); while an incremental rehash is running, the
+// buckets of the old array that have not been moved yet are counted as well
+// rehash_ns is the time spent moving entries to a new bucket array; the small
+// steps of an incremental rehash are only timed with ZHASH_PROBE_STATS
+// bucket_bytes is the size of the bucket arrays; entry_bytes is the size of the
+// entries (with their prefix and key) and key_bytes the part of it used by
+// keys; slab_bytes is what the entries take from the allocator, including
+// freed blocks kept for reuse
+// lookup_count and probe_count (entries compared with a key) are only counted
+// when zhash.c is compiled with ZHASH_PROBE_STATS defined, and are 0 otherwise;
+// they are incremented atomically, so lookups under a shared read lock stay
+// safe
+struct ZHashStats {
+  size_t bucket_count;
+  size_t entry_count;
+  double load_factor;
+  size_t chain_lengths[ZHASH_STATS_CHAIN_COUNT];
+  size_t max_chain_length;
+  size_t rehash_count;
+  uint64_t rehash_ns;
+  size_t bucket_bytes;
+  size_t entry_bytes;
+  size_t key_bytes;
+  size_t slab_bytes;
+  uint64_t lookup_count;
+  uint64_t probe_count;
 };
 
 // hash table creation and destruction
+// tables are created with malloc, calloc and free unless an allocator is given;
+// creation returns NULL if there is not enough memory
 struct ZHashTable *zcreate_hash_table(void);
+struct ZHashTable *zcreate_hash_table_with_flags(unsigned flags);
+struct ZHashTable *zcreate_hash_table_with_capacity(unsigned flags,
+    size_t capacity);
 void zfree_hash_table(struct ZHashTable *hash_table);
 
+// create a table whose memory comes from allocator (NULL for the default);
+// entry_prefix is the same as for zcreate_hash_table_with_prefix and may be 0
+struct ZHashTable *zcreate_hash_table_with_allocator(unsigned flags,
+    size_t entry_prefix, const struct ZAllocator *allocator);
+
 // hash table operations
-void zhash_set(struct ZHashTable *hash_table, char *key, void *val);
+// set returns ZHASH_NO_MEMORY if a new entry could not be allocated; a table
+// that cannot allocate a larger bucket array keeps its current one and tries
+// again on a later insertion
+enum ZHashStatus zhash_set(struct ZHashTable *hash_table, char *key, void *val);
 void *zhash_get(struct ZHashTable *hash_table, char *key);
 void *zhash_delete(struct ZHashTable *hash_table, char *key);
 bool zhash_exists(struct ZHashTable *hash_table, char *key);
 
+// hash table operations on keys of len bytes (no NUL terminator needed)
+enum ZHashStatus zhash_set_n(struct ZHashTable *hash_table, const void *key,
+    size_t len, void *val);
+void *zhash_get_n(struct ZHashTable *hash_table, const void *key, size_t len);
+void *zhash_delete_n(struct ZHashTable *hash_table, const void *key, size_t len);
+bool zhash_exists_n(struct ZHashTable *hash_table, const void *key, size_t len);
+
+// look up n keys at once; vals[i] and exists[i] are the results for keys[i]
+// faster than n separate calls on tables that do not fit in the cache
+void zhash_get_many(struct ZHashTable *hash_table, char **keys, size_t n,
+    void **vals);
+void zhash_exists_many(struct ZHashTable *hash_table, char **keys, size_t n,
+    bool *exists);
+
+// grow the table so that it holds capacity entries without rehashing
+// reserve returns ZHASH_NO_MEMORY and shrink_to_fit does nothing if the new
+// bucket array cannot be allocated; the table is then left as it is
+enum ZHashStatus zhash_reserve(struct ZHashTable *hash_table, size_t capacity);
+
+// change when the table is resized; the default is { 0.5, 0.125, 2 }
+// return false, and keep the current policy, if policy does not meet the
+// constraints given with struct ZHashPolicy
+bool zhash_set_policy(struct ZHashTable *hash_table,
+    const struct ZHashPolicy *policy);
+
+// shrink the table to the smallest size that holds its entries
+void zhash_shrink_to_fit(struct ZHashTable *hash_table);
+
+// set keys[i] to vals[i] for n keys, sizing the table once up front
+// if the table cannot be sized, ZHASH_NO_MEMORY is returned and no key is set;
+// if an entry cannot be allocated, the keys before it have been set
+enum ZHashStatus zhash_bulk_load(struct ZHashTable *hash_table, char **keys,
+    void **vals, size_t n);
+
+// function called for each entry by zhash_foreach and zhash_scan
+// it must not add or delete entries
+typedef void (*ZHashVisitor)(char *key, size_t key_length, void *val, void *ctx);
+
+// call visitor for every entry in the table
+void zhash_foreach(struct ZHashTable *hash_table, ZHashVisitor visitor,
+    void *ctx);
+
+// call visitor for the entries in a few buckets and return the next cursor
+// start with cursor 0; the scan is done when 0 is returned
+// for ZHASH_POW2 tables, every key present for the whole scan is visited at
+// least once even if the table is resized between calls; other tables give
+// the same guarantee as long as no resize starts during the scan (a running
+// incremental rehash may go on or finish)
+size_t zhash_scan(struct ZHashTable *hash_table, size_t cursor,
+    ZHashVisitor visitor, void *ctx);
+
+// entry-level operations, used to build other tables on top of zhash
+// a table created with zcreate_hash_table_with_prefix reserves entry_prefix
+// bytes (rounded up to a multiple of the pointer size) directly before each
+// entry, so a caller can embed its own struct in the same allocation and
+// reach it from an entry with ((char *) entry - entry_prefix)
+struct ZHashTable *zcreate_hash_table_with_prefix(unsigned flags,
+    size_t entry_prefix);
+
+// return the entry for key, or NULL if there is none
+struct ZHashEntry *zhash_find_entry(struct ZHashTable *hash_table,
+    const void *key, size_t len);
+
+// return the entry for key, adding one with a NULL value if there is none;
+// created is set to whether the entry is new; return NULL if there is not
+// enough memory for a new entry
+// entries never move, so the entry stays valid until it is deleted
+struct ZHashEntry *zhash_upsert_entry(struct ZHashTable *hash_table,
+    const void *key, size_t len, bool *created);
+
+// remove the entry for key from the table and return it (or NULL), without
+// freeing it; it must then be freed with zhash_free_entry
+struct ZHashEntry *zhash_unlink_entry(struct ZHashTable *hash_table,
+    const void *key, size_t len);
+void zhash_free_entry(struct ZHashTable *hash_table, struct ZHashEntry *entry);
+
+// remove an entry that is in the table (found with zhash_find_entry or
+// zhash_upsert_entry) without freeing it; the key is not hashed or compared
+// again, since the entry caches its hash
+void zhash_remove_entry(struct ZHashTable *hash_table,
+    struct ZHashEntry *entry);
+
+// function called for each entry by zhash_foreach_entry
+// it must not add or delete entries, or change their keys
+typedef void (*ZHashEntryVisitor)(struct ZHashEntry *entry, void *ctx);
+
+// call visitor for every entry in the table; unlike zhash_foreach, the
+// visitor sees the whole entry, including the hash cached in it
+void zhash_foreach_entry(struct ZHashTable *hash_table,
+    ZHashEntryVisitor visitor, void *ctx);
+
+// true while an incremental rehash is in progress
+bool zhash_rehashing(struct ZHashTable *hash_table);
+
+// fill in stats for the table; walks every bucket, so it takes time linear in
+// the size of the table
+void zhash_stats(struct ZHashTable *hash_table, struct ZHashStats *stats);
+
+// hash function used by the hash table (also used by zflat_hash)
+// the hash does not depend on the table, so it can be reused across tables
+uint64_t zhash_hash(char *key);
+uint64_t zhash_hash_n(const void *key, size_t len);
+
+// hash table operations with hash = zhash_hash(key) computed by the caller
+enum ZHashStatus zhash_set_prehashed(struct ZHashTable *hash_table, char *key,
+    uint64_t hash, void *val);
+void *zhash_get_prehashed(struct ZHashTable *hash_table, char *key,
+    uint64_t hash);
+void *zhash_delete_prehashed(struct ZHashTable *hash_table, char *key,
+    uint64_t hash);
+bool zhash_exists_prehashed(struct ZHashTable *hash_table, char *key,
+    uint64_t hash);
+
 #endif
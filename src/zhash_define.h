@@ -0,0 +1,289 @@
+#ifndef ZHASH_DEFINE_H
+#define ZHASH_DEFINE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "./zhash.h"
+
+// generator for type-specialized hash tables
+// ZHASH_DEFINE(name, key_t, val_t, hash_fn, eq_fn) defines a hash table whose
+// slots store keys of type key_t and values of type val_t directly, found by
+// linear probing; there is no allocation per entry, and hash_fn and eq_fn can
+// be inlined into every operation
+// hash_fn is called as uint64_t hash_fn(key_t key) and eq_fn as
+// bool eq_fn(key_t a, key_t b); keys and values are copied by value, so a key
+// that points to memory (such as a string) must stay valid while it is in the
+// table
+//
+// the table resizes like a ZHASH_POW2 ZHash table with the default policy: it
+// has (ZDEFINE_MIN_SIZE << size_index) slots, doubles above 50% load and
+// halves below 12.5% load; at ZDEFINE_MAX_SIZE_INDEX it no longer grows and
+// holds up to 87.5% load; the slot is picked from the high bits of the hash
+// multiplied by 2^64 / phi, so hash_fn does not need to mix its low bits
+// which slots are in use is kept in a bitmap next to the slots, so a slot is
+// only as large as a key and a value
+//
+// for ZHASH_DEFINE(point, ...) the following are defined, all static inline:
+//   struct point_hash_slot
+//   struct point_hash_table
+//   struct point_hash_table *zcreate_point_hash_table(void);
+//   void zfree_point_hash_table(struct point_hash_table *hash_table);
+//   enum ZHashStatus zpoint_hash_set(struct point_hash_table *hash_table,
+//       key_t key, val_t val);
+//   val_t *zpoint_hash_get(struct point_hash_table *hash_table, key_t key);
+//   bool zpoint_hash_delete(struct point_hash_table *hash_table, key_t key,
+//       val_t *val);
+//   bool zpoint_hash_exists(struct point_hash_table *hash_table, key_t key);
+//   size_t zpoint_hash_count(struct point_hash_table *hash_table);
+//   void zpoint_hash_foreach(struct point_hash_table *hash_table,
+//       void (*visitor)(key_t *key, val_t *val, void *ctx), void *ctx);
+// create returns NULL and set returns ZHASH_NO_MEMORY when memory runs out;
+// set returns ZHASH_FULL when the table is at its maximum size and load
+// get returns a pointer to the value in its slot, or NULL; the pointer is
+// valid until the next set or delete
+// delete copies the removed value to val (unless val is NULL) and returns
+// whether the key was in the table
+// visitors must not set or delete entries
+
+// memory comes from these functions; define them before including this file
+// to use another allocator
+#ifndef ZDEFINE_MALLOC
+#define ZDEFINE_MALLOC malloc
+#endif
+#ifndef ZDEFINE_CALLOC
+#define ZDEFINE_CALLOC calloc
+#endif
+#ifndef ZDEFINE_FREE
+#define ZDEFINE_FREE free
+#endif
+
+#define ZDEFINE_MIN_BITS 6
+#define ZDEFINE_MIN_SIZE ((size_t) 1 << ZDEFINE_MIN_BITS)
+#define ZDEFINE_MAX_SIZE_INDEX 25
+#define ZDEFINE_GOLDEN 0x9e3779b97f4a7c15ull
+
+// bits of the bitmap of slots in use, 64 slots per word
+#define zdefine_used(used, index) (((used)[(index) >> 6] >> ((index) & 63)) & 1)
+#define zdefine_mark(used, index) \
+  ((used)[(index) >> 6] |= (uint64_t) 1 << ((index) & 63))
+#define zdefine_clear(used, index) \
+  ((used)[(index) >> 6] &= ~((uint64_t) 1 << ((index) & 63)))
+
+#define ZHASH_DEFINE(name, key_t, val_t, hash_fn, eq_fn) \
+  struct name##_hash_slot { \
+    key_t key; \
+    val_t val; \
+  }; \
+  \
+  struct name##_hash_table { \
+    size_t size_index; \
+    size_t entry_count; \
+    size_t grow_at; \
+    size_t shrink_at; \
+    struct name##_hash_slot *slots; \
+    uint64_t *used; \
+  }; \
+  \
+  static inline size_t z##name##_hash_index(size_t size_index, key_t key) \
+  { \
+    return (size_t) (((uint64_t) hash_fn(key) * ZDEFINE_GOLDEN) >> \
+        (64 - ZDEFINE_MIN_BITS - size_index)); \
+  } \
+  \
+  static inline bool z##name##_hash_resize( \
+      struct name##_hash_table *hash_table, size_t size_index) \
+  { \
+    struct name##_hash_slot *slots; \
+    uint64_t *used; \
+    size_t size, old_size, ii, index; \
+    \
+    size = ZDEFINE_MIN_SIZE << size_index; \
+    slots = (struct name##_hash_slot *) ZDEFINE_MALLOC( \
+        size * sizeof(struct name##_hash_slot)); \
+    used = (uint64_t *) ZDEFINE_CALLOC(size / 64, sizeof(uint64_t)); \
+    \
+    if (!slots || !used) { \
+      ZDEFINE_FREE((void *) slots); \
+      ZDEFINE_FREE((void *) used); \
+      return false; \
+    } \
+    \
+    old_size = hash_table->slots ? \
+        ZDEFINE_MIN_SIZE << hash_table->size_index : 0; \
+    \
+    for (ii = 0; ii < old_size; ii++) { \
+      if (!zdefine_used(hash_table->used, ii)) continue; \
+      \
+      for (index = z##name##_hash_index(size_index, \
+          hash_table->slots[ii].key); zdefine_used(used, index); \
+          index = (index + 1) & (size - 1)); \
+      \
+      slots[index] = hash_table->slots[ii]; \
+      zdefine_mark(used, index); \
+    } \
+    \
+    ZDEFINE_FREE((void *) hash_table->slots); \
+    ZDEFINE_FREE((void *) hash_table->used); \
+    \
+    hash_table->slots = slots; \
+    hash_table->used = used; \
+    hash_table->size_index = size_index; \
+    hash_table->grow_at = size_index < ZDEFINE_MAX_SIZE_INDEX ? \
+        size / 2 : size - size / 8; \
+    hash_table->shrink_at = size / 8; \
+    \
+    return true; \
+  } \
+  \
+  static inline size_t z##name##_hash_find( \
+      struct name##_hash_table *hash_table, key_t key) \
+  { \
+    size_t mask, index; \
+    \
+    mask = (ZDEFINE_MIN_SIZE << hash_table->size_index) - 1; \
+    \
+    for (index = z##name##_hash_index(hash_table->size_index, key); \
+        zdefine_used(hash_table->used, index); \
+        index = (index + 1) & mask) { \
+      if (eq_fn(hash_table->slots[index].key, key)) return index; \
+    } \
+    \
+    return SIZE_MAX; \
+  } \
+  \
+  static inline struct name##_hash_table *zcreate_##name##_hash_table(void) \
+  { \
+    struct name##_hash_table *hash_table; \
+    \
+    hash_table = (struct name##_hash_table *) ZDEFINE_MALLOC( \
+        sizeof(struct name##_hash_table)); \
+    \
+    if (!hash_table) return NULL; \
+    \
+    hash_table->entry_count = 0; \
+    hash_table->slots = NULL; \
+    hash_table->used = NULL; \
+    \
+    if (!z##name##_hash_resize(hash_table, 0)) { \
+      ZDEFINE_FREE((void *) hash_table); \
+      return NULL; \
+    } \
+    \
+    return hash_table; \
+  } \
+  \
+  static inline void zfree_##name##_hash_table( \
+      struct name##_hash_table *hash_table) \
+  { \
+    ZDEFINE_FREE((void *) hash_table->slots); \
+    ZDEFINE_FREE((void *) hash_table->used); \
+    ZDEFINE_FREE((void *) hash_table); \
+  } \
+  \
+  static inline enum ZHashStatus z##name##_hash_set( \
+      struct name##_hash_table *hash_table, key_t key, val_t val) \
+  { \
+    size_t mask, index; \
+    \
+    if ((index = z##name##_hash_find(hash_table, key)) != SIZE_MAX) { \
+      hash_table->slots[index].val = val; \
+      return ZHASH_OK; \
+    } \
+    \
+    if (hash_table->entry_count + 1 > hash_table->grow_at) { \
+      if (hash_table->size_index == ZDEFINE_MAX_SIZE_INDEX) return ZHASH_FULL; \
+      \
+      if (!z##name##_hash_resize(hash_table, hash_table->size_index + 1)) { \
+        return ZHASH_NO_MEMORY; \
+      } \
+    } \
+    \
+    mask = (ZDEFINE_MIN_SIZE << hash_table->size_index) - 1; \
+    \
+    for (index = z##name##_hash_index(hash_table->size_index, key); \
+        zdefine_used(hash_table->used, index); index = (index + 1) & mask); \
+    \
+    zdefine_mark(hash_table->used, index); \
+    hash_table->slots[index].key = key; \
+    hash_table->slots[index].val = val; \
+    hash_table->entry_count++; \
+    \
+    return ZHASH_OK; \
+  } \
+  \
+  static inline val_t *z##name##_hash_get( \
+      struct name##_hash_table *hash_table, key_t key) \
+  { \
+    size_t index; \
+    \
+    index = z##name##_hash_find(hash_table, key); \
+    \
+    return index != SIZE_MAX ? &hash_table->slots[index].val : NULL; \
+  } \
+  \
+  static inline bool z##name##_hash_delete( \
+      struct name##_hash_table *hash_table, key_t key, val_t *val) \
+  { \
+    struct name##_hash_slot *slots; \
+    size_t mask, index, next, home; \
+    \
+    if ((index = z##name##_hash_find(hash_table, key)) == SIZE_MAX) { \
+      return false; \
+    } \
+    \
+    slots = hash_table->slots; \
+    mask = (ZDEFINE_MIN_SIZE << hash_table->size_index) - 1; \
+    \
+    if (val) *val = slots[index].val; \
+    \
+    for (next = (index + 1) & mask; zdefine_used(hash_table->used, next); \
+        next = (next + 1) & mask) { \
+      home = z##name##_hash_index(hash_table->size_index, slots[next].key); \
+      \
+      if (((next - home) & mask) >= ((next - index) & mask)) { \
+        slots[index] = slots[next]; \
+        index = next; \
+      } \
+    } \
+    \
+    zdefine_clear(hash_table->used, index); \
+    hash_table->entry_count--; \
+    \
+    if (hash_table->size_index > 0 && \
+        hash_table->entry_count < hash_table->shrink_at) { \
+      z##name##_hash_resize(hash_table, hash_table->size_index - 1); \
+    } \
+    \
+    return true; \
+  } \
+  \
+  static inline bool z##name##_hash_exists( \
+      struct name##_hash_table *hash_table, key_t key) \
+  { \
+    return z##name##_hash_find(hash_table, key) != SIZE_MAX; \
+  } \
+  \
+  static inline size_t z##name##_hash_count( \
+      struct name##_hash_table *hash_table) \
+  { \
+    return hash_table->entry_count; \
+  } \
+  \
+  static inline void z##name##_hash_foreach( \
+      struct name##_hash_table *hash_table, \
+      void (*visitor)(key_t *key, val_t *val, void *ctx), void *ctx) \
+  { \
+    size_t size, ii; \
+    \
+    size = ZDEFINE_MIN_SIZE << hash_table->size_index; \
+    \
+    for (ii = 0; ii < size; ii++) { \
+      if (zdefine_used(hash_table->used, ii)) { \
+        visitor(&hash_table->slots[ii].key, &hash_table->slots[ii].val, ctx); \
+      } \
+    } \
+  }
+
+#endif
@@ -0,0 +1,462 @@
+// fdopen, fsync and clock_gettime with -std=c11
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200112L
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "./zhash.h"
+#include "./zhash_image.h"
+
+// helper macros and functions, declarations
+#define zfree free
+
+#define ZIMAGE_MAGIC "ZHASHIMG"
+#define ZIMAGE_VERSION 1
+#define ZIMAGE_BYTE_ORDER 0x01020304u
+#define ZIMAGE_ALIGN 16
+#define ZIMAGE_NULL_VAL UINT64_MAX
+
+// temporary files are named path followed by a dot and 16 hex digits; a name
+// that is taken is retried this many times with new digits
+#define ZIMAGE_TMP_DIGITS 16
+#define ZIMAGE_TMP_ATTEMPTS 100
+
+// struct representing an entry of the table being written
+struct ZImageSource {
+  char *key;
+  size_t key_length;
+  void *val;
+  uint64_t hash;
+};
+
+// struct used to collect the entries of the table being written
+struct ZImageSources {
+  struct ZImageSource *sources;
+  size_t count;
+};
+
+static const struct ZImageEntry *zimage_find(struct ZHashImage *image,
+    const void *key, size_t len);
+static void zcollect_entry(struct ZHashEntry *entry, void *ctx);
+static int zcreate_tmp_file(const char *path, char *tmp_path);
+static void zsync_dir(const char *path);
+static bool zwrite_image_file(FILE *file, const struct ZImageHeader *header,
+    const uint64_t *buckets, const struct ZImageEntry *entries,
+    struct ZImageSource **order);
+static bool zwrite_at(FILE *file, uint64_t *offset, uint64_t target,
+    const void *data, size_t size);
+static uint64_t zalign(uint64_t offset);
+static uint64_t zimage_hash_check(void);
+static bool zimage_valid(const struct ZHashImage *image);
+
+// functions declared in zhash_image.h
+bool zhash_write_image(struct ZHashTable *hash_table, const char *path,
+    ZValueSizeFunction val_size)
+{
+  struct ZImageSources collected;
+  struct ZImageSource **order;
+  struct ZImageHeader header;
+  struct ZImageEntry *entries;
+  uint64_t *buckets, offset;
+  size_t bucket_count, ii;
+  char *tmp_path;
+  FILE *file;
+  bool ok;
+  int fd;
+
+  for (bucket_count = 1; bucket_count < hash_table->entry_count;
+      bucket_count <<= 1);
+
+  collected.sources = malloc((hash_table->entry_count + 1) *
+      sizeof(struct ZImageSource));
+  collected.count = 0;
+  buckets = calloc(bucket_count + 1, sizeof(uint64_t));
+  entries = malloc((hash_table->entry_count + 1) * sizeof(struct ZImageEntry));
+  order = malloc((hash_table->entry_count + 1) *
+      sizeof(struct ZImageSource *));
+  tmp_path = malloc(strlen(path) + ZIMAGE_TMP_DIGITS + 2);
+
+  if (!collected.sources || !buckets || !entries || !order || !tmp_path) {
+    zfree(tmp_path);
+    zfree(order);
+    zfree(entries);
+    zfree(buckets);
+    zfree(collected.sources);
+    return false;
+  }
+
+  zhash_foreach_entry(hash_table, zcollect_entry, &collected);
+
+  // sort the entries by bucket with a counting sort; buckets[b + 1] starts
+  // as the size of bucket b and ends as the index after its last entry
+  for (ii = 0; ii < collected.count; ii++) {
+    buckets[(collected.sources[ii].hash & (bucket_count - 1)) + 1]++;
+  }
+  for (ii = 0; ii < bucket_count; ii++) buckets[ii + 1] += buckets[ii];
+
+  for (ii = 0; ii < collected.count; ii++) {
+    order[buckets[collected.sources[ii].hash & (bucket_count - 1)]++] =
+      &collected.sources[ii];
+  }
+
+  memmove(buckets + 1, buckets, bucket_count * sizeof(uint64_t));
+  buckets[0] = 0;
+
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, ZIMAGE_MAGIC, sizeof(header.magic));
+  header.version = ZIMAGE_VERSION;
+  header.byte_order = ZIMAGE_BYTE_ORDER;
+  header.hash_check = zimage_hash_check();
+  header.entry_count = collected.count;
+  header.bucket_count = bucket_count;
+  header.buckets_offset = zalign(sizeof(header));
+  header.entries_offset = zalign(header.buckets_offset +
+      (bucket_count + 1) * sizeof(uint64_t));
+
+  // keys and values follow the entries, in the same order
+  offset = zalign(header.entries_offset +
+      collected.count * sizeof(struct ZImageEntry));
+
+  for (ii = 0; ii < collected.count; ii++) {
+    entries[ii].hash = order[ii]->hash;
+    entries[ii].key_offset = offset;
+    entries[ii].key_length = order[ii]->key_length;
+    entries[ii].val_offset = 0;
+    entries[ii].val_size = ZIMAGE_NULL_VAL;
+
+    offset = zalign(offset + order[ii]->key_length + 1);
+
+    if (order[ii]->val) {
+      entries[ii].val_offset = offset;
+      entries[ii].val_size = val_size ?
+        val_size(order[ii]->val) : strlen((char *) order[ii]->val) + 1;
+
+      offset = zalign(offset + entries[ii].val_size);
+    }
+  }
+
+  header.file_size = offset;
+
+  ok = false;
+
+  // the file is synced before it is renamed, so that after a crash path holds
+  // either the old image or the whole new one
+  if ((fd = zcreate_tmp_file(path, tmp_path)) != -1) {
+    if ((file = fdopen(fd, "wb"))) {
+      ok = zwrite_image_file(file, &header, buckets, entries, order);
+      ok = ok && fflush(file) == 0 && fsync(fd) == 0;
+      ok = fclose(file) == 0 && ok;
+      ok = ok && rename(tmp_path, path) == 0;
+    } else {
+      close(fd);
+    }
+
+    if (!ok) remove(tmp_path);
+  }
+
+  // the rename only survives a crash once the directory is synced too
+  if (ok) zsync_dir(path);
+
+  zfree(tmp_path);
+  zfree(order);
+  zfree(entries);
+  zfree(buckets);
+  zfree(collected.sources);
+
+  return ok;
+}
+
+struct ZHashImage *zhash_open_image(const char *path)
+{
+  struct ZHashImage *image;
+  struct stat st;
+  void *base;
+  int fd;
+
+  if ((fd = open(path, O_RDONLY)) < 0) return NULL;
+
+  if (fstat(fd, &st) != 0 ||
+      (size_t) st.st_size < sizeof(struct ZImageHeader)) {
+    close(fd);
+    return NULL;
+  }
+
+  base = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+
+  if (base == MAP_FAILED) return NULL;
+
+  if (!(image = malloc(sizeof(struct ZHashImage)))) {
+    munmap(base, (size_t) st.st_size);
+    return NULL;
+  }
+
+  image->base = (const char *) base;
+  image->size = (size_t) st.st_size;
+  image->header = (const struct ZImageHeader *) base;
+  image->buckets = (const uint64_t *) (image->base +
+      image->header->buckets_offset);
+  image->entries = (const struct ZImageEntry *) (image->base +
+      image->header->entries_offset);
+
+  if (!zimage_valid(image)) {
+    zhash_close_image(image);
+    return NULL;
+  }
+
+  return image;
+}
+
+void zhash_close_image(struct ZHashImage *image)
+{
+  munmap((void *) image->base, image->size);
+  zfree(image);
+}
+
+void *zhash_image_get(struct ZHashImage *image, char *key)
+{
+  return zhash_image_get_n(image, key, strlen(key), NULL);
+}
+
+bool zhash_image_exists(struct ZHashImage *image, char *key)
+{
+  return zimage_find(image, key, strlen(key)) ? true : false;
+}
+
+size_t zhash_image_count(struct ZHashImage *image)
+{
+  return (size_t) image->header->entry_count;
+}
+
+void *zhash_image_get_n(struct ZHashImage *image, const void *key, size_t len,
+    size_t *val_size)
+{
+  const struct ZImageEntry *entry;
+
+  entry = zimage_find(image, key, len);
+
+  if (val_size) *val_size = 0;
+
+  if (!entry || entry->val_size == ZIMAGE_NULL_VAL) return NULL;
+
+  if (val_size) *val_size = (size_t) entry->val_size;
+
+  return (void *) (image->base + entry->val_offset);
+}
+
+// helper functions, definitions
+// the entries of a bucket are contiguous, so a lookup reads one range of
+// entries instead of following a chain
+static const struct ZImageEntry *zimage_find(struct ZHashImage *image,
+    const void *key, size_t len)
+{
+  const struct ZImageEntry *entry, *end;
+  uint64_t hash, bucket;
+
+  hash = zhash_hash_n(key, len);
+  bucket = hash & (image->header->bucket_count - 1);
+  entry = image->entries + image->buckets[bucket];
+  end = image->entries + image->buckets[bucket + 1];
+
+  for (; entry < end; entry++) {
+    if (entry->hash == hash && entry->key_length == len &&
+        memcmp(image->base + entry->key_offset, key, len) == 0) {
+      return entry;
+    }
+  }
+
+  return NULL;
+}
+
+// the hash cached in the entry is reused instead of hashing the key again
+static void zcollect_entry(struct ZHashEntry *entry, void *ctx)
+{
+  struct ZImageSources *collected;
+  struct ZImageSource *source;
+
+  collected = (struct ZImageSources *) ctx;
+  source = &collected->sources[collected->count++];
+
+  source->key = entry->key;
+  source->key_length = entry->key_length;
+  source->val = entry->val;
+  source->hash = entry->hash;
+}
+
+// create a new file named path followed by random digits, and write its name
+// to tmp_path; return its descriptor, or -1 if it could not be created
+// the file is opened like any other new file, with mode 0666 less the umask
+static int zcreate_tmp_file(const char *path, char *tmp_path)
+{
+  static unsigned counter;
+  struct {
+    pid_t pid;
+    unsigned counter;
+    struct timespec now;
+    const void *stack;
+  } seed;
+  size_t ii;
+  int fd;
+
+  memset(&seed, 0, sizeof(seed));
+  seed.pid = getpid();
+  seed.stack = &seed;
+
+  // O_EXCL makes the name unique; the seed only makes a taken name unlikely
+  for (ii = 0; ii < ZIMAGE_TMP_ATTEMPTS; ii++) {
+    seed.counter = counter++;
+    clock_gettime(CLOCK_REALTIME, &seed.now);
+
+    sprintf(tmp_path, "%s.%016llx", path,
+        (unsigned long long) zhash_hash_n(&seed, sizeof(seed)));
+
+    fd = open(tmp_path, O_WRONLY | O_CREAT | O_EXCL, 0666);
+    if (fd != -1 || errno != EEXIST) return fd;
+  }
+
+  return -1;
+}
+
+// sync the directory that holds path, if it can be opened
+static void zsync_dir(const char *path)
+{
+  const char *slash;
+  char *dir;
+  int fd;
+
+  slash = strrchr(path, '/');
+
+  if (!slash) {
+    fd = open(".", O_RDONLY);
+  } else {
+    if (!(dir = malloc((size_t) (slash - path) + 2))) return;
+
+    memcpy(dir, path, (size_t) (slash - path) + 1);
+    dir[slash - path + 1] = '\0';
+
+    fd = open(dir, O_RDONLY);
+    zfree(dir);
+  }
+
+  if (fd == -1) return;
+
+  fsync(fd);
+  close(fd);
+}
+
+// write every part of the image at the offsets recorded in header and entries
+static bool zwrite_image_file(FILE *file, const struct ZImageHeader *header,
+    const uint64_t *buckets, const struct ZImageEntry *entries,
+    struct ZImageSource **order)
+{
+  uint64_t offset;
+  size_t ii;
+
+  offset = 0;
+
+  if (!zwrite_at(file, &offset, 0, header, sizeof(*header)) ||
+      !zwrite_at(file, &offset, header->buckets_offset, buckets,
+        (header->bucket_count + 1) * sizeof(uint64_t)) ||
+      !zwrite_at(file, &offset, header->entries_offset, entries,
+        header->entry_count * sizeof(struct ZImageEntry))) {
+    return false;
+  }
+
+  for (ii = 0; ii < header->entry_count; ii++) {
+    if (!zwrite_at(file, &offset, entries[ii].key_offset, order[ii]->key,
+          order[ii]->key_length + 1)) {
+      return false;
+    }
+
+    if (entries[ii].val_size != ZIMAGE_NULL_VAL &&
+        !zwrite_at(file, &offset, entries[ii].val_offset, order[ii]->val,
+          entries[ii].val_size)) {
+      return false;
+    }
+  }
+
+  // pad the file to its full size
+  return zwrite_at(file, &offset, header->file_size, NULL, 0);
+}
+
+// write zero bytes up to target, then size bytes of data
+static bool zwrite_at(FILE *file, uint64_t *offset, uint64_t target,
+    const void *data, size_t size)
+{
+  static const char zeros[ZIMAGE_ALIGN] = { 0 };
+
+  while (*offset < target) {
+    size_t padding;
+
+    padding = target - *offset < ZIMAGE_ALIGN ?
+      (size_t) (target - *offset) : ZIMAGE_ALIGN;
+
+    if (fwrite(zeros, 1, padding, file) != padding) return false;
+
+    *offset += padding;
+  }
+
+  if (size > 0 && fwrite(data, 1, size, file) != size) return false;
+
+  *offset += size;
+
+  return true;
+}
+
+static uint64_t zalign(uint64_t offset)
+{
+  return (offset + ZIMAGE_ALIGN - 1) & ~(uint64_t) (ZIMAGE_ALIGN - 1);
+}
+
+static uint64_t zimage_hash_check(void)
+{
+  return zhash_hash("zhash image");
+}
+
+// check the header; entries are trusted so that opening an image does not
+// have to read all of it
+static bool zimage_valid(const struct ZHashImage *image)
+{
+  const struct ZImageHeader *header;
+
+  header = image->header;
+
+  if (memcmp(header->magic, ZIMAGE_MAGIC, sizeof(header->magic)) != 0 ||
+      header->version != ZIMAGE_VERSION ||
+      header->byte_order != ZIMAGE_BYTE_ORDER ||
+      header->hash_check != zimage_hash_check() ||
+      header->file_size != image->size) {
+    return false;
+  }
+
+  if (header->bucket_count == 0 ||
+      (header->bucket_count & (header->bucket_count - 1)) != 0 ||
+      header->bucket_count > image->size / sizeof(uint64_t) ||
+      header->entry_count > image->size / sizeof(struct ZImageEntry)) {
+    return false;
+  }
+
+  if (header->buckets_offset % ZIMAGE_ALIGN != 0 ||
+      header->entries_offset % ZIMAGE_ALIGN != 0 ||
+      header->buckets_offset > image->size ||
+      header->entries_offset > image->size ||
+      (header->bucket_count + 1) * sizeof(uint64_t) >
+        image->size - header->buckets_offset ||
+      header->entry_count * sizeof(struct ZImageEntry) >
+        image->size - header->entries_offset) {
+    return false;
+  }
+
+  return image->buckets[header->bucket_count] == header->entry_count;
+}
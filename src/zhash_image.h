@@ -0,0 +1,83 @@
+#ifndef ZHASH_IMAGE_H
+#define ZHASH_IMAGE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "./zhash.h"
+
+// read-only image of a hash table in a file
+// the file only contains offsets, never pointers, so it can be mapped at any
+// address and used without being deserialized; processes that map the same
+// file share its pages
+// images are read on the architecture (word size and byte order) that wrote
+// them; zhash_open_image rejects other images
+
+// struct at the start of an image file
+// hash_check is the hash of a fixed string, so that an image written with a
+// different hash function is rejected
+// buckets are bucket_count + 1 entry indexes: the entries of bucket b are
+// entries[buckets[b]] to entries[buckets[b + 1] - 1]
+struct ZImageHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t byte_order;
+  uint64_t hash_check;
+  uint64_t file_size;
+  uint64_t entry_count;
+  uint64_t bucket_count;
+  uint64_t buckets_offset;
+  uint64_t entries_offset;
+};
+
+// struct representing an entry in an image
+// offsets are from the start of the file; the key is followed by a NUL byte
+// val_size is UINT64_MAX for NULL values
+struct ZImageEntry {
+  uint64_t hash;
+  uint64_t key_offset;
+  uint64_t key_length;
+  uint64_t val_offset;
+  uint64_t val_size;
+};
+
+// struct representing an image mapped into memory
+struct ZHashImage {
+  const char *base;
+  size_t size;
+  const struct ZImageHeader *header;
+  const uint64_t *buckets;
+  const struct ZImageEntry *entries;
+};
+
+// function returning the number of bytes of a value to copy into an image
+typedef size_t (*ZValueSizeFunction)(void *val);
+
+// write an image of the table to path; return false if the file could not be
+// written or there is not enough memory
+// each value is copied as val_size(val) bytes starting at val; if val_size is
+// NULL, values are NUL-terminated strings; NULL values stay NULL
+// the image is written to a uniquely named temporary file in the same
+// directory, which is synced and renamed to path, so processes never map a
+// partly written image (even after a crash) and concurrent writers do not
+// share a temporary file; like other new files, the image is created with
+// mode 0666 less the process's umask
+bool zhash_write_image(struct ZHashTable *hash_table, const char *path,
+    ZValueSizeFunction val_size);
+
+// map the image at path read-only; return NULL if it is missing or invalid, or
+// if there is not enough memory
+struct ZHashImage *zhash_open_image(const char *path);
+void zhash_close_image(struct ZHashImage *image);
+
+// image operations; values point into the mapped file and must not be written
+void *zhash_image_get(struct ZHashImage *image, char *key);
+bool zhash_image_exists(struct ZHashImage *image, char *key);
+size_t zhash_image_count(struct ZHashImage *image);
+
+// same as zhash_image_get for a key of len bytes; if val_size is not NULL, it
+// is set to the size of the value (0 if there is no value)
+void *zhash_image_get_n(struct ZHashImage *image, const void *key, size_t len,
+    size_t *val_size);
+
+#endif
@@ -0,0 +1,339 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "./zhash.h"
+#include "./zint_hash.h"
+
+// helper macros and functions, declarations
+static struct ZIntHashTable *zcreate_int_hash_table_with_size(size_t size_index,
+    const struct ZAllocator *allocator);
+static size_t zint_find(struct ZIntHashTable *hash_table, uint64_t key);
+static size_t zint_probe(struct ZIntHashTable *hash_table, uint64_t key);
+static void zint_insert(struct ZIntHashSlot *slots, size_t mask,
+    uint64_t key, void *val);
+static void zint_remove(struct ZIntHashTable *hash_table, size_t index);
+static bool zint_rehash(struct ZIntHashTable *hash_table, size_t size_index);
+static size_t zint_slot_count(size_t size_index);
+static void *zcalloc(const struct ZAllocator *allocator, size_t num,
+    size_t size);
+static void zrelease(const struct ZAllocator *allocator, void *ptr);
+static void *zdefault_alloc(size_t size, void *ctx);
+static void *zdefault_calloc(size_t num, size_t size, void *ctx);
+static void zdefault_free(void *ptr, void *ctx);
+
+static const struct ZAllocator default_allocator = {
+  zdefault_alloc, zdefault_calloc, zdefault_free, NULL
+};
+
+// functions declared in zint_hash.h
+struct ZIntHashTable *zcreate_int_hash_table(void)
+{
+  return zcreate_int_hash_table_with_size(0, &default_allocator);
+}
+
+struct ZIntHashTable *zcreate_int_hash_table_with_allocator(
+    const struct ZAllocator *allocator)
+{
+  return zcreate_int_hash_table_with_size(0,
+      allocator ? allocator : &default_allocator);
+}
+
+void zfree_int_hash_table(struct ZIntHashTable *hash_table)
+{
+  struct ZAllocator allocator;
+
+  zrelease(&hash_table->allocator, (void *) hash_table->slots);
+
+  // the allocator is part of the table being freed
+  allocator = hash_table->allocator;
+  zrelease(&allocator, (void *) hash_table);
+}
+
+enum ZHashStatus zint_hash_set(struct ZIntHashTable *hash_table, uint64_t key,
+    void *val)
+{
+  void **slot;
+  bool created;
+
+  if (!(slot = zint_hash_upsert(hash_table, key, &created))) {
+    return ZHASH_NO_MEMORY;
+  }
+
+  *slot = val;
+
+  return ZHASH_OK;
+}
+
+void *zint_hash_get(struct ZIntHashTable *hash_table, uint64_t key)
+{
+  size_t index;
+
+  if (key == 0) return hash_table->has_zero ? hash_table->zero_val : NULL;
+
+  index = zint_find(hash_table, key);
+
+  return index != SIZE_MAX ? hash_table->slots[index].val : NULL;
+}
+
+void *zint_hash_delete(struct ZIntHashTable *hash_table, uint64_t key)
+{
+  size_t index;
+  void *val;
+
+  if (key == 0) {
+    if (!hash_table->has_zero) return NULL;
+
+    hash_table->has_zero = false;
+    hash_table->entry_count--;
+    val = hash_table->zero_val;
+    hash_table->zero_val = NULL;
+
+    return val;
+  }
+
+  index = zint_find(hash_table, key);
+
+  if (index == SIZE_MAX) return NULL;
+
+  val = hash_table->slots[index].val;
+  zint_remove(hash_table, index);
+  hash_table->entry_count--;
+
+  // shrink below 12.5% load; if the smaller array cannot be allocated the
+  // table keeps its size
+  if (hash_table->size_index > 0 && hash_table->entry_count <
+      zint_slot_count(hash_table->size_index) / 8) {
+    zint_rehash(hash_table, hash_table->size_index - 1);
+  }
+
+  return val;
+}
+
+bool zint_hash_exists(struct ZIntHashTable *hash_table, uint64_t key)
+{
+  if (key == 0) return hash_table->has_zero;
+
+  return zint_find(hash_table, key) != SIZE_MAX;
+}
+
+size_t zint_hash_count(struct ZIntHashTable *hash_table)
+{
+  return hash_table->entry_count;
+}
+
+void **zint_hash_upsert(struct ZIntHashTable *hash_table, uint64_t key,
+    bool *created)
+{
+  size_t index;
+
+  if (key == 0) {
+    *created = !hash_table->has_zero;
+
+    if (*created) {
+      hash_table->has_zero = true;
+      hash_table->zero_val = NULL;
+      hash_table->entry_count++;
+    }
+
+    return &hash_table->zero_val;
+  }
+
+  index = zint_probe(hash_table, key);
+  *created = hash_table->slots[index].key != key;
+
+  if (!*created) return &hash_table->slots[index].val;
+
+  // grow above 75% load; only then is the key probed for again
+  if (hash_table->entry_count + 1 >
+      zint_slot_count(hash_table->size_index) / 4 * 3) {
+    if (!zint_rehash(hash_table, hash_table->size_index + 1)) return NULL;
+    index = zint_probe(hash_table, key);
+  }
+
+  hash_table->slots[index].key = key;
+  hash_table->slots[index].val = NULL;
+  hash_table->entry_count++;
+
+  return &hash_table->slots[index].val;
+}
+
+// murmur3's 64-bit finalizer; every bit of the key affects every bit of the
+// result, so the low bits can be used directly as the slot index
+uint64_t zint_hash_mix(uint64_t key)
+{
+  key ^= key >> 33;
+  key *= 0xff51afd7ed558ccdull;
+  key ^= key >> 33;
+  key *= 0xc4ceb9fe1a85ec53ull;
+  key ^= key >> 33;
+
+  return key;
+}
+
+// helper functions, definitions
+static struct ZIntHashTable *zcreate_int_hash_table_with_size(size_t size_index,
+    const struct ZAllocator *allocator)
+{
+  struct ZIntHashTable *hash_table;
+
+  hash_table = (struct ZIntHashTable *) zcalloc(allocator, 1,
+      sizeof(struct ZIntHashTable));
+
+  if (!hash_table) return NULL;
+
+  hash_table->size_index = size_index;
+  hash_table->allocator = *allocator;
+  hash_table->slots = zcalloc(allocator, zint_slot_count(size_index),
+      sizeof(struct ZIntHashSlot));
+
+  if (!hash_table->slots) {
+    zrelease(allocator, (void *) hash_table);
+    return NULL;
+  }
+
+  return hash_table;
+}
+
+// return the slot index of key (which is not 0), or SIZE_MAX if it is not in
+// the table
+static size_t zint_find(struct ZIntHashTable *hash_table, uint64_t key)
+{
+  size_t index;
+
+  index = zint_probe(hash_table, key);
+
+  return hash_table->slots[index].key ? index : SIZE_MAX;
+}
+
+// return the slot index of key (which is not 0), or of the empty slot that
+// ends its probe sequence if it is not in the table
+static size_t zint_probe(struct ZIntHashTable *hash_table, uint64_t key)
+{
+  size_t mask, index;
+
+  mask = zint_slot_count(hash_table->size_index) - 1;
+
+  for (index = zint_hash_mix(key) & mask; hash_table->slots[index].key &&
+      hash_table->slots[index].key != key; index = (index + 1) & mask);
+
+  return index;
+}
+
+// put key in the first empty slot of its probe sequence
+static void zint_insert(struct ZIntHashSlot *slots, size_t mask,
+    uint64_t key, void *val)
+{
+  size_t index;
+
+  for (index = zint_hash_mix(key) & mask; slots[index].key;
+      index = (index + 1) & mask);
+
+  slots[index].key = key;
+  slots[index].val = val;
+}
+
+// empty the slot at index, moving later entries of the same run back so that
+// no probe sequence has a gap (no tombstones are needed)
+static void zint_remove(struct ZIntHashTable *hash_table, size_t index)
+{
+  struct ZIntHashSlot *slots;
+  size_t mask, next;
+
+  slots = hash_table->slots;
+  mask = zint_slot_count(hash_table->size_index) - 1;
+
+  for (next = (index + 1) & mask; slots[next].key; next = (next + 1) & mask) {
+    size_t home;
+
+    home = zint_hash_mix(slots[next].key) & mask;
+
+    // the entry can move to index if index is between its home slot and its
+    // current slot (going around the end of the array)
+    if (((next - home) & mask) >= ((next - index) & mask)) {
+      slots[index] = slots[next];
+      index = next;
+    }
+  }
+
+  slots[index].key = 0;
+  slots[index].val = NULL;
+}
+
+// move every entry to a new array of (ZINT_MIN_SIZE << size_index) slots;
+// return false and leave the table as it is if it cannot be allocated
+static bool zint_rehash(struct ZIntHashTable *hash_table, size_t size_index)
+{
+  struct ZIntHashSlot *slots, *new_slots;
+  size_t size, ii;
+
+  new_slots = zcalloc(&hash_table->allocator, zint_slot_count(size_index),
+      sizeof(struct ZIntHashSlot));
+
+  if (!new_slots) return false;
+
+  size = zint_slot_count(hash_table->size_index);
+  slots = hash_table->slots;
+
+  hash_table->size_index = size_index;
+  hash_table->slots = new_slots;
+
+  for (ii = 0; ii < size; ii++) {
+    if (!slots[ii].key) continue;
+
+    zint_insert(hash_table->slots, zint_slot_count(size_index) - 1,
+        slots[ii].key, slots[ii].val);
+  }
+
+  zrelease(&hash_table->allocator, (void *) slots);
+
+  return true;
+}
+
+static size_t zint_slot_count(size_t size_index)
+{
+  return ZINT_MIN_SIZE << size_index;
+}
+
+static void *zcalloc(const struct ZAllocator *allocator, size_t num,
+    size_t size)
+{
+  void *ptr;
+
+  if (allocator->calloc) return allocator->calloc(num, size, allocator->ctx);
+
+  if (size != 0 && num > SIZE_MAX / size) return NULL;
+
+  if ((ptr = allocator->alloc(num * size, allocator->ctx))) {
+    memset(ptr, 0, num * size);
+  }
+
+  return ptr;
+}
+
+static void zrelease(const struct ZAllocator *allocator, void *ptr)
+{
+  if (allocator->free) allocator->free(ptr, allocator->ctx);
+}
+
+static void *zdefault_alloc(size_t size, void *ctx)
+{
+  (void) ctx;
+
+  return malloc(size);
+}
+
+static void *zdefault_calloc(size_t num, size_t size, void *ctx)
+{
+  (void) ctx;
+
+  return calloc(num, size);
+}
+
+static void zdefault_free(void *ptr, void *ctx)
+{
+  (void) ctx;
+
+  free(ptr);
+}
@@ -0,0 +1,68 @@
+#ifndef ZINT_HASH_H
+#define ZINT_HASH_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "./zhash.h"
+
+// integer hash table, uses open addressing with linear probing
+// keys are uint64_t
+// values are void *pointers
+// keys are stored in the slots themselves, so setting a key never allocates
+// (except when the table grows) and lookups never hash or compare strings
+
+// struct representing a slot in the hash table
+// key 0 marks an empty slot; the entry for key 0 is kept in the table itself
+struct ZIntHashSlot {
+  uint64_t key;
+  void *val;
+};
+
+// struct representing the integer hash table
+// the table has (ZINT_MIN_SIZE << size_index) slots
+// has_zero is true if key 0 is in the table, and zero_val is then its value
+// all of the table's memory, including the table itself, comes from allocator
+struct ZIntHashTable {
+  size_t size_index;
+  size_t entry_count;
+  struct ZIntHashSlot *slots;
+  bool has_zero;
+  void *zero_val;
+  struct ZAllocator allocator;
+};
+
+#define ZINT_MIN_SIZE ((size_t) 16)
+
+// integer hash table creation and destruction
+// tables are created with malloc, calloc and free unless an allocator is given
+// (NULL for the default; see struct ZAllocator in zhash.h); creation returns
+// NULL if there is not enough memory
+struct ZIntHashTable *zcreate_int_hash_table(void);
+struct ZIntHashTable *zcreate_int_hash_table_with_allocator(
+    const struct ZAllocator *allocator);
+void zfree_int_hash_table(struct ZIntHashTable *hash_table);
+
+// integer hash table operations; these behave the same as their counterparts
+// in zhash.h
+// set returns ZHASH_NO_MEMORY and leaves the table unchanged if the table
+// needs to grow and the larger array cannot be allocated
+enum ZHashStatus zint_hash_set(struct ZIntHashTable *hash_table, uint64_t key,
+    void *val);
+void *zint_hash_get(struct ZIntHashTable *hash_table, uint64_t key);
+void *zint_hash_delete(struct ZIntHashTable *hash_table, uint64_t key);
+bool zint_hash_exists(struct ZIntHashTable *hash_table, uint64_t key);
+size_t zint_hash_count(struct ZIntHashTable *hash_table);
+
+// return a pointer to the value of key, adding key with a NULL value if it is
+// not in the table; created is set to whether the key is new
+// return NULL (and leave the table unchanged) if there is not enough memory
+// for the key to be added
+// the pointer is valid until the next set, upsert or delete
+void **zint_hash_upsert(struct ZIntHashTable *hash_table, uint64_t key,
+    bool *created);
+
+// hash function used by the table: a bijective mix of the bits of key
+uint64_t zint_hash_mix(uint64_t key);
+
+#endif
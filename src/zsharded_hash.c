@@ -0,0 +1,181 @@
+// pthread_rwlock_t and posix_memalign with -std=c11
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200112L
+#endif
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "./zhash.h"
+#include "./zsharded_hash.h"
+
+// helper macros and functions, declarations
+#define zfree free
+
+static struct ZHashShard *zshard_for(struct ZShardedHashTable *hash_table,
+    uint64_t hash);
+static void zfree_shards(struct ZHashShard *shards, size_t shard_count);
+
+// functions declared in zsharded_hash.h
+struct ZShardedHashTable *zcreate_sharded_hash_table(size_t shard_count)
+{
+  return zcreate_sharded_hash_table_with_allocator(shard_count, NULL);
+}
+
+struct ZShardedHashTable *zcreate_sharded_hash_table_with_allocator(
+    size_t shard_count, const struct ZAllocator *allocator)
+{
+  struct ZShardedHashTable *hash_table;
+  size_t shard_bits, ii;
+
+  for (shard_bits = 0; ((size_t) 1 << shard_bits) < shard_count; shard_bits++);
+
+  if (!(hash_table = malloc(sizeof(struct ZShardedHashTable)))) return NULL;
+
+  hash_table->shard_bits = shard_bits;
+
+  if (posix_memalign((void **) &hash_table->shards, ZSHARD_ALIGN,
+      ((size_t) 1 << shard_bits) * sizeof(struct ZHashShard)) != 0) {
+    zfree((void *) hash_table);
+    return NULL;
+  }
+
+  // shards are not incremental, so lookups never move entries and only need
+  // a read lock (the ZHASH_PROBE_STATS counters are updated atomically)
+  for (ii = 0; ii < (size_t) 1 << shard_bits; ii++) {
+    if (pthread_rwlock_init(&hash_table->shards[ii].lock, NULL) != 0) break;
+
+    hash_table->shards[ii].table = zcreate_hash_table_with_allocator(0, 0,
+        allocator);
+
+    if (!hash_table->shards[ii].table) {
+      pthread_rwlock_destroy(&hash_table->shards[ii].lock);
+      break;
+    }
+  }
+
+  if (ii < (size_t) 1 << shard_bits) {
+    zfree_shards(hash_table->shards, ii);
+    zfree((void *) hash_table);
+    return NULL;
+  }
+
+  return hash_table;
+}
+
+void zfree_sharded_hash_table(struct ZShardedHashTable *hash_table)
+{
+  zfree_shards(hash_table->shards, (size_t) 1 << hash_table->shard_bits);
+  zfree((void *) hash_table);
+}
+
+enum ZHashStatus zsharded_hash_set(struct ZShardedHashTable *hash_table,
+    char *key, void *val)
+{
+  uint64_t hash;
+  struct ZHashShard *shard;
+  enum ZHashStatus status;
+
+  hash = zhash_hash(key);
+  shard = zshard_for(hash_table, hash);
+
+  pthread_rwlock_wrlock(&shard->lock);
+  status = zhash_set_prehashed(shard->table, key, hash, val);
+  pthread_rwlock_unlock(&shard->lock);
+
+  return status;
+}
+
+void *zsharded_hash_get(struct ZShardedHashTable *hash_table, char *key)
+{
+  uint64_t hash;
+  struct ZHashShard *shard;
+  void *val;
+
+  hash = zhash_hash(key);
+  shard = zshard_for(hash_table, hash);
+
+  pthread_rwlock_rdlock(&shard->lock);
+  val = zhash_get_prehashed(shard->table, key, hash);
+  pthread_rwlock_unlock(&shard->lock);
+
+  return val;
+}
+
+void *zsharded_hash_delete(struct ZShardedHashTable *hash_table, char *key)
+{
+  uint64_t hash;
+  struct ZHashShard *shard;
+  void *val;
+
+  hash = zhash_hash(key);
+  shard = zshard_for(hash_table, hash);
+
+  pthread_rwlock_wrlock(&shard->lock);
+  val = zhash_delete_prehashed(shard->table, key, hash);
+  pthread_rwlock_unlock(&shard->lock);
+
+  return val;
+}
+
+bool zsharded_hash_exists(struct ZShardedHashTable *hash_table, char *key)
+{
+  uint64_t hash;
+  struct ZHashShard *shard;
+  bool exists;
+
+  hash = zhash_hash(key);
+  shard = zshard_for(hash_table, hash);
+
+  pthread_rwlock_rdlock(&shard->lock);
+  exists = zhash_exists_prehashed(shard->table, key, hash);
+  pthread_rwlock_unlock(&shard->lock);
+
+  return exists;
+}
+
+size_t zsharded_hash_count(struct ZShardedHashTable *hash_table)
+{
+  size_t count, ii;
+
+  count = 0;
+
+  for (ii = 0; ii < (size_t) 1 << hash_table->shard_bits; ii++) {
+    struct ZHashShard *shard;
+
+    shard = &hash_table->shards[ii];
+
+    pthread_rwlock_rdlock(&shard->lock);
+    count += shard->table->entry_count;
+    pthread_rwlock_unlock(&shard->lock);
+  }
+
+  return count;
+}
+
+// helper functions, definitions
+
+// the shard is chosen by the high bits of the hash, which are independent of
+// the bucket a shard picks with hash % size
+static struct ZHashShard *zshard_for(struct ZShardedHashTable *hash_table,
+    uint64_t hash)
+{
+  if (hash_table->shard_bits == 0) return &hash_table->shards[0];
+
+  return &hash_table->shards[hash >> (64 - hash_table->shard_bits)];
+}
+
+// destroy the first shard_count shards and free the shard array
+static void zfree_shards(struct ZHashShard *shards, size_t shard_count)
+{
+  size_t ii;
+
+  for (ii = 0; ii < shard_count; ii++) {
+    pthread_rwlock_destroy(&shards[ii].lock);
+    zfree_hash_table(shards[ii].table);
+  }
+
+  zfree((void *) shards);
+}
@@ -0,0 +1,61 @@
+#ifndef ZSHARDED_HASH_H
+#define ZSHARDED_HASH_H
+
+// pthread_rwlock_t with -std=c11; only takes effect when this
+// header is included before any system header
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200112L
+#endif
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "./zhash.h"
+
+// thread-safe hash table, built on top of zhash
+// keys are strings
+// values are void *pointers
+// keys are split across shards by the high bits of their hash; each shard is
+// a separate ZHashTable with its own lock, entry count and rehashing
+
+// shards are aligned to this size so that their locks do not share cache lines
+#define ZSHARD_ALIGN 64
+
+// struct representing one shard
+struct ZHashShard {
+  _Alignas(ZSHARD_ALIGN) pthread_rwlock_t lock;
+  struct ZHashTable *table;
+};
+
+// struct representing the sharded hash table
+// there are (1 << shard_bits) shards
+struct ZShardedHashTable {
+  size_t shard_bits;
+  struct ZHashShard *shards;
+};
+
+// sharded hash table creation and destruction
+// shard_count is rounded up to a power of 2
+// creation returns NULL if there is not enough memory
+struct ZShardedHashTable *zcreate_sharded_hash_table(size_t shard_count);
+
+// create a table whose shard tables get their memory from allocator (NULL for
+// the default); the table itself and its shard array come from malloc, since
+// the shards must be aligned
+struct ZShardedHashTable *zcreate_sharded_hash_table_with_allocator(
+    size_t shard_count, const struct ZAllocator *allocator);
+void zfree_sharded_hash_table(struct ZShardedHashTable *hash_table);
+
+// sharded hash table operations; safe to call from any number of threads
+// set returns ZHASH_NO_MEMORY if the entry could not be added, like zhash_set
+enum ZHashStatus zsharded_hash_set(struct ZShardedHashTable *hash_table,
+    char *key, void *val);
+void *zsharded_hash_get(struct ZShardedHashTable *hash_table, char *key);
+void *zsharded_hash_delete(struct ZShardedHashTable *hash_table, char *key);
+bool zsharded_hash_exists(struct ZShardedHashTable *hash_table, char *key);
+
+// number of entries in all shards
+size_t zsharded_hash_count(struct ZShardedHashTable *hash_table);
+
+#endif
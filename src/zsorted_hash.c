@@ -1,4 +1,6 @@
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -8,104 +10,280 @@
 #include "./zhash.h"
 #include "./zsorted_hash.h"
 
-static struct ZSortedEntry *zcreate_sorted_entry(char *key, void *val);
-static void zfree_sorted_entry(struct ZSortedEntry *entry, bool recursive);
-static void *zmalloc(size_t size);
+static struct ZSortedHashTable *zcreate_sorted(enum ZSortedOrder order,
+    bool ttl, const struct ZAllocator *allocator);
+static struct ZHashEntry *zsorted_set(struct ZSortedHashTable *hash_table,
+    char *key, void *val);
+static struct ZHashEntry *zsorted_find(struct ZSortedHashTable *hash_table,
+    char *key, size_t len);
+static void zsorted_detach(struct ZSortedHashTable *hash_table,
+    struct ZHashEntry *hash_entry);
+static void zsorted_reap(struct ZSortedHashTable *hash_table,
+    struct ZHashEntry *hash_entry, ZEvictCallback callback, void *ctx);
+static void zsorted_release(struct ZSortedHashTable *hash_table,
+    struct ZHashEntry *hash_entry, ZEvictCallback callback, void *ctx);
+static struct ZHashEntry *zhash_entry(struct ZSortedEntry *entry);
+static struct ZSortedEntry *zsorted_entry(struct ZHashEntry *entry);
+static struct ZKeyedEntry *zkeyed_entry(struct ZSortedEntry *entry);
+static void zlist_append(struct ZSortedHashTable *hash_table,
+    struct ZSortedEntry *entry);
+static void zlist_remove(struct ZSortedHashTable *hash_table,
+    struct ZSortedEntry *entry);
+static size_t zentry_charge(struct ZSortedHashTable *hash_table,
+    struct ZHashEntry *hash_entry);
+static void zcache_evict(struct ZSortedHashTable *hash_table);
+static struct ZTimer *ztimer(struct ZSortedHashTable *hash_table,
+    struct ZSortedEntry *entry);
+static struct ZSortedEntry *ztimer_entry(struct ZSortedHashTable *hash_table,
+    struct ZTimer *timer);
+static bool zexpired(struct ZSortedHashTable *hash_table,
+    struct ZHashEntry *hash_entry);
+static void ztimer_schedule(struct ZTimerWheel *wheel, struct ZTimer *timer);
+static void ztimer_cancel(struct ZTimerWheel *wheel, struct ZTimer *timer);
+static void zwheel_skip(struct ZTimerWheel *wheel);
+static void zwheel_cascade(struct ZTimerWheel *wheel, size_t level);
+static struct ZSortedEntry **zskip_link(struct ZSortedHashTable *hash_table,
+    struct ZSortedEntry *entry, size_t level);
+static struct ZSortedEntry *zskip_search(struct ZSortedHashTable *hash_table,
+    const char *key, size_t len, bool inclusive, struct ZSortedEntry **preds);
+static void zskip_insert(struct ZSortedHashTable *hash_table,
+    struct ZSortedEntry *entry);
+static void zskip_remove(struct ZSortedHashTable *hash_table,
+    struct ZSortedEntry *entry);
+static size_t zskip_random_height(struct ZSortedHashTable *hash_table);
+static bool zkey_before(struct ZSortedEntry *entry, const char *key, size_t len,
+    bool inclusive);
+static struct ZIterator *zcreate_iterator_after(
+    struct ZSortedHashTable *hash_table, char *key, bool inclusive);
+static void *zmalloc(struct ZHashTable *table, size_t size);
+static void zrelease(struct ZHashTable *table, void *ptr);
 
 struct ZSortedHashTable *zcreate_sorted_hash_table(void)
+{
+  return zcreate_sorted(ZINSERTION_ORDER, false, NULL);
+}
+
+struct ZSortedHashTable *zcreate_sorted_hash_table_with_order(
+    enum ZSortedOrder order)
+{
+  return zcreate_sorted(order, false, NULL);
+}
+
+struct ZSortedHashTable *zcreate_sorted_hash_table_with_ttl(
+    enum ZSortedOrder order, ZEvictCallback expired, void *ctx)
 {
   struct ZSortedHashTable *hash_table;
 
-  hash_table = zmalloc(sizeof(struct ZSortedHashTable));
+  if (!(hash_table = zcreate_sorted(order, true, NULL))) return NULL;
 
-  hash_table->table = zcreate_hash_table();
-  hash_table->first = NULL;
-  hash_table->last = NULL;
+  hash_table->wheel->expired = expired;
+  hash_table->wheel->ctx = ctx;
 
   return hash_table;
 }
 
-void zfree_sorted_hash_table(struct ZSortedHashTable *hash_table)
+struct ZSortedHashTable *zcreate_sorted_hash_table_with_allocator(
+    enum ZSortedOrder order, const struct ZAllocator *allocator)
 {
-  zfree_hash_table(hash_table->table);
-  zfree_sorted_entry(hash_table->first, true);
-  zfree(hash_table);
+  return zcreate_sorted(order, false, allocator);
 }
 
-void zsorted_hash_set(struct ZSortedHashTable *hash_table, char *key, void *val)
+// the hash table is freed last, since it holds the allocator
+void zfree_sorted_hash_table(struct ZSortedHashTable *hash_table)
 {
   struct ZSortedEntry *entry;
+  struct ZHashTable *table;
 
-  if ((entry = (struct ZSortedEntry *) zhash_get(hash_table->table, key))) {
-    entry->val = val;
+  table = hash_table->table;
 
-    return;
+  if (hash_table->order == ZKEY_ORDER) {
+    for (entry = hash_table->first; entry; entry = entry->next) {
+      if (zkeyed_entry(entry)->tower) {
+        zrelease(table, zkeyed_entry(entry)->tower);
+      }
+    }
   }
 
-  entry = zcreate_sorted_entry(key, val);
+  if (hash_table->wheel) zrelease(table, hash_table->wheel);
+  zrelease(table, hash_table);
+  zfree_hash_table(table);
+}
 
-  if (hash_table->last) {
-    entry->prev = hash_table->last;
-    hash_table->last->next = entry;
-  } else {
-    entry->prev = NULL;
-    hash_table->first = entry;
+enum ZHashStatus zsorted_hash_set(struct ZSortedHashTable *hash_table,
+    char *key, void *val)
+{
+  struct ZHashEntry *hash_entry;
+
+  if (!(hash_entry = zsorted_set(hash_table, key, val))) {
+    return ZHASH_NO_MEMORY;
   }
 
-  entry->next = NULL;
-  hash_table->last = entry;
+  if (hash_table->wheel) {
+    ztimer_cancel(hash_table->wheel, ztimer(hash_table,
+          zsorted_entry(hash_entry)));
+  }
+
+  if (hash_table->cache) zcache_evict(hash_table);
 
-  zhash_set(hash_table->table, key, (void *) entry);
+  return ZHASH_OK;
 }
 
 void *zsorted_hash_get(struct ZSortedHashTable *hash_table, char *key)
 {
-  struct ZSortedEntry *entry;
+  struct ZHashEntry *hash_entry;
+
+  hash_entry = zsorted_find(hash_table, key, strlen(key));
 
-  entry = (struct ZSortedEntry *) zhash_get(hash_table->table, key);
+  if (!hash_entry) return NULL;
 
-  return entry ? entry->val : NULL;
+  if (hash_table->cache) {
+    zlist_remove(hash_table, zsorted_entry(hash_entry));
+    zlist_append(hash_table, zsorted_entry(hash_entry));
+  }
+
+  return hash_entry->val;
 }
 
 void *zsorted_hash_delete(struct ZSortedHashTable *hash_table, char *key)
 {
-  struct ZSortedEntry *entry;
+  struct ZHashEntry *hash_entry;
   void *val;
 
-  entry = (struct ZSortedEntry *) zhash_get(hash_table->table, key);
+  hash_entry = zhash_unlink_entry(hash_table->table, key, strlen(key));
 
-  if (!entry) return NULL;
+  if (!hash_entry) return NULL;
 
-  val = entry->val;
-
-  if (entry->next) {
-    entry->next->prev = entry->prev;
-  } else {
-    hash_table->last = entry->prev;
+  // an expired entry is reaped as it would have been by a lookup
+  if (zexpired(hash_table, hash_entry)) {
+    zsorted_release(hash_table, hash_entry, hash_table->wheel->expired,
+        hash_table->wheel->ctx);
+    return NULL;
   }
 
-  if (entry->prev) {
-    entry->prev->next = entry->next;
-  } else {
-    hash_table->first = entry->next;
-  }
+  val = hash_entry->val;
 
-  zhash_delete(hash_table->table, key);
-  zfree_sorted_entry(entry, false);
+  zsorted_detach(hash_table, hash_entry);
+  zhash_free_entry(hash_table->table, hash_entry);
 
   return val;
 }
 
 bool zsorted_hash_exists(struct ZSortedHashTable *hash_table, char *key)
 {
-  return zhash_exists(hash_table->table, key);
+  return zsorted_find(hash_table, key, strlen(key)) ? true : false;
+}
+
+void zsorted_hash_set_cache_policy(struct ZSortedHashTable *hash_table,
+    const struct ZCachePolicy *policy)
+{
+  struct ZSortedEntry *entry;
+
+  if (hash_table->order != ZINSERTION_ORDER) return;
+
+  if (!policy) {
+    hash_table->cache = false;
+    return;
+  }
+
+  hash_table->cache = true;
+  hash_table->cache_policy = *policy;
+  hash_table->byte_count = 0;
+
+  for (entry = hash_table->first; entry; entry = entry->next) {
+    hash_table->byte_count += zentry_charge(hash_table, zhash_entry(entry));
+  }
+
+  zcache_evict(hash_table);
+}
+
+enum ZHashStatus zsorted_hash_set_with_ttl(struct ZSortedHashTable *hash_table,
+    char *key, void *val, uint64_t now, uint64_t ttl)
+{
+  struct ZHashEntry *hash_entry;
+  struct ZTimer *timer;
+
+  if (!hash_table->wheel) return zsorted_hash_set(hash_table, key, val);
+
+  if (now > hash_table->wheel->now) hash_table->wheel->now = now;
+
+  if (!(hash_entry = zsorted_set(hash_table, key, val))) {
+    return ZHASH_NO_MEMORY;
+  }
+
+  timer = ztimer(hash_table, zsorted_entry(hash_entry));
+
+  ztimer_cancel(hash_table->wheel, timer);
+  timer->expire_at = ttl < UINT64_MAX - now ? now + ttl : UINT64_MAX;
+  ztimer_schedule(hash_table->wheel, timer);
+
+  if (hash_table->cache) zcache_evict(hash_table);
+
+  return ZHASH_OK;
+}
+
+size_t zsorted_hash_expire(struct ZSortedHashTable *hash_table, uint64_t now,
+    size_t max_work)
+{
+  struct ZTimerWheel *wheel;
+  size_t removed;
+
+  if (!(wheel = hash_table->wheel)) return 0;
+
+  if (now > wheel->now) wheel->now = now;
+
+  removed = 0;
+
+  while (removed < max_work) {
+    size_t slot, level;
+
+    if (wheel->timer_count == 0) {
+      wheel->time = wheel->now;
+      break;
+    }
+
+    // every timer in the current slot of level 0 is due
+    slot = wheel->time & (ZWHEEL_SLOT_COUNT - 1);
+
+    while (wheel->slots[0][slot] && removed < max_work) {
+      struct ZTimer *timer;
+
+      timer = wheel->slots[0][slot];
+      zsorted_reap(hash_table, zhash_entry(ztimer_entry(hash_table, timer)),
+          wheel->expired, wheel->ctx);
+      removed++;
+    }
+
+    if (wheel->slots[0][slot]) break;
+
+    wheel->occupied[0] &= ~((uint64_t) 1 << slot);
+
+    // the wheel stays at now, so that timers that are already due when they
+    // are scheduled go in a slot that the next call processes
+    if (wheel->time == wheel->now) break;
+
+    zwheel_skip(wheel);
+    wheel->time++;
+
+    // entering a new span of a level moves its timers to the levels below
+    for (level = 1; level < ZWHEEL_LEVEL_COUNT; level++) {
+      if (wheel->time & (((uint64_t) 1 << (ZWHEEL_SLOT_BITS * level)) - 1)) {
+        break;
+      }
+
+      zwheel_cascade(wheel, level);
+    }
+  }
+
+  return removed;
 }
 
 struct ZIterator *zcreate_iterator(struct ZSortedHashTable *hash_table)
 {
   struct ZIterator *iterator;
 
-  iterator = zmalloc(sizeof(struct ZIterator));
+  // iterators are owned by the caller, not the table, so they always come
+  // from malloc
+  if (!(iterator = malloc(sizeof(struct ZIterator)))) return NULL;
 
   iterator->entry = hash_table->first;
 
@@ -123,6 +301,18 @@ void zfree_iterator(struct ZIterator *iterator)
   zfree(iterator);
 }
 
+struct ZIterator *zsorted_hash_lower_bound(struct ZSortedHashTable *hash_table,
+    char *key)
+{
+  return zcreate_iterator_after(hash_table, key, false);
+}
+
+struct ZIterator *zsorted_hash_upper_bound(struct ZSortedHashTable *hash_table,
+    char *key)
+{
+  return zcreate_iterator_after(hash_table, key, true);
+}
+
 size_t zsorted_hash_count(struct ZSortedHashTable *hash_table)
 {
   return hash_table->table->entry_count;
@@ -139,14 +329,14 @@ char *ziterator_get_key(struct ZIterator *iterator)
 {
   if (iterator->status != ZWITHIN_BOUNDS) return NULL;
 
-  return iterator->entry->key;
+  return zhash_entry(iterator->entry)->key;
 }
 
 void *ziterator_get_val(struct ZIterator *iterator)
 {
   if (iterator->status != ZWITHIN_BOUNDS) return NULL;
 
-  return iterator->entry->val;
+  return zhash_entry(iterator->entry)->val;
 }
 
 void ziterator_next(struct ZIterator *iterator)
@@ -183,40 +373,577 @@ void ziterator_prev(struct ZIterator *iterator)
   }
 }
 
-static struct ZSortedEntry *zcreate_sorted_entry(char *key, void *val)
+// the hash entry directly follows the sorted entry
+// everything is allocated with the allocator of the hash table
+static struct ZSortedHashTable *zcreate_sorted(enum ZSortedOrder order,
+    bool ttl, const struct ZAllocator *allocator)
+{
+  struct ZSortedHashTable *hash_table;
+  struct ZHashTable *table;
+  struct ZTimerWheel *wheel;
+  size_t prefix, timer_offset, ii;
+
+  prefix = order == ZKEY_ORDER ?
+    sizeof(struct ZKeyedEntry) : sizeof(struct ZSortedEntry);
+  timer_offset = 0;
+
+  // the timer goes in front of everything else
+  if (ttl) {
+    timer_offset = prefix - sizeof(struct ZSortedEntry) + sizeof(struct ZTimer);
+    prefix += sizeof(struct ZTimer);
+  }
+
+  if (!(table = zcreate_hash_table_with_allocator(0, prefix, allocator))) {
+    return NULL;
+  }
+
+  hash_table = zmalloc(table, sizeof(struct ZSortedHashTable));
+  wheel = ttl ? zmalloc(table, sizeof(struct ZTimerWheel)) : NULL;
+
+  if (!hash_table || (ttl && !wheel)) {
+    if (hash_table) zrelease(table, hash_table);
+    if (wheel) zrelease(table, wheel);
+    zfree_hash_table(table);
+    return NULL;
+  }
+
+  if (wheel) memset(wheel, 0, sizeof(struct ZTimerWheel));
+
+  hash_table->table = table;
+  hash_table->wheel = wheel;
+  hash_table->timer_offset = timer_offset;
+  hash_table->first = NULL;
+  hash_table->last = NULL;
+  hash_table->order = order;
+  hash_table->cache = false;
+  hash_table->byte_count = 0;
+  hash_table->skip_level = 0;
+  hash_table->random_state = 0x9e3779b97f4a7c15ull;
+
+  for (ii = 0; ii < ZCOUNT_OF(hash_table->skip_heads); ii++) {
+    hash_table->skip_heads[ii] = NULL;
+  }
+
+  return hash_table;
+}
+
+// set key to val, adding an entry at its position in the order if needed;
+// return NULL if there is not enough memory for a new entry
+// cache limits are not enforced, so the entry is still in the table
+static struct ZHashEntry *zsorted_set(struct ZSortedHashTable *hash_table,
+    char *key, void *val)
 {
+  struct ZHashEntry *hash_entry;
   struct ZSortedEntry *entry;
+  bool created;
+  size_t len;
+
+  len = strlen(key);
+
+  hash_entry = zhash_upsert_entry(hash_table->table, key, len, &created);
+
+  if (!hash_entry) return NULL;
+
+  entry = zsorted_entry(hash_entry);
+
+  // an expired entry is reaped and its hash entry reused for the new one
+  if (!created && zexpired(hash_table, hash_entry)) {
+    zsorted_detach(hash_table, hash_entry);
+    if (hash_table->wheel->expired) {
+      hash_table->wheel->expired(hash_entry->key, hash_entry->val,
+          hash_table->wheel->ctx);
+    }
+    created = true;
+  }
+
+  if (created && hash_table->wheel) {
+    ztimer(hash_table, entry)->pprev = NULL;
+  }
+
+  if (hash_table->cache) {
+    if (!created) {
+      hash_table->byte_count -= zentry_charge(hash_table, hash_entry);
+      zlist_remove(hash_table, entry);
+    }
+
+    hash_entry->val = val;
+    hash_table->byte_count += zentry_charge(hash_table, hash_entry);
+    zlist_append(hash_table, entry);
+
+    return hash_entry;
+  }
+
+  hash_entry->val = val;
+
+  if (!created) return hash_entry;
+
+  if (hash_table->order == ZKEY_ORDER) {
+    zskip_insert(hash_table, entry);
+  } else {
+    zlist_append(hash_table, entry);
+  }
+
+  return hash_entry;
+}
+
+// return the entry for key, or NULL if there is none
+// an expired entry is removed and NULL is returned
+static struct ZHashEntry *zsorted_find(struct ZSortedHashTable *hash_table,
+    char *key, size_t len)
+{
+  struct ZHashEntry *hash_entry;
+
+  hash_entry = zhash_find_entry(hash_table->table, key, len);
+
+  if (hash_entry && zexpired(hash_table, hash_entry)) {
+    zsorted_reap(hash_table, hash_entry, hash_table->wheel->expired,
+        hash_table->wheel->ctx);
+    return NULL;
+  }
+
+  return hash_entry;
+}
+
+// remove an entry that is no longer in the hash table from the order, the
+// skip list, the cache accounting and the timer wheel
+static void zsorted_detach(struct ZSortedHashTable *hash_table,
+    struct ZHashEntry *hash_entry)
+{
+  struct ZSortedEntry *entry;
+
+  entry = zsorted_entry(hash_entry);
+
+  if (hash_table->order == ZKEY_ORDER) zskip_remove(hash_table, entry);
+  if (hash_table->cache) {
+    hash_table->byte_count -= zentry_charge(hash_table, hash_entry);
+  }
+  if (hash_table->wheel) {
+    ztimer_cancel(hash_table->wheel, ztimer(hash_table, entry));
+  }
+
+  zlist_remove(hash_table, entry);
+}
+
+// remove an entry from the table, pass it to callback and free it
+static void zsorted_reap(struct ZSortedHashTable *hash_table,
+    struct ZHashEntry *hash_entry, ZEvictCallback callback, void *ctx)
+{
+  zhash_remove_entry(hash_table->table, hash_entry);
+  zsorted_release(hash_table, hash_entry, callback, ctx);
+}
+
+// same as zsorted_reap, for an entry already unlinked from the hash table
+static void zsorted_release(struct ZSortedHashTable *hash_table,
+    struct ZHashEntry *hash_entry, ZEvictCallback callback, void *ctx)
+{
+  zsorted_detach(hash_table, hash_entry);
+
+  if (callback) callback(hash_entry->key, hash_entry->val, ctx);
+
+  zhash_free_entry(hash_table->table, hash_entry);
+}
+
+static struct ZHashEntry *zhash_entry(struct ZSortedEntry *entry)
+{
+  return (struct ZHashEntry *) (entry + 1);
+}
+
+static struct ZSortedEntry *zsorted_entry(struct ZHashEntry *entry)
+{
+  return (struct ZSortedEntry *) entry - 1;
+}
+
+static struct ZKeyedEntry *zkeyed_entry(struct ZSortedEntry *entry)
+{
+  return (struct ZKeyedEntry *) ((char *) entry -
+      offsetof(struct ZKeyedEntry, links));
+}
+
+static void zlist_append(struct ZSortedHashTable *hash_table,
+    struct ZSortedEntry *entry)
+{
+  if (hash_table->last) {
+    entry->prev = hash_table->last;
+    hash_table->last->next = entry;
+  } else {
+    entry->prev = NULL;
+    hash_table->first = entry;
+  }
+
+  entry->next = NULL;
+  hash_table->last = entry;
+}
+
+static void zlist_remove(struct ZSortedHashTable *hash_table,
+    struct ZSortedEntry *entry)
+{
+  if (entry->next) {
+    entry->next->prev = entry->prev;
+  } else {
+    hash_table->last = entry->prev;
+  }
+
+  if (entry->prev) {
+    entry->prev->next = entry->next;
+  } else {
+    hash_table->first = entry->next;
+  }
+}
+
+// bytes charged for an entry under the cache policy
+static size_t zentry_charge(struct ZSortedHashTable *hash_table,
+    struct ZHashEntry *hash_entry)
+{
+  size_t charge;
+
+  charge = hash_table->table->entry_prefix + sizeof(struct ZHashEntry) +
+    hash_entry->key_length + 1;
+
+  if (hash_table->cache_policy.val_size) {
+    charge += hash_table->cache_policy.val_size(hash_entry->val);
+  }
+
+  return charge;
+}
+
+// remove least recently used entries while the table is over a limit
+static void zcache_evict(struct ZSortedHashTable *hash_table)
+{
+  struct ZCachePolicy *policy;
+
+  policy = &hash_table->cache_policy;
+
+  while (hash_table->first &&
+      ((policy->max_entries &&
+        hash_table->table->entry_count > policy->max_entries) ||
+       (policy->max_bytes && hash_table->byte_count > policy->max_bytes))) {
+    zsorted_reap(hash_table, zhash_entry(hash_table->first), policy->evict,
+        policy->ctx);
+  }
+}
+
+static struct ZTimer *ztimer(struct ZSortedHashTable *hash_table,
+    struct ZSortedEntry *entry)
+{
+  return (struct ZTimer *) ((char *) entry - hash_table->timer_offset);
+}
+
+static struct ZSortedEntry *ztimer_entry(struct ZSortedHashTable *hash_table,
+    struct ZTimer *timer)
+{
+  return (struct ZSortedEntry *) ((char *) timer + hash_table->timer_offset);
+}
+
+static bool zexpired(struct ZSortedHashTable *hash_table,
+    struct ZHashEntry *hash_entry)
+{
+  struct ZTimer *timer;
+
+  if (!hash_table->wheel) return false;
+
+  timer = ztimer(hash_table, zsorted_entry(hash_entry));
+
+  return timer->pprev && timer->expire_at <= hash_table->wheel->now;
+}
+
+// add a timer to the slot for its expiry time
+// a timer that expires within 64^(l + 1) ticks of the wheel's time goes in
+// level l, in the slot given by bits 6l to 6l + 5 of its expiry time; timers
+// further away go in the last level and are placed again when it cascades
+static void ztimer_schedule(struct ZTimerWheel *wheel, struct ZTimer *timer)
+{
+  uint64_t expire_at;
+  size_t level, slot;
+
+  expire_at = timer->expire_at < wheel->time ? wheel->time : timer->expire_at;
+
+  for (level = 0; level < ZWHEEL_LEVEL_COUNT - 1; level++) {
+    if (expire_at - wheel->time <
+        (uint64_t) 1 << (ZWHEEL_SLOT_BITS * (level + 1))) {
+      break;
+    }
+  }
+
+  if (expire_at - wheel->time >=
+      (uint64_t) 1 << (ZWHEEL_SLOT_BITS * ZWHEEL_LEVEL_COUNT)) {
+    // the slot that the last level reaches last
+    expire_at = wheel->time - ((uint64_t) 1 << (ZWHEEL_SLOT_BITS * level));
+  }
+
+  slot = (expire_at >> (ZWHEEL_SLOT_BITS * level)) & (ZWHEEL_SLOT_COUNT - 1);
+
+  timer->next = wheel->slots[level][slot];
+  timer->pprev = &wheel->slots[level][slot];
+
+  if (timer->next) timer->next->pprev = &timer->next;
+
+  wheel->slots[level][slot] = timer;
+  wheel->occupied[level] |= (uint64_t) 1 << slot;
+  wheel->timer_count++;
+}
+
+static void ztimer_cancel(struct ZTimerWheel *wheel, struct ZTimer *timer)
+{
+  if (!timer->pprev) return;
+
+  *timer->pprev = timer->next;
+  if (timer->next) timer->next->pprev = timer->pprev;
+
+  timer->pprev = NULL;
+  wheel->timer_count--;
+}
+
+// move the wheel's time forward over ticks that have no timers, up to the
+// tick before now
+// the rest of the current span of level l + 1 has no timers if the levels
+// below l are empty and the slots of level l after the current one are
+static void zwheel_skip(struct ZTimerWheel *wheel)
+{
+  size_t level;
+
+  for (level = 0; level < ZWHEEL_LEVEL_COUNT; level++) {
+    size_t shift, slot;
+    uint64_t end;
+
+    shift = ZWHEEL_SLOT_BITS * level;
+    slot = (wheel->time >> shift) & (ZWHEEL_SLOT_COUNT - 1);
+
+    if (level > 0 && wheel->occupied[level - 1]) return;
+    if (slot + 1 < ZWHEEL_SLOT_COUNT && wheel->occupied[level] >> (slot + 1)) {
+      return;
+    }
+
+    end = wheel->time |
+      (((uint64_t) 1 << (shift + ZWHEEL_SLOT_BITS)) - 1);
+
+    if (end >= wheel->now) {
+      wheel->time = wheel->now - 1;
+      return;
+    }
+
+    wheel->time = end;
+  }
+}
+
+// move the timers of the slot of level that the wheel's time just entered to
+// the levels below
+static void zwheel_cascade(struct ZTimerWheel *wheel, size_t level)
+{
+  struct ZTimer *timer, *next;
+  size_t slot;
+
+  slot = (wheel->time >> (ZWHEEL_SLOT_BITS * level)) & (ZWHEEL_SLOT_COUNT - 1);
+  timer = wheel->slots[level][slot];
 
-  entry = zmalloc(sizeof(struct ZSortedEntry));
+  wheel->slots[level][slot] = NULL;
+  wheel->occupied[level] &= ~((uint64_t) 1 << slot);
 
-  entry->key = key;
-  entry->val = val;
+  for (; timer; timer = next) {
+    next = timer->next;
+    wheel->timer_count--;
+    ztimer_schedule(wheel, timer);
+  }
+}
 
-  return entry;
+// return the pointer to the entry after entry at level (level + 1), where a
+// NULL entry is the head of the skip list
+static struct ZSortedEntry **zskip_link(struct ZSortedHashTable *hash_table,
+    struct ZSortedEntry *entry, size_t level)
+{
+  return entry ? &zkeyed_entry(entry)->tower->next[level] : &hash_table->skip_heads[level];
 }
 
-static void zfree_sorted_entry(struct ZSortedEntry *entry, bool recursive)
+// return the last entry whose key is less than key (or equal to key, if
+// inclusive), or NULL if there is none
+// if preds is not NULL, preds[i] is set to the last such entry at level i + 1
+// for every level below skip_level
+static struct ZSortedEntry *zskip_search(struct ZSortedHashTable *hash_table,
+    const char *key, size_t len, bool inclusive, struct ZSortedEntry **preds)
 {
-  struct ZSortedEntry *next;
+  struct ZSortedEntry *pred, *next;
+  size_t level;
 
-  if (!recursive) entry->next = NULL;
+  pred = NULL;
+
+  for (level = hash_table->skip_level; level-- > 0; ) {
+    while ((next = *zskip_link(hash_table, pred, level)) &&
+        zkey_before(next, key, len, inclusive)) {
+      pred = next;
+    }
 
-  while (entry) {
-    next = entry->next;
+    if (preds) preds[level] = pred;
+  }
 
-    zfree(entry);
+  next = pred ? pred->next : hash_table->first;
 
-    entry = next;
+  while (next && zkey_before(next, key, len, inclusive)) {
+    pred = next;
+    next = next->next;
   }
+
+  return pred;
 }
 
-static void *zmalloc(size_t size)
+// link a new entry into the list at its key's position and give it a tower
+static void zskip_insert(struct ZSortedHashTable *hash_table,
+    struct ZSortedEntry *entry)
 {
-  void *ptr;
+  struct ZSortedEntry *preds[ZSKIP_LEVEL_COUNT - 1], *pred;
+  struct ZHashEntry *hash_entry;
+  struct ZSkipTower *tower;
+  size_t height, level;
+
+  hash_entry = zhash_entry(entry);
+  pred = zskip_search(hash_table, hash_entry->key, hash_entry->key_length,
+      false, preds);
+
+  entry->prev = pred;
+  entry->next = pred ? pred->next : hash_table->first;
+
+  if (entry->next) {
+    entry->next->prev = entry;
+  } else {
+    hash_table->last = entry;
+  }
+
+  if (pred) {
+    pred->next = entry;
+  } else {
+    hash_table->first = entry;
+  }
+
+  height = zskip_random_height(hash_table);
+  tower = NULL;
+
+  // without memory for a tower the entry is only in level 0, which slows
+  // searches down a little but keeps the list correct
+  if (height > 0) {
+    tower = zmalloc(hash_table->table, sizeof(struct ZSkipTower) +
+        height * sizeof(struct ZSortedEntry *));
+
+    if (tower) {
+      tower->height = height;
+    } else {
+      height = 0;
+    }
+  }
+
+  zkeyed_entry(entry)->tower = tower;
+
+  for (level = 0; level < height; level++) {
+    struct ZSortedEntry **link;
 
-  ptr = malloc(size);
+    if (level >= hash_table->skip_level) preds[level] = NULL;
 
-  if (!ptr) exit(EXIT_FAILURE);
+    link = zskip_link(hash_table, preds[level], level);
+    tower->next[level] = *link;
+    *link = entry;
+  }
+
+  if (height > hash_table->skip_level) hash_table->skip_level = height;
+}
 
-  return ptr;
+// unlink an entry from every level of the skip list and free its tower
+static void zskip_remove(struct ZSortedHashTable *hash_table,
+    struct ZSortedEntry *entry)
+{
+  struct ZSortedEntry *preds[ZSKIP_LEVEL_COUNT - 1];
+  struct ZHashEntry *hash_entry;
+  struct ZSkipTower *tower;
+  size_t level;
+
+  if ((tower = zkeyed_entry(entry)->tower)) {
+    hash_entry = zhash_entry(entry);
+    zskip_search(hash_table, hash_entry->key, hash_entry->key_length, false,
+        preds);
+
+    for (level = 0; level < tower->height; level++) {
+      *zskip_link(hash_table, preds[level], level) = tower->next[level];
+    }
+
+    while (hash_table->skip_level > 0 &&
+        !hash_table->skip_heads[hash_table->skip_level - 1]) {
+      hash_table->skip_level--;
+    }
+
+    zrelease(hash_table->table, tower);
+  }
+}
+
+// number of levels above 0, each with probability 1/4
+static size_t zskip_random_height(struct ZSortedHashTable *hash_table)
+{
+  uint64_t random;
+  size_t height;
+
+  // xorshift64*
+  hash_table->random_state ^= hash_table->random_state >> 12;
+  hash_table->random_state ^= hash_table->random_state << 25;
+  hash_table->random_state ^= hash_table->random_state >> 27;
+  random = hash_table->random_state * 0x2545f4914f6cdd1dull;
+
+  for (height = 0; height < ZSKIP_LEVEL_COUNT - 1 && (random & 3) == 0;
+      height++) {
+    random >>= 2;
+  }
+
+  return height;
+}
+
+// true if the key of entry sorts before key (or is equal to key, if inclusive)
+// keys are compared byte by byte and a prefix sorts before longer keys
+static bool zkey_before(struct ZSortedEntry *entry, const char *key, size_t len,
+    bool inclusive)
+{
+  struct ZHashEntry *hash_entry;
+  int cmp;
+
+  hash_entry = zhash_entry(entry);
+  cmp = memcmp(hash_entry->key, key,
+      hash_entry->key_length < len ? hash_entry->key_length : len);
+
+  if (cmp == 0) {
+    if (hash_entry->key_length != len) return hash_entry->key_length < len;
+
+    return inclusive;
+  }
+
+  return cmp < 0;
+}
+
+// create an iterator at the entry after the last entry whose key is less than
+// key (or equal to key, if inclusive)
+static struct ZIterator *zcreate_iterator_after(
+    struct ZSortedHashTable *hash_table, char *key, bool inclusive)
+{
+  struct ZIterator *iterator;
+  struct ZSortedEntry *pred;
+
+  if (hash_table->order != ZKEY_ORDER) return NULL;
+
+  if (!(iterator = malloc(sizeof(struct ZIterator)))) return NULL;
+
+  pred = zskip_search(hash_table, key, strlen(key), inclusive, NULL);
+
+  iterator->entry = pred ? pred->next : hash_table->first;
+
+  if (iterator->entry) {
+    iterator->status = ZWITHIN_BOUNDS;
+  } else if ((iterator->entry = hash_table->last)) {
+    iterator->status = ZAFTER_LAST;
+  } else {
+    iterator->status = ZNO_ENTRIES;
+  }
+
+  return iterator;
+}
+
+static void *zmalloc(struct ZHashTable *table, size_t size)
+{
+  return table->allocator.alloc(size, table->allocator.ctx);
+}
+
+static void zrelease(struct ZHashTable *table, void *ptr)
+{
+  if (table->allocator.free) table->allocator.free(ptr, table->allocator.ctx);
 }
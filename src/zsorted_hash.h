@@ -2,27 +2,123 @@
 #define ZSORTED_HASH_H
 
 #include <stdbool.h>
+#include <stdint.h>
 
 #include "./zhash.h"
 
 // sorted hash table, built on top of zhash
 // keys are strings
 // values are void *pointers
-// keys are sorted according to insertion order by default
+// keys are sorted according to insertion order by default, or in
+// lexicographic order of their bytes for tables created with ZKEY_ORDER
 
 // struct to represent the linked list used to iterate through entries
+// it is stored directly before the ZHashEntry holding its key and value, in
+// the same allocation (see zcreate_hash_table_with_prefix)
 struct ZSortedEntry {
-  char *key;
-  void *val;
   struct ZSortedEntry *next;
   struct ZSortedEntry *prev;
 };
 
+// order of the entries of a sorted hash table
+enum ZSortedOrder {
+  ZINSERTION_ORDER,
+  ZKEY_ORDER
+};
+
+// key ordered tables also keep a skip list over the entries, so that an
+// iterator can be positioned at a key in O(log n); an entry is in the list
+// of level 0 (its next and prev pointers) and in each of its tower's levels
+#define ZSKIP_LEVEL_COUNT 16
+
+// struct representing the levels above 0 of an entry in the skip list
+// next[i] is the next entry at level i + 1; about 1 in 4 entries have a tower
+// and 1 in 4 towers are higher than 1
+struct ZSkipTower {
+  size_t height;
+  struct ZSortedEntry *next[];
+};
+
+// struct stored before the hash entry in key ordered tables
+// links must be the last member, so that it directly precedes the hash entry
+struct ZKeyedEntry {
+  struct ZSkipTower *tower;
+  struct ZSortedEntry links;
+};
+
+// function called with each entry that a cache evicts, after the entry has
+// been removed from the table; key is only valid during the call
+typedef void (*ZEvictCallback)(char *key, void *val, void *ctx);
+
+// struct representing the limits of a hash table used as an LRU cache
+// a limit of 0 means no limit
+// an entry is charged the memory the table allocates for it plus
+// val_size(val) bytes (if val_size is not NULL); the size of a value must not
+// change while it is in the table
+struct ZCachePolicy {
+  size_t max_entries;
+  size_t max_bytes;
+  size_t (*val_size)(void *val);
+  ZEvictCallback evict;
+  void *ctx;
+};
+
+// entries of tables created with zcreate_sorted_hash_table_with_ttl can expire
+// timers are kept in a hierarchical timer wheel of ZWHEEL_LEVEL_COUNT levels
+// of ZWHEEL_SLOT_COUNT slots; a slot at level l holds the timers that expire
+// in one span of 64^l ticks, and is moved to the level below when the wheel
+// reaches it
+// times are in ticks of any unit chosen by the caller (seconds, milliseconds)
+#define ZWHEEL_LEVEL_COUNT 4
+#define ZWHEEL_SLOT_BITS 6
+#define ZWHEEL_SLOT_COUNT (1 << ZWHEEL_SLOT_BITS)
+
+// struct stored before the other structs in front of the hash entry of
+// tables with expiring entries
+// pprev points to the pointer to the timer in its slot list, or is NULL if
+// the entry does not expire
+struct ZTimer {
+  struct ZTimer *next;
+  struct ZTimer **pprev;
+  uint64_t expire_at;
+};
+
+// struct representing the timers of a table
+// now is the latest time passed in by the caller; entries that expire at or
+// before now are treated as missing even if they have not been removed yet
+// time is the next tick the wheel will process; it never passes now, so a
+// timer that is already due when it is scheduled is still processed
+// occupied[l] has bit i set if slots[l][i] is not empty
+struct ZTimerWheel {
+  uint64_t now;
+  uint64_t time;
+  size_t timer_count;
+  ZEvictCallback expired;
+  void *ctx;
+  uint64_t occupied[ZWHEEL_LEVEL_COUNT];
+  struct ZTimer *slots[ZWHEEL_LEVEL_COUNT][ZWHEEL_SLOT_COUNT];
+};
+
 // struct representing a sorted hash table
+// wheel is NULL unless entries can expire; timer_offset is then the distance
+// from a ZTimer to the ZSortedEntry of the same entry
+// cache is true once a cache policy is set, and byte_count is then the number
+// of bytes charged for the entries
+// skip_heads[i] is the first entry at level i + 1 of the skip list and
+// skip_level is the number of levels above 0 that have entries
 struct ZSortedHashTable {
   struct ZHashTable *table;
   struct ZSortedEntry *first;
   struct ZSortedEntry *last;
+  enum ZSortedOrder order;
+  bool cache;
+  struct ZCachePolicy cache_policy;
+  size_t byte_count;
+  size_t skip_level;
+  struct ZSortedEntry *skip_heads[ZSKIP_LEVEL_COUNT - 1];
+  uint64_t random_state;
+  struct ZTimerWheel *wheel;
+  size_t timer_offset;
 };
 
 // struct used for iteration through values
@@ -38,19 +134,69 @@ struct ZIterator {
 };
 
 // sorted hash table creation and destruction
+// creation returns NULL if there is not enough memory
 struct ZSortedHashTable *zcreate_sorted_hash_table(void);
+struct ZSortedHashTable *zcreate_sorted_hash_table_with_order(
+    enum ZSortedOrder order);
+// create a table whose entries can be given a time to live
+// expired is called with each entry removed because it expired (it may be
+// NULL)
+struct ZSortedHashTable *zcreate_sorted_hash_table_with_ttl(
+    enum ZSortedOrder order, ZEvictCallback expired, void *ctx);
+// create a table whose memory (entries, skip list towers and the table
+// itself) comes from allocator; see struct ZAllocator in zhash.h
+struct ZSortedHashTable *zcreate_sorted_hash_table_with_allocator(
+    enum ZSortedOrder order, const struct ZAllocator *allocator);
 void zfree_sorted_hash_table(struct ZSortedHashTable *hash_table);
 
 // sorted hash table operations
-void zsorted_hash_set(struct ZSortedHashTable *hash_table, char *key, void *val);
+// set returns ZHASH_NO_MEMORY, and leaves the table unchanged, if a new entry
+// could not be allocated
+enum ZHashStatus zsorted_hash_set(struct ZSortedHashTable *hash_table,
+    char *key, void *val);
 void *zsorted_hash_get(struct ZSortedHashTable *hash_table, char *key);
 void *zsorted_hash_delete(struct ZSortedHashTable *hash_table, char *key);
 bool zsorted_hash_exists(struct ZSortedHashTable *hash_table, char *key);
 
+// turn the table into an LRU cache; NULL turns the cache off
+// zsorted_hash_get and zsorted_hash_set then move the entry to the end of the
+// order, and zsorted_hash_set evicts entries from the start of the order (the
+// least recently used) while the table is over a limit, including the new
+// entry if it alone is over max_bytes; zsorted_hash_exists does not count as
+// a use
+// only for ZINSERTION_ORDER tables; ignored for other tables
+void zsorted_hash_set_cache_policy(struct ZSortedHashTable *hash_table,
+    const struct ZCachePolicy *policy);
+
+// set key to val and make the entry expire at time now + ttl
+// zsorted_hash_set removes the expiry time of an existing entry
+// entries only expire in tables created with
+// zcreate_sorted_hash_table_with_ttl; other tables set the key without an
+// expiry time, like zsorted_hash_set
+enum ZHashStatus zsorted_hash_set_with_ttl(struct ZSortedHashTable *hash_table,
+    char *key, void *val, uint64_t now, uint64_t ttl);
+
+// advance the table's time to now and remove up to max_work entries that
+// expired at or before now; return the number of entries removed
+// expired entries that are not removed yet are skipped by get, delete and
+// exists (which also remove them), but not by iterators
+size_t zsorted_hash_expire(struct ZSortedHashTable *hash_table, uint64_t now,
+    size_t max_work);
+
 // iterator creation and destruction
+// iterators are allocated with malloc; creation returns NULL if it fails
 struct ZIterator *zcreate_iterator(struct ZSortedHashTable *hash_table);
 void zfree_iterator(struct ZIterator *iterator);
 
+// create an iterator at the first entry whose key is not less than key
+// (lower bound) or greater than key (upper bound); if there is none, the
+// iterator is after the last entry
+// only for ZKEY_ORDER tables; return NULL for other tables
+struct ZIterator *zsorted_hash_lower_bound(struct ZSortedHashTable *hash_table,
+    char *key);
+struct ZIterator *zsorted_hash_upper_bound(struct ZSortedHashTable *hash_table,
+    char *key);
+
 // iteration functions
 size_t zsorted_hash_count(struct ZSortedHashTable *hash_table);
 bool ziterator_exists(struct ZIterator *iterator);
@@ -0,0 +1,389 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "./zhash.h"
+#include "./zint_hash.h"
+#include "./zsorted_int_hash.h"
+
+// helper macros and functions, declarations
+// nodes are stored in the table as their index plus 1, so that no node is
+// stored as NULL
+#define zencode_node(node) ((void *) (uintptr_t) ((node) + 1))
+#define zdecode_node(val) ((size_t) (uintptr_t) (val) - 1)
+
+static size_t zsorted_int_find(struct ZSortedIntHashTable *hash_table,
+    uint64_t key);
+static bool zreserve_node(struct ZSortedIntHashTable *hash_table);
+static size_t zalloc_node(struct ZSortedIntHashTable *hash_table);
+static void zcompact_nodes(struct ZSortedIntHashTable *hash_table);
+static void zsync_iterator(struct ZSortedIntIterator *iterator);
+static void zmove_iterator(struct ZSortedIntIterator *iterator, size_t node);
+static void *zmalloc(struct ZIntHashTable *table, size_t size);
+static void zrelease(struct ZIntHashTable *table, void *ptr);
+
+// functions declared in zsorted_int_hash.h
+struct ZSortedIntHashTable *zcreate_sorted_int_hash_table(void)
+{
+  return zcreate_sorted_int_hash_table_with_allocator(NULL);
+}
+
+// everything is allocated with the allocator of the integer hash table
+struct ZSortedIntHashTable *zcreate_sorted_int_hash_table_with_allocator(
+    const struct ZAllocator *allocator)
+{
+  struct ZSortedIntHashTable *hash_table;
+  struct ZIntHashTable *table;
+  struct ZSortedIntNode *nodes;
+
+  if (!(table = zcreate_int_hash_table_with_allocator(allocator))) return NULL;
+
+  hash_table = zmalloc(table, sizeof(struct ZSortedIntHashTable));
+  nodes = zmalloc(table, ZINT_MIN_SIZE * sizeof(struct ZSortedIntNode));
+
+  if (!hash_table || !nodes) {
+    if (hash_table) zrelease(table, hash_table);
+    if (nodes) zrelease(table, nodes);
+    zfree_int_hash_table(table);
+    return NULL;
+  }
+
+  hash_table->table = table;
+  hash_table->node_count = 0;
+  hash_table->node_capacity = ZINT_MIN_SIZE;
+  hash_table->nodes = nodes;
+  hash_table->free_node = ZSORTED_INT_NO_NODE;
+  hash_table->first = ZSORTED_INT_NO_NODE;
+  hash_table->last = ZSORTED_INT_NO_NODE;
+  hash_table->generation = 0;
+
+  return hash_table;
+}
+
+// the integer hash table is freed last, since it holds the allocator
+void zfree_sorted_int_hash_table(struct ZSortedIntHashTable *hash_table)
+{
+  struct ZIntHashTable *table;
+
+  table = hash_table->table;
+
+  zrelease(table, hash_table->nodes);
+  zrelease(table, hash_table);
+  zfree_int_hash_table(table);
+}
+
+enum ZHashStatus zsorted_int_hash_set(struct ZSortedIntHashTable *hash_table,
+    uint64_t key, void *val)
+{
+  struct ZSortedIntNode *node;
+  void **encoded;
+  bool created;
+  size_t index;
+
+  // one probe finds the key, or the empty slot it is added at
+  if (!(encoded = zint_hash_upsert(hash_table->table, key, &created))) {
+    return ZHASH_NO_MEMORY;
+  }
+
+  if (!created) {
+    hash_table->nodes[zdecode_node(*encoded)].val = val;
+    return ZHASH_OK;
+  }
+
+  // a new key that cannot get a node is taken out again, so that no key is
+  // left without a node; only this rare case probes for the key twice
+  if (!zreserve_node(hash_table)) {
+    zint_hash_delete(hash_table->table, key);
+    return ZHASH_NO_MEMORY;
+  }
+
+  index = zalloc_node(hash_table);
+  node = &hash_table->nodes[index];
+
+  node->key = key;
+  node->val = val;
+  node->next = ZSORTED_INT_NO_NODE;
+  node->prev = hash_table->last;
+
+  if (hash_table->last != ZSORTED_INT_NO_NODE) {
+    hash_table->nodes[hash_table->last].next = index;
+  } else {
+    hash_table->first = index;
+  }
+  hash_table->last = index;
+
+  *encoded = zencode_node(index);
+
+  return ZHASH_OK;
+}
+
+void *zsorted_int_hash_get(struct ZSortedIntHashTable *hash_table,
+    uint64_t key)
+{
+  size_t index;
+
+  index = zsorted_int_find(hash_table, key);
+
+  return index != ZSORTED_INT_NO_NODE ? hash_table->nodes[index].val : NULL;
+}
+
+void *zsorted_int_hash_delete(struct ZSortedIntHashTable *hash_table,
+    uint64_t key)
+{
+  struct ZSortedIntNode *node;
+  void *encoded, *val;
+  size_t index;
+
+  if (!(encoded = zint_hash_delete(hash_table->table, key))) return NULL;
+
+  index = zdecode_node(encoded);
+  node = &hash_table->nodes[index];
+
+  if (node->prev != ZSORTED_INT_NO_NODE) {
+    hash_table->nodes[node->prev].next = node->next;
+  } else {
+    hash_table->first = node->next;
+  }
+
+  if (node->next != ZSORTED_INT_NO_NODE) {
+    hash_table->nodes[node->next].prev = node->prev;
+  } else {
+    hash_table->last = node->prev;
+  }
+
+  val = node->val;
+  node->next = hash_table->free_node;
+  hash_table->free_node = index;
+
+  if (hash_table->node_capacity > ZINT_MIN_SIZE &&
+      zint_hash_count(hash_table->table) < hash_table->node_capacity / 4) {
+    zcompact_nodes(hash_table);
+  }
+
+  return val;
+}
+
+bool zsorted_int_hash_exists(struct ZSortedIntHashTable *hash_table,
+    uint64_t key)
+{
+  return zint_hash_exists(hash_table->table, key);
+}
+
+size_t zsorted_int_hash_count(struct ZSortedIntHashTable *hash_table)
+{
+  return zint_hash_count(hash_table->table);
+}
+
+struct ZSortedIntIterator *zcreate_sorted_int_iterator(
+    struct ZSortedIntHashTable *hash_table)
+{
+  struct ZSortedIntIterator *iterator;
+
+  // iterators are owned by the caller, not the table, so they always come
+  // from malloc
+  if (!(iterator = malloc(sizeof(struct ZSortedIntIterator)))) return NULL;
+
+  iterator->hash_table = hash_table;
+  iterator->node = hash_table->first;
+
+  if (iterator->node != ZSORTED_INT_NO_NODE) {
+    zmove_iterator(iterator, iterator->node);
+    iterator->status = ZWITHIN_BOUNDS;
+  } else {
+    iterator->status = ZNO_ENTRIES;
+  }
+
+  return iterator;
+}
+
+void zfree_sorted_int_iterator(struct ZSortedIntIterator *iterator)
+{
+  free(iterator);
+}
+
+bool zsorted_int_iterator_exists(struct ZSortedIntIterator *iterator)
+{
+  return iterator->status == ZWITHIN_BOUNDS;
+}
+
+uint64_t zsorted_int_iterator_get_key(struct ZSortedIntIterator *iterator)
+{
+  if (iterator->status != ZWITHIN_BOUNDS) return 0;
+
+  zsync_iterator(iterator);
+
+  return iterator->hash_table->nodes[iterator->node].key;
+}
+
+void *zsorted_int_iterator_get_val(struct ZSortedIntIterator *iterator)
+{
+  if (iterator->status != ZWITHIN_BOUNDS) return NULL;
+
+  zsync_iterator(iterator);
+
+  return iterator->hash_table->nodes[iterator->node].val;
+}
+
+void zsorted_int_iterator_next(struct ZSortedIntIterator *iterator)
+{
+  size_t next;
+
+  if (iterator->status == ZBEFORE_FIRST) {
+    iterator->status = ZWITHIN_BOUNDS;
+
+    return;
+  }
+
+  if (iterator->status == ZWITHIN_BOUNDS) {
+    zsync_iterator(iterator);
+    next = iterator->hash_table->nodes[iterator->node].next;
+
+    if (next != ZSORTED_INT_NO_NODE) {
+      zmove_iterator(iterator, next);
+    } else {
+      iterator->status = ZAFTER_LAST;
+    }
+  }
+}
+
+void zsorted_int_iterator_prev(struct ZSortedIntIterator *iterator)
+{
+  size_t prev;
+
+  if (iterator->status == ZAFTER_LAST) {
+    iterator->status = ZWITHIN_BOUNDS;
+
+    return;
+  }
+
+  if (iterator->status == ZWITHIN_BOUNDS) {
+    zsync_iterator(iterator);
+    prev = iterator->hash_table->nodes[iterator->node].prev;
+
+    if (prev != ZSORTED_INT_NO_NODE) {
+      zmove_iterator(iterator, prev);
+    } else {
+      iterator->status = ZBEFORE_FIRST;
+    }
+  }
+}
+
+// helper functions, definitions
+// return the index of the node for key, or ZSORTED_INT_NO_NODE
+static size_t zsorted_int_find(struct ZSortedIntHashTable *hash_table,
+    uint64_t key)
+{
+  void *encoded;
+
+  encoded = zint_hash_get(hash_table->table, key);
+
+  return encoded ? zdecode_node(encoded) : ZSORTED_INT_NO_NODE;
+}
+
+// double the array when every node is in use; return false and leave the
+// array as it is if the larger one cannot be allocated
+static bool zreserve_node(struct ZSortedIntHashTable *hash_table)
+{
+  struct ZSortedIntNode *nodes;
+
+  if (hash_table->free_node != ZSORTED_INT_NO_NODE ||
+      hash_table->node_count < hash_table->node_capacity) {
+    return true;
+  }
+
+  nodes = zmalloc(hash_table->table, 2 * hash_table->node_capacity *
+      sizeof(struct ZSortedIntNode));
+
+  if (!nodes) return false;
+
+  memcpy(nodes, hash_table->nodes, hash_table->node_count *
+      sizeof(struct ZSortedIntNode));
+  zrelease(hash_table->table, hash_table->nodes);
+
+  hash_table->nodes = nodes;
+  hash_table->node_capacity *= 2;
+
+  return true;
+}
+
+// take a node from the free list, or the next unused node of the array
+// (zreserve_node must have been called first)
+static size_t zalloc_node(struct ZSortedIntHashTable *hash_table)
+{
+  size_t index;
+
+  if ((index = hash_table->free_node) != ZSORTED_INT_NO_NODE) {
+    hash_table->free_node = hash_table->nodes[index].next;
+    return index;
+  }
+
+  return hash_table->node_count++;
+}
+
+// move the entries, in insertion order, to the front of an array half the
+// size; the free list is left empty
+// if the smaller array cannot be allocated the nodes stay where they are
+static void zcompact_nodes(struct ZSortedIntHashTable *hash_table)
+{
+  struct ZSortedIntNode *nodes;
+  size_t capacity, count, index;
+  bool created;
+
+  capacity = hash_table->node_capacity / 2;
+  nodes = zmalloc(hash_table->table, capacity * sizeof(struct ZSortedIntNode));
+  count = 0;
+
+  if (!nodes) return;
+
+  // every key is already in the table, so the upserts below never allocate
+
+  for (index = hash_table->first; index != ZSORTED_INT_NO_NODE;
+      index = hash_table->nodes[index].next) {
+    nodes[count] = hash_table->nodes[index];
+    nodes[count].prev = count > 0 ? count - 1 : ZSORTED_INT_NO_NODE;
+    nodes[count].next = count + 1;
+    *zint_hash_upsert(hash_table->table, nodes[count].key, &created) =
+        zencode_node(count);
+    count++;
+  }
+
+  if (count > 0) nodes[count - 1].next = ZSORTED_INT_NO_NODE;
+
+  zrelease(hash_table->table, hash_table->nodes);
+
+  hash_table->nodes = nodes;
+  hash_table->node_count = count;
+  hash_table->node_capacity = capacity;
+  hash_table->free_node = ZSORTED_INT_NO_NODE;
+  hash_table->first = count > 0 ? 0 : ZSORTED_INT_NO_NODE;
+  hash_table->last = count > 0 ? count - 1 : ZSORTED_INT_NO_NODE;
+  hash_table->generation++;
+}
+
+// find the iterator's node again by its key if the nodes have moved
+static void zsync_iterator(struct ZSortedIntIterator *iterator)
+{
+  if (iterator->generation == iterator->hash_table->generation) return;
+
+  iterator->node = zsorted_int_find(iterator->hash_table, iterator->key);
+  iterator->generation = iterator->hash_table->generation;
+}
+
+// make node the iterator's current node
+static void zmove_iterator(struct ZSortedIntIterator *iterator, size_t node)
+{
+  iterator->node = node;
+  iterator->key = iterator->hash_table->nodes[node].key;
+  iterator->generation = iterator->hash_table->generation;
+}
+
+static void *zmalloc(struct ZIntHashTable *table, size_t size)
+{
+  return table->allocator.alloc(size, table->allocator.ctx);
+}
+
+static void zrelease(struct ZIntHashTable *table, void *ptr)
+{
+  if (table->allocator.free) table->allocator.free(ptr, table->allocator.ctx);
+}
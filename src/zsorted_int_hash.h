@@ -0,0 +1,98 @@
+#ifndef ZSORTED_INT_HASH_H
+#define ZSORTED_INT_HASH_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "./zint_hash.h"
+#include "./zsorted_hash.h"
+
+// sorted integer hash table, built on top of zint_hash
+// keys are uint64_t
+// values are void *pointers
+// keys are sorted according to insertion order, like zsorted_hash
+// entries are nodes of one array, linked by index, and the integer hash table
+// maps each key to its node; a node freed by a deletion goes on a free list and
+// is reused by a later insertion, so the array only grows when every node is in
+// use; when fewer than a quarter of the nodes are in use, a deletion moves the
+// entries to the front of an array half the size
+
+// value of next and prev for the first and last nodes
+#define ZSORTED_INT_NO_NODE SIZE_MAX
+
+// struct representing an entry in the sorted integer hash table
+// next and prev are indexes of the neighbouring nodes in insertion order;
+// free nodes are linked through next
+struct ZSortedIntNode {
+  uint64_t key;
+  void *val;
+  size_t next;
+  size_t prev;
+};
+
+// struct representing the sorted integer hash table
+// table maps each key to the index of its node plus 1
+// node_count is the number of nodes that have been used, including free ones
+// free_node is the first node of the free list
+// generation counts the times the nodes have been moved
+// the nodes and the table itself come from the allocator of table
+struct ZSortedIntHashTable {
+  struct ZIntHashTable *table;
+  struct ZSortedIntNode *nodes;
+  size_t node_count;
+  size_t node_capacity;
+  size_t free_node;
+  size_t first;
+  size_t last;
+  size_t generation;
+};
+
+// struct used for iteration through values, in insertion order
+// node is the index of the current node and key its key; when the nodes have
+// moved since generation, the node is found again by its key, so an iterator
+// stays valid until its current entry is deleted
+struct ZSortedIntIterator {
+  enum ZIteratorStatus status;
+  struct ZSortedIntHashTable *hash_table;
+  size_t node;
+  uint64_t key;
+  size_t generation;
+};
+
+// sorted integer hash table creation and destruction
+// creation returns NULL if there is not enough memory
+struct ZSortedIntHashTable *zcreate_sorted_int_hash_table(void);
+// create a table whose memory (nodes, the integer hash table and the table
+// itself) comes from allocator; see struct ZAllocator in zhash.h
+struct ZSortedIntHashTable *zcreate_sorted_int_hash_table_with_allocator(
+    const struct ZAllocator *allocator);
+void zfree_sorted_int_hash_table(struct ZSortedIntHashTable *hash_table);
+
+// sorted integer hash table operations
+// set returns ZHASH_NO_MEMORY and leaves the entries unchanged if a new key
+// cannot be added
+enum ZHashStatus zsorted_int_hash_set(struct ZSortedIntHashTable *hash_table,
+    uint64_t key, void *val);
+void *zsorted_int_hash_get(struct ZSortedIntHashTable *hash_table,
+    uint64_t key);
+void *zsorted_int_hash_delete(struct ZSortedIntHashTable *hash_table,
+    uint64_t key);
+bool zsorted_int_hash_exists(struct ZSortedIntHashTable *hash_table,
+    uint64_t key);
+size_t zsorted_int_hash_count(struct ZSortedIntHashTable *hash_table);
+
+// iterator creation and destruction
+// iterators are allocated with malloc; creation returns NULL if it fails
+struct ZSortedIntIterator *zcreate_sorted_int_iterator(
+    struct ZSortedIntHashTable *hash_table);
+void zfree_sorted_int_iterator(struct ZSortedIntIterator *iterator);
+
+// iteration functions; these behave the same as their counterparts in
+// zsorted_hash.h, and get_key returns 0 when there is no current entry
+bool zsorted_int_iterator_exists(struct ZSortedIntIterator *iterator);
+uint64_t zsorted_int_iterator_get_key(struct ZSortedIntIterator *iterator);
+void *zsorted_int_iterator_get_val(struct ZSortedIntIterator *iterator);
+void zsorted_int_iterator_next(struct ZSortedIntIterator *iterator);
+void zsorted_int_iterator_prev(struct ZSortedIntIterator *iterator);
+
+#endif
@@ -0,0 +1,322 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <stdbool.h>
+#include "../src/zcompact_hash.h"
+#include "./ztest_allocator.h"
+
+// generate strings of random  ASCII characters 64 to 126
+// between 5 and 20 characters
+static char *random_string()
+{
+  size_t length, ii;
+  char *str;
+
+  length = rand() % 15 + 5;
+  str = malloc((length + 1) * sizeof(char));
+
+  for (ii = 0; ii < length; ii++) {
+    str[ii] = rand() % 62 + 64;
+  }
+  str[length] = '\0';
+
+  return str;
+}
+
+static void zcompact_hash_set_test()
+{
+  size_t size, ii;
+  char **keys, **vals;
+  struct ZCompactHashTable *hash_table;
+
+  size = 100;
+  hash_table = zcreate_compact_hash_table();
+  keys = malloc(size * sizeof(char *));
+  vals = malloc(size * sizeof(char *));
+
+  for (ii = 0; ii < size; ii++) {
+    keys[ii] = random_string();
+    vals[ii] = random_string();
+    zcompact_hash_set(hash_table, keys[ii], (void *) vals[ii]);
+  }
+
+  assert(zcompact_hash_count(hash_table) == size);
+
+  for (ii = 0; ii < size; ii++) {
+    assert(strcmp((char *) zcompact_hash_get(hash_table, keys[ii]), vals[ii]) == 0);
+  }
+
+  for (ii = 0; ii < size; ii++) {
+    free(keys[ii]);
+    free(vals[ii]);
+  }
+
+  free(keys);
+  free(vals);
+  zfree_compact_hash_table(hash_table);
+}
+
+static void zcompact_hash_delete_test()
+{
+  size_t size, ii;
+  char **keys, **vals;
+  struct ZCompactHashTable *hash_table;
+
+  size = 100;
+  hash_table = zcreate_compact_hash_table();
+  keys = malloc(size * sizeof(char *));
+  vals = malloc(size * sizeof(char *));
+
+  for (ii = 0; ii < size; ii++) {
+    keys[ii] = random_string();
+    vals[ii] = random_string();
+    zcompact_hash_set(hash_table, keys[ii], (void *) vals[ii]);
+  }
+
+  assert(zcompact_hash_count(hash_table) == size);
+
+  for (ii = 0; ii < 7 * size / 8; ii++) {
+    zcompact_hash_delete(hash_table, keys[ii]);
+  }
+
+  for (ii = 0; ii < size; ii++) {
+    if (ii < 7 * size / 8) {
+      assert(zcompact_hash_get(hash_table, keys[ii]) == NULL);
+    } else {
+      assert(strcmp((char *) zcompact_hash_get(hash_table, keys[ii]), vals[ii]) == 0);
+    }
+  }
+
+  assert(zcompact_hash_count(hash_table) == size - 7 * size / 8);
+
+  for (ii = 0; ii < size; ii++) {
+    free(keys[ii]);
+    free(vals[ii]);
+  }
+
+  free(keys);
+  free(vals);
+  zfree_compact_hash_table(hash_table);
+}
+
+static void zcompact_hash_exists_test()
+{
+  struct ZCompactHashTable *hash_table;
+
+  hash_table = zcreate_compact_hash_table();
+
+  zcompact_hash_set(hash_table, "hello", (void *) "world");
+  zcompact_hash_set(hash_table, "nothing", NULL);
+
+  assert(zcompact_hash_exists(hash_table, "hello") == true);
+  assert(zcompact_hash_exists(hash_table, "nothing") == true);
+  assert(zcompact_hash_get(hash_table, "nothing") == NULL);
+  assert(zcompact_hash_exists(hash_table, "nope") == false);
+
+  zfree_compact_hash_table(hash_table);
+}
+
+static void zcompact_iterator_test()
+{
+  size_t size, ii;
+  char **keys, **vals;
+  struct ZCompactHashTable *hash_table;
+  struct ZCompactIterator *iterator;
+
+  size = 100;
+  hash_table = zcreate_compact_hash_table();
+  keys = malloc(size * sizeof(char *));
+  vals = malloc(size * sizeof(char *));
+
+  for (ii = 0; ii < size; ii++) {
+    keys[ii] = random_string();
+    vals[ii] = random_string();
+    zcompact_hash_set(hash_table, keys[ii], (void *) vals[ii]);
+  }
+
+  zcompact_hash_delete(hash_table, keys[0]);
+  zcompact_hash_delete(hash_table, keys[20]);
+  zcompact_hash_delete(hash_table, keys[size - 1]);
+  zcompact_hash_set(hash_table, keys[90], (void *) vals[90]);
+
+  iterator = zcreate_compact_iterator(hash_table);
+
+  for (ii = 1; ii < size - 1; ii++) {
+    if (ii != 20) {
+      assert(zcompact_iterator_exists(iterator) == true);
+      assert(strcmp(zcompact_iterator_get_key(iterator), keys[ii]) == 0);
+      assert(strcmp((char *) zcompact_iterator_get_val(iterator), vals[ii]) == 0);
+
+      zcompact_iterator_next(iterator);
+    }
+  }
+
+  assert(zcompact_iterator_exists(iterator) == false);
+  assert(zcompact_iterator_get_key(iterator) == NULL);
+  assert(zcompact_iterator_get_val(iterator) == NULL);
+
+  zcompact_iterator_next(iterator);
+  zcompact_iterator_prev(iterator);
+
+  for (ii = size - 2; ii > 0; ii--) {
+    if (ii != 20) {
+      assert(zcompact_iterator_exists(iterator) == true);
+      assert(strcmp(zcompact_iterator_get_key(iterator), keys[ii]) == 0);
+      assert(strcmp((char *) zcompact_iterator_get_val(iterator), vals[ii]) == 0);
+
+      zcompact_iterator_prev(iterator);
+    }
+  }
+
+  assert(zcompact_iterator_exists(iterator) == false);
+  assert(zcompact_iterator_get_key(iterator) == NULL);
+  assert(zcompact_iterator_get_val(iterator) == NULL);
+
+  for (ii = 0; ii < size; ii++) {
+    free(keys[ii]);
+    free(vals[ii]);
+  }
+
+  free(keys);
+  free(vals);
+  zfree_compact_iterator(iterator);
+  zfree_compact_hash_table(hash_table);
+}
+
+static void zcompact_hash_resize_test()
+{
+  size_t size, ii;
+  char **keys;
+  struct ZCompactHashTable *hash_table;
+  struct ZCompactIterator *iterator;
+
+  size = 10000;
+  hash_table = zcreate_compact_hash_table();
+  keys = malloc(size * sizeof(char *));
+
+  for (ii = 0; ii < size; ii++) {
+    keys[ii] = malloc(16);
+    snprintf(keys[ii], 16, "key%zu", ii);
+    zcompact_hash_set(hash_table, keys[ii], (void *) keys[ii]);
+  }
+
+  // delete and re-add keys so that the entries array fills with deleted
+  // entries and is compacted, while the table stays in insertion order
+  for (ii = 0; ii < size; ii += 2) {
+    assert(zcompact_hash_delete(hash_table, keys[ii]) == keys[ii]);
+    zcompact_hash_set(hash_table, keys[ii], (void *) keys[ii]);
+  }
+
+  assert(zcompact_hash_count(hash_table) == size);
+  assert(hash_table->entries_used < 2 * size);
+  assert(hash_table->keys_used <= hash_table->keys_capacity);
+  assert(hash_table->keys_used < 2 * hash_table->key_bytes);
+
+  iterator = zcreate_compact_iterator(hash_table);
+
+  for (ii = 1; ii < size; ii += 2) {
+    assert(zcompact_iterator_get_val(iterator) == keys[ii]);
+    zcompact_iterator_next(iterator);
+  }
+
+  for (ii = 0; ii < size; ii += 2) {
+    assert(zcompact_iterator_get_val(iterator) == keys[ii]);
+    zcompact_iterator_next(iterator);
+  }
+
+  assert(zcompact_iterator_exists(iterator) == false);
+
+  for (ii = 0; ii < size; ii++) {
+    assert(zcompact_hash_delete(hash_table, keys[ii]) == keys[ii]);
+  }
+
+  assert(zcompact_hash_count(hash_table) == 0);
+  assert(hash_table->size_index == 0);
+  assert(hash_table->key_bytes == 0);
+
+  for (ii = 0; ii < size; ii++) free(keys[ii]);
+
+  free(keys);
+  zfree_compact_iterator(iterator);
+  zfree_compact_hash_table(hash_table);
+}
+
+static void zcompact_hash_allocator_test()
+{
+  size_t count, ii;
+  char key[16], *long_key;
+  struct TestAllocator state;
+  struct ZAllocator allocator;
+  struct ZCompactHashTable *hash_table;
+  struct ZCompactIterator *iterator;
+
+  // the table, its index, its entries and its key array are four allocations
+  test_allocator_init(&allocator, &state, 3);
+  assert(zcreate_compact_hash_table_with_allocator(&allocator) == NULL);
+  assert(state.live == 0);
+
+  state.remaining = 4;
+  hash_table = zcreate_compact_hash_table_with_allocator(&allocator);
+  assert(hash_table != NULL);
+
+  // keys are copied into the key array, so filling the entries array does not
+  // allocate
+  for (count = 0; hash_table->entries_used < 4; count++) {
+    snprintf(key, sizeof(key), "key%zu", count);
+    assert(zcompact_hash_set(hash_table, key, NULL) == ZHASH_OK);
+  }
+
+  // the table cannot grow, and a failed insertion leaves it unchanged
+  snprintf(key, sizeof(key), "key%zu", count);
+  assert(zcompact_hash_set(hash_table, key, NULL) == ZHASH_NO_MEMORY);
+  assert(zcompact_hash_count(hash_table) == count);
+  assert(zcompact_hash_exists(hash_table, key) == false);
+
+  state.remaining = SIZE_MAX;
+  for (ii = count; ii < 100; ii++) {
+    snprintf(key, sizeof(key), "key%zu", ii);
+    assert(zcompact_hash_set(hash_table, key, NULL) == ZHASH_OK);
+  }
+
+  // a key that does not fit in the key array cannot be added either
+  state.remaining = 0;
+  long_key = malloc(hash_table->keys_capacity + 1);
+  memset(long_key, 'x', hash_table->keys_capacity);
+  long_key[hash_table->keys_capacity] = '\0';
+
+  assert(zcompact_hash_set(hash_table, long_key, NULL) == ZHASH_NO_MEMORY);
+  assert(zcompact_hash_count(hash_table) == 100);
+  assert(zcompact_hash_exists(hash_table, long_key) == false);
+
+  // keys stay in insertion order
+  iterator = zcreate_compact_iterator(hash_table);
+  for (ii = 0; ii < 100; ii++) {
+    snprintf(key, sizeof(key), "key%zu", ii);
+    assert(strcmp(zcompact_iterator_get_key(iterator), key) == 0);
+    zcompact_iterator_next(iterator);
+  }
+  assert(zcompact_iterator_exists(iterator) == false);
+  zfree_compact_iterator(iterator);
+
+  state.remaining = SIZE_MAX;
+  assert(zcompact_hash_set(hash_table, long_key, long_key) == ZHASH_OK);
+  assert(zcompact_hash_get(hash_table, long_key) == long_key);
+
+  zfree_compact_hash_table(hash_table);
+  assert(state.live == 0);
+
+  free(long_key);
+}
+
+int main()
+{
+  zcompact_hash_set_test();
+  zcompact_hash_delete_test();
+  zcompact_hash_exists_test();
+  zcompact_iterator_test();
+  zcompact_hash_resize_test();
+  zcompact_hash_allocator_test();
+
+  return 0;
+}
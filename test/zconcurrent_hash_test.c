@@ -0,0 +1,192 @@
+// strdup with -std=c11
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include "../src/zconcurrent_hash.h"
+
+#define READER_COUNT 4
+#define KEY_COUNT 2000
+
+struct ReaderArgs {
+  struct ZConcurrentHashTable *hash_table;
+  char **keys;
+  atomic_bool *done;
+};
+
+// generate strings of random  ASCII characters 64 to 126
+// between 5 and 20 characters
+static char *random_string()
+{
+  size_t length, ii;
+  char *str;
+
+  length = rand() % 15 + 5;
+  str = malloc((length + 1) * sizeof(char));
+
+  for (ii = 0; ii < length; ii++) {
+    str[ii] = rand() % 62 + 64;
+  }
+  str[length] = '\0';
+
+  return str;
+}
+
+static size_t retired_count(struct ZConcurrentHashTable *hash_table)
+{
+  struct ZRetiredPointer *retired;
+  size_t count;
+
+  count = 0;
+  for (retired = hash_table->retired; retired; retired = retired->next) {
+    count++;
+  }
+
+  return count;
+}
+
+static void zconcurrent_hash_set_test()
+{
+  size_t size, ii;
+  char **keys, **vals;
+  struct ZConcurrentHashTable *hash_table;
+  struct ZConcurrentReader *reader;
+
+  size = 100;
+  hash_table = zcreate_concurrent_hash_table();
+  reader = zconcurrent_hash_register_reader(hash_table);
+  keys = malloc(size * sizeof(char *));
+  vals = malloc(size * sizeof(char *));
+
+  for (ii = 0; ii < size; ii++) {
+    keys[ii] = random_string();
+    vals[ii] = random_string();
+    assert(zconcurrent_hash_set(hash_table, keys[ii], (void *) vals[ii]) ==
+        ZHASH_OK);
+  }
+
+  assert(hash_table->entry_count == size);
+
+  // the table grew from 64 to 256 buckets while the reader could still see
+  // the old arrays; each array is retired with its chains in one record
+  assert(retired_count(hash_table) == 2);
+
+  for (ii = 0; ii < size; ii++) {
+    assert(strcmp((char *) zconcurrent_hash_get(hash_table, keys[ii]), vals[ii]) == 0);
+  }
+
+  zconcurrent_hash_set(hash_table, keys[10], (void *) vals[20]);
+  assert(strcmp((char *) zconcurrent_hash_get(hash_table, keys[10]), vals[20]) == 0);
+
+  for (ii = 0; ii < 7 * size / 8; ii++) {
+    assert(zconcurrent_hash_delete(hash_table, keys[ii]) != NULL);
+  }
+
+  for (ii = 0; ii < size; ii++) {
+    assert(zconcurrent_hash_exists(hash_table, keys[ii]) == (ii >= 7 * size / 8));
+  }
+
+  // after a quiescent state, everything retired so far can be freed
+  zconcurrent_hash_quiescent(hash_table, reader);
+  zconcurrent_hash_unregister_reader(hash_table, reader);
+  assert(hash_table->retired == NULL);
+
+  for (ii = 0; ii < size; ii++) {
+    free(keys[ii]);
+    free(vals[ii]);
+  }
+
+  free(keys);
+  free(vals);
+  zfree_concurrent_hash_table(hash_table);
+}
+
+// readers look up every key over and over while the writer changes the table
+static void *reader_thread(void *arg)
+{
+  struct ReaderArgs *args;
+  struct ZConcurrentReader *reader;
+  size_t ii;
+
+  args = (struct ReaderArgs *) arg;
+  reader = zconcurrent_hash_register_reader(args->hash_table);
+
+  while (!atomic_load(args->done)) {
+    for (ii = 0; ii < KEY_COUNT; ii++) {
+      void *val;
+
+      // a key is either missing or maps to itself
+      val = zconcurrent_hash_get(args->hash_table, args->keys[ii]);
+      assert(val == NULL || val == args->keys[ii]);
+    }
+    zconcurrent_hash_quiescent(args->hash_table, reader);
+  }
+
+  zconcurrent_hash_unregister_reader(args->hash_table, reader);
+
+  return NULL;
+}
+
+static void zconcurrent_hash_readers_test()
+{
+  size_t ii, round;
+  char *keys[KEY_COUNT];
+  char key[32];
+  atomic_bool done;
+  pthread_t threads[READER_COUNT];
+  struct ReaderArgs args;
+  struct ZConcurrentHashTable *hash_table;
+
+  hash_table = zcreate_concurrent_hash_table();
+  atomic_init(&done, false);
+
+  for (ii = 0; ii < KEY_COUNT; ii++) {
+    snprintf(key, sizeof(key), "key:%zu", ii);
+    keys[ii] = strdup(key);
+  }
+
+  args.hash_table = hash_table;
+  args.keys = keys;
+  args.done = &done;
+
+  for (ii = 0; ii < READER_COUNT; ii++) {
+    assert(pthread_create(&threads[ii], NULL, reader_thread, &args) == 0);
+  }
+
+  // grow and shrink the table several times under the readers
+  for (round = 0; round < 5; round++) {
+    for (ii = 0; ii < KEY_COUNT; ii++) {
+      assert(zconcurrent_hash_set(hash_table, keys[ii], (void *) keys[ii]) ==
+          ZHASH_OK);
+    }
+    for (ii = 0; ii < KEY_COUNT; ii++) {
+      assert(zconcurrent_hash_delete(hash_table, keys[ii]) == keys[ii]);
+    }
+  }
+
+  atomic_store(&done, true);
+
+  for (ii = 0; ii < READER_COUNT; ii++) {
+    assert(pthread_join(threads[ii], NULL) == 0);
+  }
+
+  assert(hash_table->entry_count == 0);
+
+  for (ii = 0; ii < KEY_COUNT; ii++) free(keys[ii]);
+
+  zfree_concurrent_hash_table(hash_table);
+}
+
+int main()
+{
+  zconcurrent_hash_set_test();
+  zconcurrent_hash_readers_test();
+
+  return 0;
+}
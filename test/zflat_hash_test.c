@@ -0,0 +1,430 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <stdbool.h>
+#include "../src/zhash.h"
+#include "../src/zflat_hash.h"
+#include "../src/zflat_hash_internal.h"
+
+// generate strings of random  ASCII characters 64 to 126
+// between 5 and 20 characters
+static char *random_string()
+{
+  size_t length, ii;
+  char *str;
+
+  length = rand() % 15 + 5;
+  str = malloc((length + 1) * sizeof(char));
+
+  for (ii = 0; ii < length; ii++) {
+    str[ii] = rand() % 62 + 64;
+  }
+  str[length] = '\0';
+
+  return str;
+}
+
+static size_t slot_count(struct ZFlatHashTable *hash_table)
+{
+  return (size_t) ZFLAT_GROUP_SIZE << hash_table->size_index;
+}
+
+// first group of the probe sequence of key in a table with 2^size_index groups
+static size_t first_group(const char *key, size_t size_index)
+{
+  return ZFLAT_FIRST_GROUP(zhash_hash((char *) key), size_index);
+}
+
+// generate a key that is not in the table and whose probe sequence starts at
+// group
+static char *key_for_group(struct ZFlatHashTable *hash_table, size_t group,
+    size_t size_index)
+{
+  char *key;
+
+  for (;;) {
+    key = random_string();
+    if (first_group(key, size_index) == group &&
+        !zflat_hash_exists(hash_table, key)) {
+      return key;
+    }
+    free(key);
+  }
+}
+
+// return the slot index holding key, or SIZE_MAX
+static size_t slot_of(struct ZFlatHashTable *hash_table, const char *key)
+{
+  size_t ii;
+
+  for (ii = 0; ii < slot_count(hash_table); ii++) {
+    if (hash_table->ctrl[ii] >= 0 &&
+        strcmp(hash_table->slots[ii].key, key) == 0) {
+      return ii;
+    }
+  }
+
+  return SIZE_MAX;
+}
+
+// check the counts, the control bytes and the load limit of the table, and
+// that every key can be found by its probe sequence
+static void check_table(struct ZFlatHashTable *hash_table)
+{
+  size_t size, full, deleted, ii;
+
+  size = slot_count(hash_table);
+  full = deleted = 0;
+
+  for (ii = 0; ii < size; ii++) {
+    signed char ctrl;
+
+    ctrl = hash_table->ctrl[ii];
+
+    if (ctrl == ZFLAT_DELETED) {
+      deleted++;
+    } else if (ctrl != ZFLAT_EMPTY) {
+      assert(ctrl >= 0);
+      full++;
+
+      assert(hash_table->slots[ii].hash ==
+          zhash_hash(hash_table->slots[ii].key));
+      assert(ctrl == ZFLAT_TAG(hash_table->slots[ii].hash));
+      assert(zflat_hash_get(hash_table, hash_table->slots[ii].key) ==
+          hash_table->slots[ii].val);
+    }
+  }
+
+  assert(full == hash_table->entry_count);
+  assert(deleted == hash_table->deleted_count);
+  assert(full + deleted <= size / 8 * 7);
+}
+
+// the tests below mirror the ones in zhash_test.c
+static void zflat_hash_set_test()
+{
+  size_t size, ii;
+  char **keys, **vals;
+  struct ZFlatHashTable *hash_table;
+
+  size = 100;
+  hash_table = zcreate_flat_hash_table();
+  keys = malloc(size * sizeof(char *));
+  vals = malloc(size * sizeof(char *));
+
+  for (ii = 0; ii < size; ii++) {
+    keys[ii] = random_string();
+    vals[ii] = random_string();
+    assert(zflat_hash_set(hash_table, keys[ii], (void *) vals[ii]) == ZHASH_OK);
+  }
+
+  assert(hash_table->size_index == 3);
+  assert(hash_table->entry_count == size);
+
+  for (ii = 0; ii < size; ii++) {
+    assert(strcmp((char *) zflat_hash_get(hash_table, keys[ii]), vals[ii]) == 0);
+  }
+
+  assert(zflat_hash_set(hash_table, keys[10], (void *) vals[20]) == ZHASH_OK);
+  assert(zflat_hash_set(hash_table, keys[50], (void *) vals[70]) == ZHASH_OK);
+
+  assert(hash_table->entry_count == size);
+  assert(strcmp((char *) zflat_hash_get(hash_table, keys[10]), vals[20]) == 0);
+  assert(strcmp((char *) zflat_hash_get(hash_table, keys[50]), vals[70]) == 0);
+  check_table(hash_table);
+
+  for (ii = 0; ii < size; ii++) {
+    free(keys[ii]);
+    free(vals[ii]);
+  }
+
+  free(keys);
+  free(vals);
+  zfree_flat_hash_table(hash_table);
+}
+
+static void zflat_hash_delete_test()
+{
+  size_t size, ii;
+  char **keys, **vals;
+  struct ZFlatHashTable *hash_table;
+
+  size = 100;
+  hash_table = zcreate_flat_hash_table();
+  keys = malloc(size * sizeof(char *));
+  vals = malloc(size * sizeof(char *));
+
+  for (ii = 0; ii < size; ii++) {
+    keys[ii] = random_string();
+    vals[ii] = random_string();
+    zflat_hash_set(hash_table, keys[ii], (void *) vals[ii]);
+  }
+
+  assert(hash_table->size_index == 3);
+  assert(hash_table->entry_count == size);
+
+  for (ii = 0; ii < 7 * size / 8; ii++) {
+    zflat_hash_delete(hash_table, keys[ii]);
+  }
+
+  for (ii = 0; ii < size; ii++) {
+    if (ii < 7 * size / 8) {
+      assert(zflat_hash_get(hash_table, keys[ii]) == NULL);
+    } else {
+      assert(strcmp((char *) zflat_hash_get(hash_table, keys[ii]), vals[ii]) == 0);
+    }
+  }
+
+  assert(hash_table->size_index == 2);
+  assert(hash_table->entry_count == size - 7 * size / 8);
+  check_table(hash_table);
+
+  for (ii = 0; ii < size; ii++) {
+    free(keys[ii]);
+    free(vals[ii]);
+  }
+
+  free(keys);
+  free(vals);
+  zfree_flat_hash_table(hash_table);
+}
+
+static void zflat_hash_exists_test()
+{
+  struct ZFlatHashTable *hash_table;
+
+  hash_table = zcreate_flat_hash_table();
+
+  zflat_hash_set(hash_table, "hello", (void *) "world");
+  zflat_hash_set(hash_table, "nothing", NULL);
+
+  assert(zflat_hash_exists(hash_table, "hello") == true);
+  assert(zflat_hash_exists(hash_table, "nothing") == true);
+  assert(zflat_hash_get(hash_table, "nothing") == NULL);
+  assert(zflat_hash_exists(hash_table, "nope") == false);
+
+  zfree_flat_hash_table(hash_table);
+}
+
+// after every round, walking the slots finds exactly the keys that are left
+static void zflat_hash_churn_test()
+{
+  size_t size, ii, jj;
+  char **keys;
+  struct ZFlatHashTable *hash_table;
+
+  size = 40;
+  hash_table = zcreate_flat_hash_table();
+  keys = malloc(size * sizeof(char *));
+
+  for (ii = 0; ii < size; ii++) keys[ii] = random_string();
+
+  for (jj = 0; jj < 50; jj++) {
+    for (ii = 0; ii < size; ii++) {
+      zflat_hash_set(hash_table, keys[ii], (void *) keys[ii]);
+    }
+    for (ii = jj % 2; ii < size; ii += 2) {
+      assert(zflat_hash_delete(hash_table, keys[ii]) == keys[ii]);
+    }
+    for (ii = 0; ii < size; ii++) {
+      if (ii % 2 == jj % 2) {
+        assert(zflat_hash_exists(hash_table, keys[ii]) == false);
+        assert(slot_of(hash_table, keys[ii]) == SIZE_MAX);
+      } else {
+        assert(zflat_hash_get(hash_table, keys[ii]) == keys[ii]);
+        assert(slot_of(hash_table, keys[ii]) != SIZE_MAX);
+      }
+    }
+
+    assert(hash_table->entry_count == size / 2);
+    check_table(hash_table);
+  }
+
+  for (ii = 0; ii < size; ii++) free(keys[ii]);
+
+  free(keys);
+  zfree_flat_hash_table(hash_table);
+}
+
+// keys that start in the last group overflow into the first one when the
+// last group is full
+static void zflat_hash_wraparound_test()
+{
+  size_t size_index, size, group, ii;
+  char **keys;
+  struct ZFlatHashTable *hash_table;
+
+  // 17 keys grow the table to 2 groups (up to 28 entries)
+  size_index = 1;
+  group = ((size_t) 1 << size_index) - 1;
+  size = ZFLAT_GROUP_SIZE + 1;
+  hash_table = zcreate_flat_hash_table();
+  keys = malloc(size * sizeof(char *));
+
+  for (ii = 0; ii < size; ii++) {
+    keys[ii] = key_for_group(hash_table, group, size_index);
+    zflat_hash_set(hash_table, keys[ii], (void *) keys[ii]);
+  }
+
+  assert(hash_table->size_index == size_index);
+  check_table(hash_table);
+
+  // the last group is full and exactly one key went to group 0
+  for (ii = group * ZFLAT_GROUP_SIZE; ii < slot_count(hash_table); ii++) {
+    assert(hash_table->ctrl[ii] >= 0);
+  }
+
+  for (ii = 0; ii < size; ii++) {
+    if (slot_of(hash_table, keys[ii]) < ZFLAT_GROUP_SIZE) break;
+  }
+
+  assert(ii < size);
+  assert(zflat_hash_get(hash_table, keys[ii]) == keys[ii]);
+
+  for (ii = 0; ii < size; ii++) free(keys[ii]);
+
+  free(keys);
+  zfree_flat_hash_table(hash_table);
+}
+
+// a delete from a full group leaves a tombstone, which keeps later keys of
+// the probe sequence reachable and is reused by the next insertion
+static void zflat_hash_tombstone_test()
+{
+  size_t size_index, size, group, index, ii;
+  char **keys, *key, *new_key;
+  struct ZFlatHashTable *hash_table;
+
+  size_index = 1;
+  group = 0;
+  size = ZFLAT_GROUP_SIZE + 1;
+  hash_table = zcreate_flat_hash_table();
+  keys = malloc(size * sizeof(char *));
+
+  for (ii = 0; ii < size; ii++) {
+    keys[ii] = key_for_group(hash_table, group, size_index);
+    zflat_hash_set(hash_table, keys[ii], (void *) keys[ii]);
+  }
+
+  assert(hash_table->size_index == size_index);
+
+  // pick a key in the full group
+  for (ii = 0; ii < size; ii++) {
+    index = slot_of(hash_table, keys[ii]);
+    if (index / ZFLAT_GROUP_SIZE == group) break;
+  }
+
+  key = keys[ii];
+  assert(zflat_hash_delete(hash_table, key) == key);
+  assert(hash_table->ctrl[index] == ZFLAT_DELETED);
+  assert(hash_table->deleted_count == 1);
+  check_table(hash_table);
+
+  // the key that overflowed past the tombstone is still found
+  for (ii = 0; ii < size; ii++) {
+    if (keys[ii] != key) assert(zflat_hash_get(hash_table, keys[ii]) == keys[ii]);
+  }
+
+  assert(zflat_hash_exists(hash_table, key) == false);
+
+  // the next key of the same probe sequence takes the tombstone's slot
+  new_key = key_for_group(hash_table, group, size_index);
+
+  zflat_hash_set(hash_table, new_key, (void *) new_key);
+  assert(slot_of(hash_table, new_key) == index);
+  assert(hash_table->deleted_count == 0);
+  check_table(hash_table);
+
+  // a delete from a group with an empty slot leaves the slot empty
+  for (ii = 0; ii < size; ii++) {
+    if (keys[ii] != key && slot_of(hash_table, keys[ii]) / ZFLAT_GROUP_SIZE !=
+        group) {
+      break;
+    }
+  }
+
+  index = slot_of(hash_table, keys[ii]);
+  assert(zflat_hash_delete(hash_table, keys[ii]) == keys[ii]);
+  assert(hash_table->ctrl[index] == ZFLAT_EMPTY);
+  assert(hash_table->deleted_count == 0);
+  check_table(hash_table);
+
+  for (ii = 0; ii < size; ii++) free(keys[ii]);
+
+  free(new_key);
+  free(keys);
+  zfree_flat_hash_table(hash_table);
+}
+
+// replacing keys one at a time leaves tombstones behind; they must be
+// cleared without the table growing without bound
+static void zflat_hash_delete_heavy_test()
+{
+  size_t size, rounds, ii, max_size_index;
+  char **keys;
+  struct ZFlatHashTable *hash_table;
+
+  size = 200;
+  rounds = 20000;
+  hash_table = zcreate_flat_hash_table();
+  keys = malloc(size * sizeof(char *));
+
+  for (ii = 0; ii < size; ii++) {
+    keys[ii] = malloc(24);
+    snprintf(keys[ii], 24, "key%zu", ii);
+    zflat_hash_set(hash_table, keys[ii], (void *) keys[ii]);
+  }
+
+  // tombstones may make the table grow, but never past the size at which
+  // the live entries fill at most 7/16 of the slots; after that the table is
+  // rebuilt at the same size to clear them
+  for (max_size_index = 0; size + 1 > ((size_t) 7 << max_size_index);
+      max_size_index++);
+
+  for (ii = 0; ii < rounds; ii++) {
+    size_t jj;
+
+    jj = (size_t) rand() % size;
+
+    assert(zflat_hash_delete(hash_table, keys[jj]) == keys[jj]);
+    snprintf(keys[jj], 24, "key%zu", size + ii);
+    zflat_hash_set(hash_table, keys[jj], (void *) keys[jj]);
+
+    assert(hash_table->entry_count == size);
+    assert(hash_table->size_index <= max_size_index);
+    assert(hash_table->entry_count + hash_table->deleted_count <=
+        slot_count(hash_table) / 8 * 7);
+
+    if (ii % 1000 == 0) check_table(hash_table);
+  }
+
+  check_table(hash_table);
+
+  // deleting most keys shrinks the table
+  for (ii = 0; ii < size - 10; ii++) {
+    assert(zflat_hash_delete(hash_table, keys[ii]) == keys[ii]);
+    assert(zflat_hash_delete(hash_table, keys[ii]) == NULL);
+  }
+
+  assert(hash_table->size_index < max_size_index);
+  check_table(hash_table);
+
+  for (ii = 0; ii < size; ii++) free(keys[ii]);
+
+  free(keys);
+  zfree_flat_hash_table(hash_table);
+}
+
+int main()
+{
+  zflat_hash_set_test();
+  zflat_hash_delete_test();
+  zflat_hash_exists_test();
+  zflat_hash_churn_test();
+  zflat_hash_wraparound_test();
+  zflat_hash_tombstone_test();
+  zflat_hash_delete_heavy_test();
+
+  return 0;
+}
@@ -0,0 +1,110 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <stdbool.h>
+#include "../src/zhash.h"
+#include "../src/zfrozen_hash.h"
+
+// generate strings of random  ASCII characters 64 to 126
+// between 5 and 20 characters
+static char *random_string()
+{
+  size_t length, ii;
+  char *str;
+
+  length = rand() % 15 + 5;
+  str = malloc((length + 1) * sizeof(char));
+
+  for (ii = 0; ii < length; ii++) {
+    str[ii] = rand() % 62 + 64;
+  }
+  str[length] = '\0';
+
+  return str;
+}
+
+static void zfrozen_hash_get_test(size_t size)
+{
+  size_t ii;
+#ifdef ZFROZEN_HASH_MASK
+  size_t taken;
+#endif
+  char **keys, **vals, *missing;
+  struct ZHashTable *hash_table;
+  struct ZFrozenHashTable *frozen;
+
+  hash_table = zcreate_hash_table();
+  keys = malloc((size + 1) * sizeof(char *));
+  vals = malloc((size + 1) * sizeof(char *));
+
+  for (ii = 0; ii < size; ii++) {
+    keys[ii] = random_string();
+    vals[ii] = random_string();
+    zhash_set(hash_table, keys[ii], (void *) vals[ii]);
+  }
+
+  if (size > 0) zhash_set(hash_table, keys[0], NULL);
+
+  frozen = zhash_freeze(hash_table);
+
+  assert(zfrozen_hash_count(frozen) == hash_table->entry_count);
+
+#ifndef ZFROZEN_HASH_MASK
+  // every slot holds a key
+  for (ii = 0; ii < zfrozen_hash_count(frozen); ii++) {
+    assert(frozen->slots[ii].key_length != SIZE_MAX);
+  }
+#else
+  // most keys collide, and every key is either in a slot or in the overflow
+  // array, which is sorted by hash
+  taken = 0;
+  for (ii = 0; ii < zfrozen_hash_count(frozen); ii++) {
+    if (frozen->slots[ii].key_length != SIZE_MAX) taken++;
+  }
+
+  assert(taken + frozen->overflow_count == zfrozen_hash_count(frozen));
+  if (size > 10000) assert(frozen->overflow_count > taken);
+
+  for (ii = 1; ii < frozen->overflow_count; ii++) {
+    assert(frozen->overflow[ii - 1].hash <= frozen->overflow[ii].hash);
+  }
+#endif
+
+  for (ii = 0; ii < size; ii++) {
+    assert(zfrozen_hash_get(frozen, keys[ii]) ==
+        zhash_get(hash_table, keys[ii]));
+    assert(zfrozen_hash_exists(frozen, keys[ii]) == true);
+  }
+
+  if (size > 0) assert(zfrozen_hash_get(frozen, keys[0]) == NULL);
+
+  for (ii = 0; ii < 1000; ii++) {
+    missing = random_string();
+    assert(zfrozen_hash_exists(frozen, missing) ==
+        zhash_exists(hash_table, missing));
+    free(missing);
+  }
+
+  assert(zfrozen_hash_exists(frozen, "") == false);
+
+  for (ii = 0; ii < size; ii++) {
+    free(keys[ii]);
+    free(vals[ii]);
+  }
+
+  free(keys);
+  free(vals);
+  zfree_hash_table(hash_table);
+  zfree_frozen_hash_table(frozen);
+}
+
+int main()
+{
+  zfrozen_hash_get_test(0);
+  zfrozen_hash_get_test(1);
+  zfrozen_hash_get_test(100);
+  zfrozen_hash_get_test(100000);
+
+  return 0;
+}
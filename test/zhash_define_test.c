@@ -0,0 +1,275 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+#include <stdbool.h>
+
+// allocation functions for the generated tables; allocations fail once
+// alloc_budget reaches 0
+static size_t alloc_budget = SIZE_MAX;
+
+static void *test_malloc(size_t size)
+{
+  if (alloc_budget == 0) return NULL;
+  alloc_budget--;
+
+  return malloc(size);
+}
+
+static void *test_calloc(size_t num, size_t size)
+{
+  if (alloc_budget == 0) return NULL;
+  alloc_budget--;
+
+  return calloc(num, size);
+}
+
+#define ZDEFINE_MALLOC test_malloc
+#define ZDEFINE_CALLOC test_calloc
+#include "../src/zhash_define.h"
+
+struct Point {
+  double x;
+  double y;
+  int id;
+};
+
+static uint64_t hash_int(int key)
+{
+  return (uint64_t) key;
+}
+
+static bool eq_int(int a, int b)
+{
+  return a == b;
+}
+
+static uint64_t hash_id(uint64_t key)
+{
+  return key;
+}
+
+static bool eq_id(uint64_t a, uint64_t b)
+{
+  return a == b;
+}
+
+// FNV-1a
+static uint64_t hash_string(const char *key)
+{
+  uint64_t hash;
+
+  for (hash = 0xcbf29ce484222325ull; *key; key++) {
+    hash = (hash ^ (unsigned char) *key) * 0x100000001b3ull;
+  }
+
+  return hash;
+}
+
+static bool eq_string(const char *a, const char *b)
+{
+  return strcmp(a, b) == 0;
+}
+
+ZHASH_DEFINE(point, int, struct Point, hash_int, eq_int)
+ZHASH_DEFINE(word, const char *, size_t, hash_string, eq_string)
+ZHASH_DEFINE(id, uint64_t, uint64_t, hash_id, eq_id)
+
+// generate strings of random  ASCII characters 64 to 126
+// between 5 and 20 characters
+static char *random_string()
+{
+  size_t length, ii;
+  char *str;
+
+  length = rand() % 15 + 5;
+  str = malloc((length + 1) * sizeof(char));
+
+  for (ii = 0; ii < length; ii++) {
+    str[ii] = rand() % 62 + 64;
+  }
+  str[length] = '\0';
+
+  return str;
+}
+
+static void sum_ids(int *key, struct Point *val, void *ctx)
+{
+  assert(*key == val->id);
+  *(long *) ctx += val->id;
+}
+
+static void zhash_define_set_test()
+{
+  int size, ii;
+  struct Point point, *found;
+  struct point_hash_table *hash_table;
+
+  size = 1000;
+  hash_table = zcreate_point_hash_table();
+
+  for (ii = 0; ii < size; ii++) {
+    point.x = ii;
+    point.y = -ii;
+    point.id = ii;
+    assert(zpoint_hash_set(hash_table, ii, point) == ZHASH_OK);
+  }
+
+  assert(zpoint_hash_count(hash_table) == (size_t) size);
+
+  for (ii = 0; ii < size; ii++) {
+    found = zpoint_hash_get(hash_table, ii);
+    assert(found != NULL);
+    assert(found->x == ii && found->y == -ii && found->id == ii);
+  }
+
+  assert(zpoint_hash_get(hash_table, size) == NULL);
+  assert(zpoint_hash_get(hash_table, -1) == NULL);
+
+  // values can be updated in place through get, or replaced by set
+  zpoint_hash_get(hash_table, 0)->x = 42;
+  assert(zpoint_hash_get(hash_table, 0)->x == 42);
+
+  point.x = 7;
+  zpoint_hash_set(hash_table, 0, point);
+  assert(zpoint_hash_get(hash_table, 0)->x == 7);
+  assert(zpoint_hash_count(hash_table) == (size_t) size);
+
+  zfree_point_hash_table(hash_table);
+}
+
+static void zhash_define_delete_test()
+{
+  size_t size, ii, val;
+  char **keys;
+  struct word_hash_table *hash_table;
+
+  size = 1000;
+  hash_table = zcreate_word_hash_table();
+  keys = malloc(size * sizeof(char *));
+
+  for (ii = 0; ii < size; ii++) {
+    keys[ii] = random_string();
+    zword_hash_set(hash_table, keys[ii], ii);
+  }
+
+  for (ii = 0; ii < size / 2; ii++) {
+    val = SIZE_MAX;
+    // random strings may repeat, in which case the later index is stored
+    if (zword_hash_exists(hash_table, keys[ii])) {
+      assert(zword_hash_delete(hash_table, keys[ii], &val) == true);
+      assert(val >= ii);
+    }
+    assert(zword_hash_delete(hash_table, keys[ii], &val) == false);
+  }
+
+  for (ii = size / 2; ii < size; ii++) {
+    if (zword_hash_get(hash_table, keys[ii])) {
+      assert(strcmp(keys[*zword_hash_get(hash_table, keys[ii])], keys[ii]) == 0);
+    }
+  }
+
+  for (ii = size / 2; ii < size; ii++) {
+    zword_hash_delete(hash_table, keys[ii], NULL);
+  }
+
+  assert(zword_hash_count(hash_table) == 0);
+  assert(hash_table->size_index == 0);
+
+  for (ii = 0; ii < size; ii++) free(keys[ii]);
+
+  free(keys);
+  zfree_word_hash_table(hash_table);
+}
+
+static void zhash_define_resize_test()
+{
+  int size, ii;
+  long sum;
+  struct Point point;
+  struct point_hash_table *hash_table;
+
+  size = 100000;
+  hash_table = zcreate_point_hash_table();
+
+  // keys that only differ in their high bits
+  for (ii = 0; ii < size; ii++) {
+    point.x = point.y = 0;
+    point.id = ii << 8;
+    zpoint_hash_set(hash_table, ii << 8, point);
+  }
+
+  assert(hash_table->entry_count <= hash_table->grow_at);
+  assert(hash_table->grow_at == (ZDEFINE_MIN_SIZE <<
+      hash_table->size_index) / 2);
+
+  sum = 0;
+  zpoint_hash_foreach(hash_table, sum_ids, &sum);
+  assert(sum == ((long) size * (size - 1) / 2) << 8);
+
+  for (ii = 0; ii < size; ii++) {
+    assert(zpoint_hash_delete(hash_table, ii << 8, &point) == true);
+    assert(point.id == ii << 8);
+  }
+
+  assert(zpoint_hash_count(hash_table) == 0);
+  assert(hash_table->size_index == 0);
+
+  zfree_point_hash_table(hash_table);
+}
+
+static void zhash_define_grow_failure_test()
+{
+  size_t size, ii;
+  struct id_hash_table *hash_table;
+  enum ZHashStatus status;
+
+  // occupancy is kept out of the slots
+  assert(sizeof(struct id_hash_slot) == 2 * sizeof(uint64_t));
+
+  // the table and its slots and bitmap are three allocations
+  alloc_budget = 2;
+  assert(zcreate_id_hash_table() == NULL);
+
+  alloc_budget = 3;
+  hash_table = zcreate_id_hash_table();
+  assert(hash_table != NULL);
+
+  size = ZDEFINE_MIN_SIZE;
+  status = ZHASH_OK;
+
+  // the first set that needs the table to grow fails, so the table never
+  // goes above 50% load
+  for (ii = 1; ii <= size && status == ZHASH_OK; ii++) {
+    status = zid_hash_set(hash_table, ii, ii * 2);
+  }
+
+  assert(status == ZHASH_NO_MEMORY);
+  assert(zid_hash_count(hash_table) == ZDEFINE_MIN_SIZE / 2);
+  assert(zid_hash_exists(hash_table, ii - 1) == false);
+
+  // an existing key is still updated in place
+  assert(zid_hash_set(hash_table, 1, 7) == ZHASH_OK);
+  assert(*zid_hash_get(hash_table, 1) == 7);
+
+  alloc_budget = SIZE_MAX;
+  assert(zid_hash_set(hash_table, ii - 1, 0) == ZHASH_OK);
+  assert(hash_table->size_index == 1);
+
+  for (ii = 2; ii <= ZDEFINE_MIN_SIZE / 2; ii++) {
+    assert(*zid_hash_get(hash_table, ii) == ii * 2);
+  }
+
+  zfree_id_hash_table(hash_table);
+}
+
+int main()
+{
+  zhash_define_set_test();
+  zhash_define_delete_test();
+  zhash_define_resize_test();
+  zhash_define_grow_failure_test();
+
+  return 0;
+}
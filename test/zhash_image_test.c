@@ -0,0 +1,249 @@
+// mode_t and umask with -std=c11
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200112L
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "../src/zhash.h"
+#include "../src/zhash_image.h"
+
+#define IMAGE_PATH "./zhash_image_test.img"
+
+// generate strings of random  ASCII characters 64 to 126
+// between 5 and 20 characters
+static char *random_string()
+{
+  size_t length, ii;
+  char *str;
+
+  length = rand() % 15 + 5;
+  str = malloc((length + 1) * sizeof(char));
+
+  for (ii = 0; ii < length; ii++) {
+    str[ii] = rand() % 62 + 64;
+  }
+  str[length] = '\0';
+
+  return str;
+}
+
+static size_t uint64_size(void *val)
+{
+  (void) val;
+
+  return sizeof(uint64_t);
+}
+
+static void zhash_image_string_test()
+{
+  size_t size, ii;
+  char **keys, **vals;
+  struct ZHashTable *hash_table;
+  struct ZHashImage *image;
+
+  size = 1000;
+  hash_table = zcreate_hash_table();
+  keys = malloc(size * sizeof(char *));
+  vals = malloc(size * sizeof(char *));
+
+  for (ii = 0; ii < size; ii++) {
+    keys[ii] = random_string();
+    vals[ii] = random_string();
+    zhash_set(hash_table, keys[ii], (void *) vals[ii]);
+  }
+
+  zhash_set(hash_table, "nothing", NULL);
+
+  assert(zhash_write_image(hash_table, IMAGE_PATH, NULL) == true);
+
+  image = zhash_open_image(IMAGE_PATH);
+
+  assert(image != NULL);
+  assert(zhash_image_count(image) == hash_table->entry_count);
+
+  for (ii = 0; ii < size; ii++) {
+    assert(strcmp((char *) zhash_image_get(image, keys[ii]),
+          (char *) zhash_get(hash_table, keys[ii])) == 0);
+    assert(zhash_image_exists(image, keys[ii]) == true);
+  }
+
+  assert(zhash_image_exists(image, "nothing") == true);
+  assert(zhash_image_get(image, "nothing") == NULL);
+  assert(zhash_image_exists(image, "nope") == false);
+  assert(zhash_image_get(image, "nope") == NULL);
+
+  zhash_close_image(image);
+  remove(IMAGE_PATH);
+
+  for (ii = 0; ii < size; ii++) {
+    free(keys[ii]);
+    free(vals[ii]);
+  }
+
+  free(keys);
+  free(vals);
+  zfree_hash_table(hash_table);
+}
+
+static void zhash_image_binary_test()
+{
+  size_t size, ii, val_size;
+  uint64_t *vals;
+  char key[2];
+  struct ZHashTable *hash_table;
+  struct ZHashImage *image;
+
+  size = 256;
+  hash_table = zcreate_hash_table();
+  vals = malloc(size * sizeof(uint64_t));
+
+  // one byte keys, including the zero byte
+  for (ii = 0; ii < size; ii++) {
+    key[0] = (char) ii;
+    vals[ii] = (uint64_t) ii * 0x0101010101010101ull;
+    zhash_set_n(hash_table, key, 1, (void *) &vals[ii]);
+  }
+
+  assert(zhash_write_image(hash_table, IMAGE_PATH, uint64_size) == true);
+
+  image = zhash_open_image(IMAGE_PATH);
+
+  assert(image != NULL);
+
+  for (ii = 0; ii < size; ii++) {
+    uint64_t *val;
+
+    key[0] = (char) ii;
+    val = (uint64_t *) zhash_image_get_n(image, key, 1, &val_size);
+
+    assert(val_size == sizeof(uint64_t));
+    assert((uintptr_t) val % sizeof(uint64_t) == 0);
+    assert(*val == vals[ii]);
+  }
+
+  assert(zhash_image_get_n(image, key, 2, &val_size) == NULL);
+  assert(val_size == 0);
+
+  zhash_close_image(image);
+  remove(IMAGE_PATH);
+
+  free(vals);
+  zfree_hash_table(hash_table);
+}
+
+static void zhash_image_invalid_test()
+{
+  struct ZHashTable *hash_table;
+  struct ZHashImage *image;
+  FILE *file;
+
+  hash_table = zcreate_hash_table();
+
+  // an empty table still makes a valid image
+  assert(zhash_write_image(hash_table, IMAGE_PATH, NULL) == true);
+
+  image = zhash_open_image(IMAGE_PATH);
+
+  assert(image != NULL);
+  assert(zhash_image_count(image) == 0);
+  assert(zhash_image_exists(image, "nope") == false);
+
+  zhash_close_image(image);
+
+  // an image whose size does not match its header is rejected
+  file = fopen(IMAGE_PATH, "r+b");
+  fseek(file, 0, SEEK_END);
+  fputs("garbage", file);
+  fclose(file);
+
+  assert(zhash_open_image(IMAGE_PATH) == NULL);
+
+  remove(IMAGE_PATH);
+
+  assert(zhash_open_image(IMAGE_PATH) == NULL);
+  assert(zhash_write_image(hash_table, "./missing/dir/image", NULL) == false);
+
+  zfree_hash_table(hash_table);
+}
+
+// the temporary file gets a unique name, so a file (here a directory) left at
+// the old fixed name does not stop the write, and no temporary file is left
+static void zhash_image_tmp_test()
+{
+  struct ZHashTable *hash_table;
+  struct ZHashImage *image;
+  struct dirent *dir_entry;
+  DIR *dir;
+
+  hash_table = zcreate_hash_table();
+  zhash_set(hash_table, "key", "val");
+
+  assert(mkdir(IMAGE_PATH ".tmp", 0755) == 0);
+  assert(zhash_write_image(hash_table, IMAGE_PATH, NULL) == true);
+  assert(zhash_write_image(hash_table, IMAGE_PATH, NULL) == true);
+
+  image = zhash_open_image(IMAGE_PATH);
+
+  assert(image != NULL);
+  assert(strcmp(zhash_image_get(image, "key"), "val") == 0);
+
+  zhash_close_image(image);
+
+  dir = opendir(".");
+  assert(dir != NULL);
+
+  while ((dir_entry = readdir(dir))) {
+    assert(strncmp(dir_entry->d_name, "zhash_image_test.img.",
+          strlen("zhash_image_test.img.")) != 0 ||
+        strcmp(dir_entry->d_name, "zhash_image_test.img.tmp") == 0);
+  }
+
+  closedir(dir);
+  rmdir(IMAGE_PATH ".tmp");
+  remove(IMAGE_PATH);
+  zfree_hash_table(hash_table);
+}
+
+// the image gets the same mode as other new files of the process
+static void zhash_image_mode_test()
+{
+  struct ZHashTable *hash_table;
+  struct stat st;
+  mode_t mask;
+
+  hash_table = zcreate_hash_table();
+  zhash_set(hash_table, "key", "val");
+
+  mask = umask(027);
+  assert(zhash_write_image(hash_table, IMAGE_PATH, NULL) == true);
+  assert(stat(IMAGE_PATH, &st) == 0);
+  assert((st.st_mode & 0777) == 0640);
+
+  umask(022);
+  assert(zhash_write_image(hash_table, IMAGE_PATH, NULL) == true);
+  assert(stat(IMAGE_PATH, &st) == 0);
+  assert((st.st_mode & 0777) == 0644);
+
+  umask(mask);
+  remove(IMAGE_PATH);
+  zfree_hash_table(hash_table);
+}
+
+int main()
+{
+  zhash_image_string_test();
+  zhash_image_binary_test();
+  zhash_image_invalid_test();
+  zhash_image_tmp_test();
+  zhash_image_mode_test();
+
+  return 0;
+}
@@ -4,6 +4,7 @@
 #include <assert.h>
 #include <stdbool.h>
 #include "../src/zhash.h"
+#include "./ztest_allocator.h"
 
 // generate strings of random  ASCII characters 64 to 126
 // between 5 and 20 characters
@@ -125,11 +126,741 @@ static void zhash_exists_test()
   zfree_hash_table(hash_table);
 }
 
+static void zhash_incremental_test()
+{
+  size_t size, ii;
+  char **keys, **vals;
+  bool rehashed;
+  struct ZHashTable *hash_table;
+
+  size = 2000;
+  rehashed = false;
+  hash_table = zcreate_hash_table_with_flags(ZHASH_INCREMENTAL);
+  keys = malloc(size * sizeof(char *));
+  vals = malloc(size * sizeof(char *));
+
+  for (ii = 0; ii < size; ii++) {
+    keys[ii] = random_string();
+    vals[ii] = random_string();
+    zhash_set(hash_table, keys[ii], (void *) vals[ii]);
+
+    // every key must stay visible while buckets are being moved
+    if (zhash_rehashing(hash_table)) {
+      rehashed = true;
+      assert(strcmp((char *) zhash_get(hash_table, keys[ii / 2]), vals[ii / 2]) == 0);
+    }
+  }
+
+  assert(rehashed == true);
+  assert(hash_table->entry_count == size);
+
+  for (ii = 0; ii < size; ii++) {
+    assert(strcmp((char *) zhash_get(hash_table, keys[ii]), vals[ii]) == 0);
+  }
+
+  for (ii = 0; ii < 7 * size / 8; ii++) {
+    assert(zhash_delete(hash_table, keys[ii]) == vals[ii]);
+  }
+
+  for (ii = 0; ii < size; ii++) {
+    if (ii < 7 * size / 8) {
+      assert(zhash_exists(hash_table, keys[ii]) == false);
+    } else {
+      assert(strcmp((char *) zhash_get(hash_table, keys[ii]), vals[ii]) == 0);
+    }
+  }
+
+  assert(hash_table->entry_count == size - 7 * size / 8);
+
+  for (ii = 0; ii < size; ii++) {
+    free(keys[ii]);
+    free(vals[ii]);
+  }
+
+  free(keys);
+  free(vals);
+  zfree_hash_table(hash_table);
+}
+
+// number of blocks on the slab's list of individually allocated blocks
+static size_t large_block_count(struct ZHashTable *hash_table)
+{
+  size_t count;
+  struct ZSlabLarge *large;
+
+  count = 0;
+  for (large = hash_table->slab.large; large; large = large->next) {
+    assert(large->next == NULL || large->next->prev == large);
+    count++;
+  }
+
+  return count;
+}
+
+static void zhash_long_key_test()
+{
+  size_t ii;
+  char long_key[1000];
+  struct ZHashTable *hash_table;
+
+  hash_table = zcreate_hash_table();
+
+  memset(long_key, 'a', sizeof(long_key) - 1);
+  long_key[sizeof(long_key) - 1] = '\0';
+
+  // long keys are too big for the slab and are allocated individually
+  zhash_set(hash_table, long_key, (void *) "long");
+  zhash_set(hash_table, "short", (void *) "short");
+
+  for (ii = 0; ii < 5; ii++) {
+    long_key[ii] = 'b';
+    zhash_set(hash_table, long_key, (void *) "longer");
+  }
+
+  assert(hash_table->entry_count == 7);
+  assert(large_block_count(hash_table) == 6);
+  assert(strcmp((char *) zhash_get(hash_table, long_key), "longer") == 0);
+  assert(strcmp((char *) zhash_delete(hash_table, long_key), "longer") == 0);
+  assert(zhash_exists(hash_table, long_key) == false);
+  assert(large_block_count(hash_table) == 5);
+  assert(strcmp((char *) zhash_get(hash_table, "short"), "short") == 0);
+
+  // blocks are unlinked from the middle and both ends of the list
+  long_key[4] = 'a';
+  assert(zhash_delete(hash_table, long_key) != NULL);
+  memset(long_key, 'a', 5);
+  assert(zhash_delete(hash_table, long_key) != NULL);
+  memset(long_key, 'b', 2);
+  assert(zhash_delete(hash_table, long_key) != NULL);
+  assert(large_block_count(hash_table) == 2);
+
+  // the remaining long keys are freed with the table, without walking the
+  // buckets (checked for leaks by the test script)
+
+  zfree_hash_table(hash_table);
+}
+
+static void zhash_binary_key_test()
+{
+  struct ZHashTable *hash_table;
+  char buffer[] = "user:1\0user:12 user:123";
+
+  hash_table = zcreate_hash_table();
+
+  // keys are slices of a larger buffer and may contain zero bytes
+  zhash_set_n(hash_table, buffer, 6, (void *) "one");
+  zhash_set_n(hash_table, buffer + 7, 7, (void *) "twelve");
+  zhash_set_n(hash_table, buffer, 8, (void *) "with zero byte");
+
+  assert(hash_table->entry_count == 3);
+  assert(strcmp((char *) zhash_get_n(hash_table, buffer + 7, 6), "one") == 0);
+  assert(strcmp((char *) zhash_get_n(hash_table, buffer + 15, 7), "twelve") == 0);
+  assert(strcmp((char *) zhash_get_n(hash_table, buffer, 8), "with zero byte") == 0);
+  assert(strcmp((char *) zhash_get(hash_table, "user:1"), "one") == 0);
+  assert(zhash_exists_n(hash_table, buffer + 15, 8) == false);
+
+  assert(strcmp((char *) zhash_delete_n(hash_table, buffer, 8), "with zero byte") == 0);
+  assert(zhash_exists_n(hash_table, buffer, 8) == false);
+  assert(zhash_exists_n(hash_table, buffer, 6) == true);
+
+  zfree_hash_table(hash_table);
+}
+
+static void zhash_prehashed_test()
+{
+  uint64_t hash;
+  struct ZHashTable *tenant_table, *global_table;
+
+  tenant_table = zcreate_hash_table();
+  global_table = zcreate_hash_table();
+
+  // the same hash works for every table
+  hash = zhash_hash("hello");
+  zhash_set_prehashed(tenant_table, "hello", hash, (void *) "tenant");
+  zhash_set_prehashed(global_table, "hello", hash, (void *) "global");
+
+  assert(strcmp((char *) zhash_get(tenant_table, "hello"), "tenant") == 0);
+  assert(strcmp((char *) zhash_get_prehashed(global_table, "hello", hash), "global") == 0);
+  assert(zhash_exists_prehashed(tenant_table, "hello", hash) == true);
+  assert(zhash_exists_prehashed(tenant_table, "nope", zhash_hash("nope")) == false);
+
+  assert(strcmp((char *) zhash_delete_prehashed(tenant_table, "hello", hash), "tenant") == 0);
+  assert(zhash_exists(tenant_table, "hello") == false);
+  assert(zhash_exists(global_table, "hello") == true);
+
+  zfree_hash_table(tenant_table);
+  zfree_hash_table(global_table);
+}
+
+static void zhash_get_many_test()
+{
+  size_t size, ii;
+  char **keys, **vals;
+  void **found_vals;
+  bool *found;
+  struct ZHashTable *hash_table;
+
+  size = 100;
+  hash_table = zcreate_hash_table();
+  keys = malloc(size * sizeof(char *));
+  vals = malloc(size * sizeof(char *));
+  found_vals = malloc(size * sizeof(void *));
+  found = malloc(size * sizeof(bool));
+
+  for (ii = 0; ii < size; ii++) {
+    keys[ii] = random_string();
+    vals[ii] = random_string();
+    if (ii % 3 != 0) zhash_set(hash_table, keys[ii], (void *) vals[ii]);
+  }
+
+  zhash_get_many(hash_table, keys, size, found_vals);
+  zhash_exists_many(hash_table, keys, size, found);
+
+  for (ii = 0; ii < size; ii++) {
+    if (ii % 3 != 0) {
+      assert(found_vals[ii] == vals[ii]);
+      assert(found[ii] == true);
+    } else {
+      assert(found_vals[ii] == NULL);
+      assert(found[ii] == false);
+    }
+  }
+
+  for (ii = 0; ii < size; ii++) {
+    free(keys[ii]);
+    free(vals[ii]);
+  }
+
+  free(keys);
+  free(vals);
+  free(found_vals);
+  free(found);
+  zfree_hash_table(hash_table);
+}
+
+static void zhash_capacity_test()
+{
+  size_t size, ii;
+  char **keys, **vals;
+  struct ZHashTable *hash_table, *reserved_table;
+
+  size = 1000;
+  hash_table = zcreate_hash_table_with_capacity(0, size);
+  reserved_table = zcreate_hash_table();
+  keys = malloc(size * sizeof(char *));
+  vals = malloc(size * sizeof(char *));
+
+  // 3407 is the first size whose table holds 1000 entries
+  assert(hash_table->size_index == 5);
+
+  zhash_reserve(reserved_table, size);
+  assert(reserved_table->size_index == 5);
+
+  for (ii = 0; ii < size; ii++) {
+    keys[ii] = random_string();
+    vals[ii] = random_string();
+    zhash_set(hash_table, keys[ii], (void *) vals[ii]);
+  }
+
+  zhash_bulk_load(reserved_table, keys, (void **) vals, size);
+
+  assert(hash_table->size_index == 5);
+  assert(reserved_table->size_index == 5);
+  assert(reserved_table->entry_count == hash_table->entry_count);
+
+  for (ii = 0; ii < size; ii++) {
+    assert(strcmp((char *) zhash_get(reserved_table, keys[ii]), vals[ii]) == 0);
+  }
+
+  for (ii = 0; ii < size; ii++) {
+    free(keys[ii]);
+    free(vals[ii]);
+  }
+
+  free(keys);
+  free(vals);
+  zfree_hash_table(hash_table);
+  zfree_hash_table(reserved_table);
+
+  // 2048 buckets is the first power of 2 table that holds 1000 entries
+  hash_table = zcreate_hash_table_with_capacity(ZHASH_POW2 | ZHASH_INCREMENTAL,
+      size);
+  assert(hash_table->flags == (ZHASH_POW2 | ZHASH_INCREMENTAL));
+  assert(hash_table->size_index == 5);
+  zfree_hash_table(hash_table);
+}
+
+static void zhash_pow2_test()
+{
+  size_t size, ii;
+  char **keys, **vals;
+  struct ZHashTable *hash_table;
+
+  size = 100;
+  hash_table = zcreate_hash_table_with_flags(ZHASH_POW2);
+  keys = malloc(size * sizeof(char *));
+  vals = malloc(size * sizeof(char *));
+
+  for (ii = 0; ii < size; ii++) {
+    keys[ii] = random_string();
+    vals[ii] = random_string();
+    zhash_set(hash_table, keys[ii], (void *) vals[ii]);
+  }
+
+  // 64 -> 128 -> 256 buckets
+  assert(hash_table->size_index == 2);
+  assert(hash_table->entry_count == size);
+
+  for (ii = 0; ii < 7 * size / 8; ii++) {
+    zhash_delete(hash_table, keys[ii]);
+  }
+
+  for (ii = 0; ii < size; ii++) {
+    if (ii < 7 * size / 8) {
+      assert(zhash_get(hash_table, keys[ii]) == NULL);
+    } else {
+      assert(strcmp((char *) zhash_get(hash_table, keys[ii]), vals[ii]) == 0);
+    }
+  }
+
+  // 13 entries is less than 128 / 8, so the table is back to 64 buckets
+  assert(hash_table->size_index == 0);
+
+  zhash_reserve(hash_table, 1000);
+  assert(hash_table->size_index == 5);
+
+  for (ii = 0; ii < size; ii++) {
+    free(keys[ii]);
+    free(vals[ii]);
+  }
+
+  free(keys);
+  free(vals);
+  zfree_hash_table(hash_table);
+}
+
+static void zhash_policy_test()
+{
+  size_t size, ii;
+  char **keys;
+  struct ZHashTable *hash_table;
+  struct ZHashPolicy policy = { 0.9, 0.0, 4 };
+  struct ZHashPolicy bad_policies[] = {
+    { 0.0, 0.0, 2 }, { -1.0, 0.0, 2 }, { 0.5, 0.3, 2 }, { 0.5, 0.2, 4 }
+  };
+
+  size = 100;
+  hash_table = zcreate_hash_table();
+  keys = malloc(size * sizeof(char *));
+
+  assert(zhash_set_policy(hash_table, &policy) == true);
+
+  // policies that grow on every insertion or shrink right after growing are
+  // rejected and leave the current policy in place
+  assert(zhash_set_policy(hash_table, &bad_policies[0]) == false);
+  assert(zhash_set_policy(hash_table, &bad_policies[1]) == false);
+  assert(zhash_set_policy(hash_table, &bad_policies[2]) == false);
+  assert(zhash_set_policy(hash_table, &bad_policies[3]) == false);
+  assert(hash_table->policy.max_load == 0.9);
+
+  for (ii = 0; ii < size; ii++) {
+    keys[ii] = random_string();
+    zhash_set(hash_table, keys[ii], NULL);
+  }
+
+  // grows once, by two sizes, when the 48th entry passes 0.9 * 53
+  assert(hash_table->size_index == 2);
+
+  for (ii = 1; ii < size; ii++) zhash_delete(hash_table, keys[ii]);
+
+  // shrinking is disabled
+  assert(hash_table->size_index == 2);
+
+  zhash_shrink_to_fit(hash_table);
+
+  assert(hash_table->size_index == 0);
+  assert(hash_table->entry_count == 1);
+  assert(zhash_exists(hash_table, keys[0]) == true);
+
+  for (ii = 0; ii < size; ii++) free(keys[ii]);
+
+  free(keys);
+  zfree_hash_table(hash_table);
+}
+
+// marks every visited key in the hash table passed as ctx
+static void mark_visited(char *key, size_t key_length, void *val, void *ctx)
+{
+  (void) val;
+
+  zhash_set_n((struct ZHashTable *) ctx, key, key_length, (void *) key);
+}
+
+static void zhash_foreach_test()
+{
+  size_t size, ii;
+  char **keys;
+  struct ZHashTable *hash_table, *visited;
+
+  size = 100;
+  hash_table = zcreate_hash_table();
+  visited = zcreate_hash_table();
+  keys = malloc(size * sizeof(char *));
+
+  for (ii = 0; ii < size; ii++) {
+    keys[ii] = random_string();
+    zhash_set(hash_table, keys[ii], NULL);
+  }
+
+  zhash_foreach(hash_table, mark_visited, visited);
+
+  assert(visited->entry_count == hash_table->entry_count);
+
+  for (ii = 0; ii < size; ii++) {
+    assert(zhash_exists(visited, keys[ii]) == true);
+    free(keys[ii]);
+  }
+
+  free(keys);
+  zfree_hash_table(hash_table);
+  zfree_hash_table(visited);
+}
+
+// checks that the entry's cached hash is the hash of its key, and counts it
+static void check_entry(struct ZHashEntry *entry, void *ctx)
+{
+  assert(entry->hash == zhash_hash_n(entry->key, entry->key_length));
+  assert(entry->val == (void *) entry->key ||
+      strcmp((char *) entry->val, entry->key) == 0);
+
+  (*(size_t *) ctx)++;
+}
+
+static void zhash_foreach_entry_test()
+{
+  size_t size, count, ii;
+  char **keys;
+  struct ZHashTable *hash_table;
+
+  size = 1000;
+  hash_table = zcreate_hash_table_with_flags(ZHASH_INCREMENTAL);
+  keys = malloc(size * sizeof(char *));
+
+  // an incremental table may still have entries in its old bucket array
+  for (ii = 0; ii < size; ii++) {
+    keys[ii] = random_string();
+    zhash_set(hash_table, keys[ii], keys[ii]);
+  }
+
+  count = 0;
+  zhash_foreach_entry(hash_table, check_entry, &count);
+
+  assert(count == hash_table->entry_count);
+
+  for (ii = 0; ii < size; ii++) free(keys[ii]);
+
+  free(keys);
+  zfree_hash_table(hash_table);
+}
+
+static void zhash_scan_test()
+{
+  size_t size, extra_size, ii, steps, cursor;
+  char **keys, **extra_keys;
+  struct ZHashTable *hash_table, *visited;
+
+  size = 100;
+  extra_size = 2000;
+  hash_table = zcreate_hash_table_with_flags(ZHASH_POW2 | ZHASH_INCREMENTAL);
+  visited = zcreate_hash_table();
+  keys = malloc(size * sizeof(char *));
+  extra_keys = malloc(extra_size * sizeof(char *));
+
+  for (ii = 0; ii < size; ii++) {
+    keys[ii] = random_string();
+    zhash_set(hash_table, keys[ii], NULL);
+  }
+
+  for (ii = 0; ii < extra_size; ii++) {
+    extra_keys[ii] = malloc(16);
+    snprintf(extra_keys[ii], 16, "extra%zu", ii);
+  }
+
+  // the table grows and then shrinks while the scan is running
+  cursor = 0;
+  steps = 0;
+  do {
+    cursor = zhash_scan(hash_table, cursor, mark_visited, visited);
+
+    if (steps < extra_size / 20) {
+      for (ii = steps * 20; ii < steps * 20 + 20; ii++) {
+        zhash_set(hash_table, extra_keys[ii], NULL);
+      }
+    } else if (steps < extra_size / 10) {
+      for (ii = steps * 20 - extra_size; ii < steps * 20 - extra_size + 20; ii++) {
+        zhash_delete(hash_table, extra_keys[ii]);
+      }
+    }
+
+    steps++;
+  } while (cursor != 0);
+
+  for (ii = 0; ii < size; ii++) {
+    assert(zhash_exists(visited, keys[ii]) == true);
+    free(keys[ii]);
+  }
+
+  for (ii = 0; ii < extra_size; ii++) free(extra_keys[ii]);
+
+  free(keys);
+  free(extra_keys);
+  zfree_hash_table(hash_table);
+  zfree_hash_table(visited);
+}
+
+static void zhash_scan_rehashing_test()
+{
+  size_t size, ii, cursor;
+  char **keys;
+  struct ZHashTable *hash_table, *visited;
+
+  size = 1000;
+  hash_table = zcreate_hash_table_with_flags(ZHASH_INCREMENTAL);
+  visited = zcreate_hash_table();
+  keys = malloc(size * sizeof(char *));
+
+  // stop adding keys as soon as an incremental rehash is running
+  for (ii = 0; ii < size && !hash_table->old_entries; ii++) {
+    keys[ii] = random_string();
+    zhash_set(hash_table, keys[ii], NULL);
+  }
+
+  size = ii;
+  assert(hash_table->old_entries != NULL);
+
+  // the scan does not finish the rehash, which lookups between the calls
+  // move along
+  cursor = zhash_scan(hash_table, 0, mark_visited, visited);
+  assert(hash_table->old_entries != NULL);
+
+  ii = 0;
+  while (cursor != 0) {
+    zhash_get(hash_table, keys[ii++ % size]);
+    cursor = zhash_scan(hash_table, cursor, mark_visited, visited);
+  }
+
+  assert(hash_table->old_entries == NULL);
+
+  for (ii = 0; ii < size; ii++) {
+    assert(zhash_exists(visited, keys[ii]) == true);
+    free(keys[ii]);
+  }
+
+  free(keys);
+  zfree_hash_table(hash_table);
+  zfree_hash_table(visited);
+}
+
+static void zhash_entry_test()
+{
+  size_t size, ii;
+  char **keys;
+  bool created;
+  struct ZHashTable *hash_table;
+  struct ZHashEntry *entry;
+
+  size = 1000;
+  hash_table = zcreate_hash_table_with_prefix(ZHASH_INCREMENTAL, sizeof(size_t));
+  keys = malloc(size * sizeof(char *));
+
+  for (ii = 0; ii < size; ii++) {
+    keys[ii] = random_string();
+    entry = zhash_upsert_entry(hash_table, keys[ii], strlen(keys[ii]), &created);
+    if (!created) continue;
+    entry->val = (void *) keys[ii];
+    *(size_t *) ((char *) entry - hash_table->entry_prefix) = ii;
+  }
+
+  for (ii = 0; ii < size; ii++) {
+    entry = zhash_find_entry(hash_table, keys[ii], strlen(keys[ii]));
+    assert(entry != NULL);
+    assert(strcmp(entry->key, keys[ii]) == 0);
+    assert(strcmp(keys[*(size_t *) ((char *) entry - hash_table->entry_prefix)],
+          keys[ii]) == 0);
+    zhash_upsert_entry(hash_table, keys[ii], strlen(keys[ii]), &created);
+    assert(created == false);
+  }
+
+  // remove entries by key and by entry, while the table shrinks
+  for (ii = 0; ii < size; ii++) {
+    if (ii % 2) {
+      entry = zhash_unlink_entry(hash_table, keys[ii], strlen(keys[ii]));
+    } else if ((entry = zhash_find_entry(hash_table, keys[ii],
+            strlen(keys[ii])))) {
+      zhash_remove_entry(hash_table, entry);
+    }
+    if (entry) zhash_free_entry(hash_table, entry);
+    assert(zhash_find_entry(hash_table, keys[ii], strlen(keys[ii])) == NULL);
+  }
+
+  assert(hash_table->entry_count == 0);
+
+  for (ii = 0; ii < size; ii++) free(keys[ii]);
+
+  free(keys);
+  zfree_hash_table(hash_table);
+}
+
+static void zhash_stats_test()
+{
+  size_t size, ii, bucket_total, entry_total, key_bytes;
+  char *key;
+  struct ZHashTable *hash_table;
+  struct ZHashStats stats;
+
+  size = 10000;
+  hash_table = zcreate_hash_table_with_flags(ZHASH_INCREMENTAL);
+
+  zhash_stats(hash_table, &stats);
+  assert(stats.entry_count == 0);
+  assert(stats.rehash_count == 0);
+  assert(stats.max_chain_length == 0);
+  assert(stats.chain_lengths[0] == stats.bucket_count);
+
+  key_bytes = 0;
+  for (ii = 0; ii < size; ii++) {
+    key = random_string();
+    if (!zhash_exists(hash_table, key)) key_bytes += strlen(key) + 1;
+    zhash_set(hash_table, key, NULL);
+    free(key);
+  }
+
+  zhash_stats(hash_table, &stats);
+
+  assert(stats.entry_count == hash_table->entry_count);
+  assert(stats.rehash_count > 0);
+  assert(stats.load_factor ==
+      (double) stats.entry_count / (double) stats.bucket_count);
+  assert(stats.key_bytes == key_bytes);
+  assert(stats.entry_bytes >= stats.key_bytes);
+  assert(stats.slab_bytes >= stats.entry_bytes);
+  assert(stats.bucket_bytes >= stats.bucket_count * sizeof(void *));
+
+  // every bucket and every entry is counted once, including the buckets of
+  // an unfinished incremental rehash
+  bucket_total = entry_total = 0;
+  for (ii = 0; ii < ZHASH_STATS_CHAIN_COUNT; ii++) {
+    bucket_total += stats.chain_lengths[ii];
+    entry_total += ii * stats.chain_lengths[ii];
+    if (stats.chain_lengths[ii] > 0) assert(ii <= stats.max_chain_length);
+  }
+
+  assert(bucket_total >= stats.bucket_count);
+  if (stats.max_chain_length < ZHASH_STATS_CHAIN_COUNT) {
+    assert(entry_total == stats.entry_count);
+  }
+
+#ifdef ZHASH_PROBE_STATS
+  assert(stats.lookup_count >= size);
+  assert(stats.probe_count > 0);
+#else
+  assert(stats.lookup_count == 0);
+  assert(stats.probe_count == 0);
+#endif
+
+  zfree_hash_table(hash_table);
+}
+
+static void zhash_allocator_test()
+{
+  size_t size, count, ii;
+  char **keys;
+  struct TestAllocator state;
+  struct ZAllocator allocator;
+  struct ZHashTable *hash_table;
+  enum ZHashStatus status;
+
+  // the table and its buckets are two allocations
+  test_allocator_init(&allocator, &state, 1);
+  assert(zcreate_hash_table_with_allocator(0, 0, &allocator) == NULL);
+  assert(state.live == 0);
+
+  state.remaining = 40;
+  hash_table = zcreate_hash_table_with_allocator(ZHASH_INCREMENTAL, 0,
+      &allocator);
+  assert(hash_table != NULL);
+
+  size = 100000;
+  keys = malloc(size * sizeof(char *));
+  count = 0;
+  status = ZHASH_OK;
+
+  // long keys use individually allocated entries, which use up the budget
+  for (ii = 0; ii < size && status == ZHASH_OK; ii++) {
+    keys[ii] = random_string();
+    if (ii % 2 == 0) {
+      keys[ii] = realloc(keys[ii], 300);
+      memset(keys[ii] + strlen(keys[ii]), 'x', 299 - strlen(keys[ii]));
+      keys[ii][299] = '\0';
+    }
+    if (!zhash_exists(hash_table, keys[ii])) count++;
+    status = zhash_set(hash_table, keys[ii], keys[ii]);
+  }
+
+  // the failed insertion left the table unchanged
+  assert(status == ZHASH_NO_MEMORY);
+  size = ii;
+  count--;
+  assert(hash_table->entry_count == count);
+  assert(zhash_exists(hash_table, keys[size - 1]) == false);
+
+  for (ii = 0; ii < size - 1; ii++) {
+    assert(strcmp(zhash_get(hash_table, keys[ii]), keys[ii]) == 0);
+  }
+
+  state.remaining = SIZE_MAX;
+  assert(zhash_set(hash_table, keys[size - 1], keys[size - 1]) == ZHASH_OK);
+  assert(zhash_get(hash_table, keys[size - 1]) == keys[size - 1]);
+
+  zfree_hash_table(hash_table);
+  assert(state.live == 0);
+
+  // a bulk load that cannot size the table sets no keys
+  state.remaining = 2;
+  hash_table = zcreate_hash_table_with_allocator(0, 0, &allocator);
+  assert(zhash_bulk_load(hash_table, keys, (void **) keys, size) ==
+      ZHASH_NO_MEMORY);
+  assert(hash_table->entry_count == 0);
+  assert(hash_table->size_index == 0);
+  assert(zhash_reserve(hash_table, size) == ZHASH_NO_MEMORY);
+  zfree_hash_table(hash_table);
+  assert(state.live == 0);
+
+  for (ii = 0; ii < size; ii++) free(keys[ii]);
+
+  free(keys);
+}
+
 int main()
 {
   zhash_set_test();
   zhash_delete_test();
   zhash_exists_test();
+  zhash_incremental_test();
+  zhash_long_key_test();
+  zhash_binary_key_test();
+  zhash_prehashed_test();
+  zhash_get_many_test();
+  zhash_capacity_test();
+  zhash_pow2_test();
+  zhash_policy_test();
+  zhash_foreach_test();
+  zhash_foreach_entry_test();
+  zhash_scan_test();
+  zhash_scan_rehashing_test();
+  zhash_entry_test();
+  zhash_stats_test();
+  zhash_allocator_test();
 
   return 0;
 }
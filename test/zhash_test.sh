@@ -42,3 +42,14 @@ function run_tests() {
 
 run_tests '../src/zhash.c ./zhash_test.c' 'zhash'
 run_tests '../src/zhash.c ../src/zsorted_hash.c ./zsorted_hash_test.c' 'zsorted_hash'
+run_tests '../src/zhash.c ../src/zflat_hash.c ./zflat_hash_test.c' 'zflat_hash'
+run_tests '-DZFLAT_NO_SIMD ../src/zhash.c ../src/zflat_hash.c ./zflat_hash_test.c' 'zflat_hash_no_simd'
+run_tests '../src/zhash.c ../src/zcompact_hash.c ./zcompact_hash_test.c' 'zcompact_hash'
+run_tests '../src/zhash.c ../src/zhash_image.c ./zhash_image_test.c' 'zhash_image'
+run_tests '../src/zhash.c ../src/zfrozen_hash.c ./zfrozen_hash_test.c' 'zfrozen_hash'
+run_tests '-DZFROZEN_HASH_MASK=0xfff0000000000000ull -DZFROZEN_MAX_PILOT=0 ../src/zhash.c ../src/zfrozen_hash.c ./zfrozen_hash_test.c' 'zfrozen_hash_collide'
+run_tests '../src/zint_hash.c ./zint_hash_test.c' 'zint_hash'
+run_tests '../src/zint_hash.c ../src/zsorted_int_hash.c ./zsorted_int_hash_test.c' 'zsorted_int_hash'
+run_tests './zhash_define_test.c' 'zhash_define'
+run_tests '-pthread ../src/zhash.c ../src/zsharded_hash.c ./zsharded_hash_test.c' 'zsharded_hash'
+run_tests '-pthread ../src/zhash.c ../src/zconcurrent_hash.c ./zconcurrent_hash_test.c' 'zconcurrent_hash'
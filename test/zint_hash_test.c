@@ -0,0 +1,257 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <assert.h>
+#include <stdbool.h>
+#include "../src/zint_hash.h"
+#include "./ztest_allocator.h"
+
+// generate random 64-bit keys; rand() only gives 15 reliable bits
+static uint64_t random_key()
+{
+  uint64_t key;
+  size_t ii;
+
+  key = 0;
+  for (ii = 0; ii < 5; ii++) key = (key << 15) ^ (uint64_t) rand();
+
+  return key;
+}
+
+static void zint_hash_set_test()
+{
+  size_t size, ii;
+  uint64_t *keys;
+  struct ZIntHashTable *hash_table;
+
+  size = 1000;
+  hash_table = zcreate_int_hash_table();
+  keys = malloc(size * sizeof(uint64_t));
+
+  // sequential ids, the common case, and key 0
+  for (ii = 0; ii < size; ii++) {
+    keys[ii] = ii;
+    zint_hash_set(hash_table, keys[ii], (void *) &keys[ii]);
+  }
+
+  assert(zint_hash_count(hash_table) == size);
+
+  for (ii = 0; ii < size; ii++) {
+    assert(zint_hash_get(hash_table, keys[ii]) == &keys[ii]);
+  }
+
+  // overwriting does not add entries
+  for (ii = 0; ii < size; ii++) {
+    zint_hash_set(hash_table, keys[ii], (void *) &keys[size - ii - 1]);
+  }
+
+  assert(zint_hash_count(hash_table) == size);
+
+  for (ii = 0; ii < size; ii++) {
+    assert(zint_hash_get(hash_table, keys[ii]) == &keys[size - ii - 1]);
+  }
+
+  assert(zint_hash_get(hash_table, size) == NULL);
+  assert(zint_hash_get(hash_table, UINT64_MAX) == NULL);
+
+  free(keys);
+  zfree_int_hash_table(hash_table);
+}
+
+static void zint_hash_delete_test()
+{
+  size_t size, ii;
+  uint64_t *keys;
+  struct ZIntHashTable *hash_table;
+
+  size = 1000;
+  hash_table = zcreate_int_hash_table();
+  keys = malloc(size * sizeof(uint64_t));
+
+  for (ii = 0; ii < size; ii++) {
+    keys[ii] = random_key();
+    zint_hash_set(hash_table, keys[ii], (void *) &keys[ii]);
+  }
+
+  assert(zint_hash_count(hash_table) == size);
+
+  // deleting moves later entries of a probe sequence back; every remaining
+  // key must still be found
+  for (ii = 0; ii < size / 2; ii++) {
+    assert(zint_hash_delete(hash_table, keys[ii]) == &keys[ii]);
+    assert(zint_hash_delete(hash_table, keys[ii]) == NULL);
+  }
+
+  assert(zint_hash_count(hash_table) == size - size / 2);
+
+  for (ii = 0; ii < size; ii++) {
+    if (ii < size / 2) {
+      assert(zint_hash_get(hash_table, keys[ii]) == NULL);
+    } else {
+      assert(zint_hash_get(hash_table, keys[ii]) == &keys[ii]);
+    }
+  }
+
+  zint_hash_set(hash_table, 0, (void *) keys);
+  assert(zint_hash_count(hash_table) == size - size / 2 + 1);
+  assert(zint_hash_delete(hash_table, 0) == keys);
+  assert(zint_hash_delete(hash_table, 0) == NULL);
+
+  for (ii = size / 2; ii < size; ii++) {
+    assert(zint_hash_delete(hash_table, keys[ii]) == &keys[ii]);
+  }
+
+  assert(zint_hash_count(hash_table) == 0);
+  assert(hash_table->size_index == 0);
+
+  free(keys);
+  zfree_int_hash_table(hash_table);
+}
+
+static void zint_hash_exists_test()
+{
+  size_t size, ii;
+  struct ZIntHashTable *hash_table;
+
+  size = 100;
+  hash_table = zcreate_int_hash_table();
+
+  // keys are multiples of 16, which all land in slot 0 without a mixer
+  for (ii = 0; ii < size; ii++) {
+    zint_hash_set(hash_table, ii << 4, NULL);
+  }
+
+  for (ii = 0; ii < size; ii++) {
+    assert(zint_hash_exists(hash_table, ii << 4) == true);
+    assert(zint_hash_exists(hash_table, (ii << 4) + 1) == false);
+  }
+
+  zfree_int_hash_table(hash_table);
+}
+
+static void zint_hash_resize_test()
+{
+  size_t size, ii;
+  struct ZIntHashTable *hash_table;
+
+  size = 100000;
+  hash_table = zcreate_int_hash_table();
+
+  for (ii = 1; ii <= size; ii++) {
+    zint_hash_set(hash_table, ii, (void *) (uintptr_t) ii);
+  }
+
+  assert(zint_hash_count(hash_table) == size);
+  assert(hash_table->entry_count * 4 <= (ZINT_MIN_SIZE <<
+      hash_table->size_index) * 3);
+
+  for (ii = 1; ii <= size; ii++) {
+    assert(zint_hash_get(hash_table, ii) == (void *) (uintptr_t) ii);
+    assert(zint_hash_delete(hash_table, ii) == (void *) (uintptr_t) ii);
+  }
+
+  assert(zint_hash_count(hash_table) == 0);
+  assert(hash_table->size_index == 0);
+
+  zfree_int_hash_table(hash_table);
+}
+
+static void zint_hash_upsert_test()
+{
+  size_t size, ii;
+  bool created;
+  void **val;
+  struct ZIntHashTable *hash_table;
+
+  size = 1000;
+  hash_table = zcreate_int_hash_table();
+
+  // key 0 is kept outside the slots, but behaves like any other key
+  for (ii = 0; ii < size; ii++) {
+    val = zint_hash_upsert(hash_table, ii, &created);
+    assert(created == true);
+    assert(*val == NULL);
+    *val = (void *) (uintptr_t) (ii + 1);
+    assert(zint_hash_count(hash_table) == ii + 1);
+  }
+
+  for (ii = 0; ii < size; ii++) {
+    val = zint_hash_upsert(hash_table, ii, &created);
+    assert(created == false);
+    assert(*val == (void *) (uintptr_t) (ii + 1));
+    *val = (void *) (uintptr_t) ii;
+  }
+
+  assert(zint_hash_count(hash_table) == size);
+
+  for (ii = 0; ii < size; ii++) {
+    assert(zint_hash_exists(hash_table, ii) == true);
+    assert(zint_hash_get(hash_table, ii) == (void *) (uintptr_t) ii);
+  }
+
+  zfree_int_hash_table(hash_table);
+}
+
+static void zint_hash_allocator_test()
+{
+  size_t size, size_index, ii;
+  uint64_t *keys;
+  struct TestAllocator state;
+  struct ZAllocator allocator;
+  struct ZIntHashTable *hash_table;
+  enum ZHashStatus status;
+
+  // the table and its slots are two allocations
+  test_allocator_init(&allocator, &state, 1);
+  assert(zcreate_int_hash_table_with_allocator(&allocator) == NULL);
+  assert(state.live == 0);
+
+  state.remaining = 6;
+  hash_table = zcreate_int_hash_table_with_allocator(&allocator);
+  assert(hash_table != NULL);
+
+  size = 100000;
+  keys = malloc(size * sizeof(uint64_t));
+  status = ZHASH_OK;
+
+  // every time the table grows it uses up one allocation
+  for (ii = 0; ii < size && status == ZHASH_OK; ii++) {
+    keys[ii] = random_key();
+    status = zint_hash_set(hash_table, keys[ii], (void *) &keys[ii]);
+  }
+
+  assert(status == ZHASH_NO_MEMORY);
+  size = ii;
+  assert(zint_hash_count(hash_table) == size - 1);
+
+  // a table that cannot shrink keeps its size
+  size_index = hash_table->size_index;
+  for (ii = 0; ii < size - 2; ii++) {
+    assert(zint_hash_delete(hash_table, keys[ii]) == &keys[ii]);
+  }
+
+  assert(hash_table->size_index == size_index);
+  assert(zint_hash_get(hash_table, keys[size - 2]) == &keys[size - 2]);
+
+  state.remaining = SIZE_MAX;
+  assert(zint_hash_set(hash_table, keys[size - 1], (void *) &keys[size - 1]) ==
+      ZHASH_OK);
+  assert(zint_hash_get(hash_table, keys[size - 1]) == &keys[size - 1]);
+
+  zfree_int_hash_table(hash_table);
+  assert(state.live == 0);
+
+  free(keys);
+}
+
+int main()
+{
+  zint_hash_set_test();
+  zint_hash_delete_test();
+  zint_hash_exists_test();
+  zint_hash_resize_test();
+  zint_hash_upsert_test();
+  zint_hash_allocator_test();
+
+  return 0;
+}
@@ -0,0 +1,169 @@
+// strdup and pthread_rwlock_t with -std=c11
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include "../src/zsharded_hash.h"
+#include "./ztest_allocator.h"
+
+#define THREAD_COUNT 8
+#define KEYS_PER_THREAD 2000
+
+struct ThreadArgs {
+  struct ZShardedHashTable *hash_table;
+  char **keys;
+};
+
+// generate strings of random  ASCII characters 64 to 126
+// between 5 and 20 characters
+static char *random_string()
+{
+  size_t length, ii;
+  char *str;
+
+  length = rand() % 15 + 5;
+  str = malloc((length + 1) * sizeof(char));
+
+  for (ii = 0; ii < length; ii++) {
+    str[ii] = rand() % 62 + 64;
+  }
+  str[length] = '\0';
+
+  return str;
+}
+
+// every thread sets its own keys, reads them back, then deletes half of them
+static void *writer_thread(void *arg)
+{
+  struct ThreadArgs *args;
+  size_t ii;
+
+  args = (struct ThreadArgs *) arg;
+
+  for (ii = 0; ii < KEYS_PER_THREAD; ii++) {
+    zsharded_hash_set(args->hash_table, args->keys[ii], (void *) args->keys[ii]);
+  }
+
+  for (ii = 0; ii < KEYS_PER_THREAD; ii++) {
+    assert(zsharded_hash_get(args->hash_table, args->keys[ii]) == args->keys[ii]);
+  }
+
+  for (ii = 0; ii < KEYS_PER_THREAD; ii += 2) {
+    assert(zsharded_hash_delete(args->hash_table, args->keys[ii]) == args->keys[ii]);
+  }
+
+  return NULL;
+}
+
+static void zsharded_hash_test()
+{
+  size_t ii, jj;
+  char *keys[THREAD_COUNT][KEYS_PER_THREAD];
+  char key[32];
+  pthread_t threads[THREAD_COUNT];
+  struct ThreadArgs args[THREAD_COUNT];
+  struct ZShardedHashTable *hash_table;
+
+  hash_table = zcreate_sharded_hash_table(5);
+
+  assert(hash_table->shard_bits == 3);
+
+  // keys are unique per thread
+  for (ii = 0; ii < THREAD_COUNT; ii++) {
+    for (jj = 0; jj < KEYS_PER_THREAD; jj++) {
+      snprintf(key, sizeof(key), "%zu:%zu", ii, jj);
+      keys[ii][jj] = strdup(key);
+    }
+    args[ii].hash_table = hash_table;
+    args[ii].keys = keys[ii];
+  }
+
+  for (ii = 0; ii < THREAD_COUNT; ii++) {
+    assert(pthread_create(&threads[ii], NULL, writer_thread, &args[ii]) == 0);
+  }
+
+  for (ii = 0; ii < THREAD_COUNT; ii++) {
+    assert(pthread_join(threads[ii], NULL) == 0);
+  }
+
+  assert(zsharded_hash_count(hash_table) == THREAD_COUNT * KEYS_PER_THREAD / 2);
+
+  for (ii = 0; ii < THREAD_COUNT; ii++) {
+    for (jj = 0; jj < KEYS_PER_THREAD; jj++) {
+      assert(zsharded_hash_exists(hash_table, keys[ii][jj]) == (jj % 2 == 1));
+      free(keys[ii][jj]);
+    }
+  }
+
+  zfree_sharded_hash_table(hash_table);
+}
+
+static void zsharded_hash_exists_test()
+{
+  char *key;
+  struct ZShardedHashTable *hash_table;
+
+  hash_table = zcreate_sharded_hash_table(1);
+  key = random_string();
+
+  zsharded_hash_set(hash_table, "hello", (void *) "world");
+  zsharded_hash_set(hash_table, "nothing", NULL);
+  zsharded_hash_set(hash_table, key, (void *) key);
+
+  assert(zsharded_hash_exists(hash_table, "hello") == true);
+  assert(zsharded_hash_exists(hash_table, "nothing") == true);
+  assert(zsharded_hash_get(hash_table, "nothing") == NULL);
+  assert(zsharded_hash_get(hash_table, key) == key);
+  assert(zsharded_hash_exists(hash_table, "nope") == false);
+  assert(zsharded_hash_count(hash_table) == 3);
+
+  free(key);
+  zfree_sharded_hash_table(hash_table);
+}
+
+static void zsharded_hash_allocator_test()
+{
+  char key[300];
+  struct TestAllocator state;
+  struct ZAllocator allocator;
+  struct ZShardedHashTable *hash_table;
+
+  // each of the 4 shard tables needs two allocations; the shards built
+  // before the failure are freed
+  test_allocator_init(&allocator, &state, 7);
+  assert(zcreate_sharded_hash_table_with_allocator(4, &allocator) == NULL);
+  assert(state.live == 0);
+
+  // every shard shares the allocator; a long key needs its own entry
+  state.remaining = 8;
+  hash_table = zcreate_sharded_hash_table_with_allocator(4, &allocator);
+  assert(hash_table != NULL);
+
+  memset(key, 'x', sizeof(key) - 1);
+  key[sizeof(key) - 1] = '\0';
+  assert(zsharded_hash_set(hash_table, key, (void *) key) == ZHASH_NO_MEMORY);
+  assert(zsharded_hash_count(hash_table) == 0);
+  assert(zsharded_hash_exists(hash_table, key) == false);
+
+  state.remaining = SIZE_MAX;
+  assert(zsharded_hash_set(hash_table, key, (void *) key) == ZHASH_OK);
+  assert(zsharded_hash_get(hash_table, key) == key);
+
+  zfree_sharded_hash_table(hash_table);
+  assert(state.live == 0);
+}
+
+int main()
+{
+  zsharded_hash_test();
+  zsharded_hash_exists_test();
+  zsharded_hash_allocator_test();
+
+  return 0;
+}
@@ -4,6 +4,7 @@
 #include <assert.h>
 #include <stdbool.h>
 #include "../src/zsorted_hash.h"
+#include "./ztest_allocator.h"
 
 // generate strings of random  ASCII characters 64 to 126
 // between 5 and 20 characters
@@ -183,12 +184,445 @@ static void ziterator_test()
   zfree_sorted_hash_table(hash_table);
 }
 
+// check that the table is in key order and that lower and upper bounds agree
+// with a linear search
+static void check_key_order(struct ZSortedHashTable *hash_table)
+{
+  size_t count, ii;
+  char **keys, probe[16];
+  struct ZIterator *iterator;
+
+  count = zsorted_hash_count(hash_table);
+  keys = malloc((count + 1) * sizeof(char *));
+
+  ii = 0;
+  for (iterator = zcreate_iterator(hash_table);
+      ziterator_exists(iterator); ziterator_next(iterator)) {
+    keys[ii] = ziterator_get_key(iterator);
+    assert(ii == 0 || strcmp(keys[ii - 1], keys[ii]) < 0);
+    ii++;
+  }
+  zfree_iterator(iterator);
+
+  assert(ii == count);
+
+  for (ii = 0; ii < 200; ii++) {
+    size_t lower, upper;
+
+    snprintf(probe, sizeof(probe), "k%d", rand() % 1000);
+
+    for (lower = 0; lower < count && strcmp(keys[lower], probe) < 0; lower++);
+    for (upper = lower; upper < count && strcmp(keys[upper], probe) <= 0;
+        upper++);
+
+    iterator = zsorted_hash_lower_bound(hash_table, probe);
+    assert(ziterator_get_key(iterator) == (lower < count ? keys[lower] : NULL));
+    zfree_iterator(iterator);
+
+    iterator = zsorted_hash_upper_bound(hash_table, probe);
+    assert(ziterator_get_key(iterator) == (upper < count ? keys[upper] : NULL));
+    if (upper == count && count > 0) {
+      ziterator_prev(iterator);
+      assert(ziterator_get_key(iterator) == keys[count - 1]);
+    }
+    zfree_iterator(iterator);
+  }
+
+  free(keys);
+}
+
+static void zsorted_hash_key_order_test()
+{
+  size_t size, ii, prefix_count;
+  char **keys;
+  struct ZSortedHashTable *hash_table;
+  struct ZIterator *iterator;
+
+  size = 2000;
+  hash_table = zcreate_sorted_hash_table_with_order(ZKEY_ORDER);
+  keys = malloc(size * sizeof(char *));
+
+  check_key_order(hash_table);
+
+  for (ii = 0; ii < size; ii++) {
+    keys[ii] = malloc(16);
+    snprintf(keys[ii], 16, "k%d", rand() % 1000);
+    zsorted_hash_set(hash_table, keys[ii], (void *) keys[ii]);
+  }
+
+  check_key_order(hash_table);
+
+  // every key starting with "k12" sorts between "k12" and "k13"
+  prefix_count = 0;
+  for (iterator = zsorted_hash_lower_bound(hash_table, "k12");
+      ziterator_exists(iterator) &&
+      strncmp(ziterator_get_key(iterator), "k12", 3) == 0;
+      ziterator_next(iterator)) {
+    prefix_count++;
+  }
+  zfree_iterator(iterator);
+
+  for (iterator = zcreate_iterator(hash_table);
+      ziterator_exists(iterator); ziterator_next(iterator)) {
+    if (strncmp(ziterator_get_key(iterator), "k12", 3) == 0) prefix_count--;
+  }
+  zfree_iterator(iterator);
+
+  assert(prefix_count == 0);
+
+  for (ii = 0; ii < size; ii += 2) zsorted_hash_delete(hash_table, keys[ii]);
+
+  check_key_order(hash_table);
+
+  for (ii = 0; ii < size; ii++) zsorted_hash_delete(hash_table, keys[ii]);
+
+  assert(zsorted_hash_count(hash_table) == 0);
+  assert(hash_table->skip_level == 0);
+
+  iterator = zsorted_hash_lower_bound(hash_table, "k");
+  assert(ziterator_exists(iterator) == false);
+  zfree_iterator(iterator);
+
+  for (ii = 0; ii < size; ii++) free(keys[ii]);
+
+  free(keys);
+  zfree_sorted_hash_table(hash_table);
+
+  hash_table = zcreate_sorted_hash_table();
+  assert(zsorted_hash_lower_bound(hash_table, "k") == NULL);
+  zfree_sorted_hash_table(hash_table);
+}
+
+static void count_eviction(char *key, void *val, void *ctx)
+{
+  (void) key;
+
+  assert(val != NULL);
+  (*(size_t *) ctx)++;
+}
+
+static size_t value_size(void *val)
+{
+  return strlen((char *) val) + 1;
+}
+
+static void zsorted_hash_cache_test()
+{
+  size_t size, evicted, ii;
+  char **keys;
+  struct ZSortedHashTable *hash_table;
+  struct ZCachePolicy policy = { 10, 0, NULL, count_eviction, NULL };
+
+  size = 20;
+  evicted = 0;
+  policy.ctx = &evicted;
+  hash_table = zcreate_sorted_hash_table();
+  keys = malloc(size * sizeof(char *));
+
+  zsorted_hash_set_cache_policy(hash_table, &policy);
+
+  for (ii = 0; ii < size; ii++) {
+    keys[ii] = malloc(16);
+    snprintf(keys[ii], 16, "key%zu", ii);
+  }
+
+  for (ii = 0; ii < 10; ii++) {
+    zsorted_hash_set(hash_table, keys[ii], (void *) keys[ii]);
+  }
+
+  // using key0 and setting key1 again makes key2 the least recently used
+  assert(zsorted_hash_get(hash_table, keys[0]) == keys[0]);
+  zsorted_hash_set(hash_table, keys[1], (void *) keys[1]);
+  assert(zsorted_hash_exists(hash_table, keys[2]) == true);
+
+  zsorted_hash_set(hash_table, keys[10], (void *) keys[10]);
+
+  assert(evicted == 1);
+  assert(zsorted_hash_count(hash_table) == 10);
+  assert(zsorted_hash_exists(hash_table, keys[2]) == false);
+  assert(zsorted_hash_exists(hash_table, keys[0]) == true);
+  assert(zsorted_hash_exists(hash_table, keys[1]) == true);
+
+  for (ii = 11; ii < size; ii++) {
+    zsorted_hash_set(hash_table, keys[ii], (void *) keys[ii]);
+  }
+
+  assert(evicted == 10);
+  assert(zsorted_hash_count(hash_table) == 10);
+
+  // a byte limit that holds fewer entries evicts right away
+  policy.max_entries = 0;
+  policy.max_bytes = 5 * (hash_table->byte_count / 10) + 1;
+  policy.val_size = value_size;
+  zsorted_hash_set_cache_policy(hash_table, &policy);
+
+  assert(zsorted_hash_count(hash_table) < 10);
+  assert(hash_table->byte_count <= policy.max_bytes);
+
+  for (ii = 0; ii < size; ii++) {
+    zsorted_hash_set(hash_table, keys[ii], (void *) keys[ii]);
+    assert(hash_table->byte_count <= policy.max_bytes);
+  }
+
+  assert(zsorted_hash_get(hash_table, keys[size - 1]) == keys[size - 1]);
+  assert(evicted + zsorted_hash_count(hash_table) == 10 + 2 * size - 10);
+
+  for (ii = 0; ii < size; ii++) zsorted_hash_delete(hash_table, keys[ii]);
+
+  assert(hash_table->byte_count == 0);
+
+  for (ii = 0; ii < size; ii++) free(keys[ii]);
+
+  free(keys);
+  zfree_sorted_hash_table(hash_table);
+}
+
+// check that exactly the entries with expire_at[i] > now are in the table
+static void check_expired(struct ZSortedHashTable *hash_table, char **keys,
+    uint64_t *expire_at, size_t size, uint64_t now)
+{
+  size_t live, ii;
+  struct ZIterator *iterator;
+
+  live = 0;
+  for (ii = 0; ii < size; ii++) {
+    if (expire_at[ii] > now) live++;
+  }
+
+  assert(zsorted_hash_count(hash_table) == live);
+
+  for (iterator = zcreate_iterator(hash_table);
+      ziterator_exists(iterator); ziterator_next(iterator)) {
+    assert(expire_at[(size_t) ziterator_get_val(iterator)] > now);
+  }
+  zfree_iterator(iterator);
+
+  for (ii = 0; ii < size; ii++) {
+    assert(zsorted_hash_exists(hash_table, keys[ii]) == (expire_at[ii] > now));
+  }
+}
+
+static void zsorted_hash_ttl_test(enum ZSortedOrder order)
+{
+  size_t size, expired, ii;
+  uint64_t now, *expire_at;
+  char **keys;
+  struct ZSortedHashTable *hash_table;
+
+  size = 2000;
+  expired = 0;
+  hash_table = zcreate_sorted_hash_table_with_ttl(order, count_eviction,
+      &expired);
+  keys = malloc(size * sizeof(char *));
+  expire_at = malloc(size * sizeof(uint64_t));
+
+  now = 1000;
+
+  for (ii = 0; ii < size; ii++) {
+    keys[ii] = malloc(16);
+    snprintf(keys[ii], 16, "key%zu", ii);
+
+    // some entries expire after the range of the wheel and some never expire
+    if (ii % 10 == 0) {
+      expire_at[ii] = UINT64_MAX;
+      zsorted_hash_set(hash_table, keys[ii], (void *) ii);
+    } else {
+      expire_at[ii] = now + (ii % 10 == 1 ?
+          20000000 : (uint64_t) rand() % 300000);
+      zsorted_hash_set_with_ttl(hash_table, keys[ii], (void *) ii, now,
+          expire_at[ii] - now);
+    }
+  }
+
+  // setting a key without a ttl keeps it forever
+  zsorted_hash_set(hash_table, keys[3], (void *) (size_t) 3);
+  expire_at[3] = UINT64_MAX;
+
+  // at most max_work entries are removed per call
+  now += 200000;
+  assert(zsorted_hash_expire(hash_table, now, 10) <= 10);
+  assert(zsorted_hash_get(hash_table, keys[size - 1]) ==
+      (expire_at[size - 1] > now ? (void *) (size - 1) : NULL));
+
+  while (zsorted_hash_expire(hash_table, now, 10) > 0);
+
+  check_expired(hash_table, keys, expire_at, size, now);
+  assert(expired == size - zsorted_hash_count(hash_table));
+
+  for (now += 1; now < 30000000; now += (uint64_t) rand() % 500000) {
+    zsorted_hash_expire(hash_table, now, size);
+    check_expired(hash_table, keys, expire_at, size, now);
+  }
+
+  assert(zsorted_hash_count(hash_table) == size / 10 + 1);
+  assert(hash_table->wheel->timer_count == 0);
+  assert(expired == size - size / 10 - 1);
+
+  for (ii = 0; ii < size; ii++) free(keys[ii]);
+
+  free(keys);
+  free(expire_at);
+  zfree_sorted_hash_table(hash_table);
+}
+
+static void zsorted_hash_ttl_replace_test(enum ZSortedOrder order)
+{
+  size_t expired;
+  struct ZSortedHashTable *hash_table;
+  struct ZIterator *iterator;
+
+  expired = 0;
+  hash_table = zcreate_sorted_hash_table_with_ttl(order, count_eviction,
+      &expired);
+
+  zsorted_hash_set_with_ttl(hash_table, "b", (void *) "b", 0, 10);
+  zsorted_hash_set_with_ttl(hash_table, "c", (void *) "c", 0, 10);
+  zsorted_hash_set(hash_table, "a", (void *) "a");
+
+  // moves the wheel's time past the expiry of b and c without reaping them
+  zsorted_hash_set_with_ttl(hash_table, "a", (void *) "a", 100, 1000);
+  assert(zsorted_hash_count(hash_table) == 3);
+
+  // deleting an expired entry reaps it
+  assert(zsorted_hash_delete(hash_table, "b") == NULL);
+  assert(expired == 1);
+
+  // setting an expired key reaps it and adds a new entry, which does not
+  // expire and goes to the end of the insertion order
+  zsorted_hash_set(hash_table, "c", (void *) "new c");
+  assert(expired == 2);
+  assert(zsorted_hash_count(hash_table) == 2);
+  assert(strcmp(zsorted_hash_get(hash_table, "c"), "new c") == 0);
+
+  iterator = zcreate_iterator(hash_table);
+  assert(strcmp(ziterator_get_key(iterator), "a") == 0);
+  ziterator_next(iterator);
+  assert(strcmp(ziterator_get_key(iterator), "c") == 0);
+  ziterator_next(iterator);
+  assert(ziterator_exists(iterator) == false);
+  zfree_iterator(iterator);
+
+  assert(zsorted_hash_expire(hash_table, 2000, 100) == 1);
+  assert(zsorted_hash_get(hash_table, "c") != NULL);
+  assert(expired == 3);
+
+  zfree_sorted_hash_table(hash_table);
+}
+
+static void zsorted_hash_ttl_due_test(enum ZSortedOrder order)
+{
+  size_t expired;
+  struct ZSortedHashTable *hash_table;
+
+  expired = 0;
+  hash_table = zcreate_sorted_hash_table_with_ttl(order, count_eviction,
+      &expired);
+
+  // entries that are already due when they are set, on an empty wheel
+  assert(zsorted_hash_expire(hash_table, 10, 100) == 0);
+  zsorted_hash_set_with_ttl(hash_table, "a", (void *) "a", 10, 0);
+  zsorted_hash_set_with_ttl(hash_table, "b", (void *) "b", 5, 3);
+  assert(zsorted_hash_expire(hash_table, 10, 100) == 2);
+  assert(zsorted_hash_count(hash_table) == 0);
+  assert(expired == 2);
+
+  // and on a wheel that still has timers
+  zsorted_hash_set_with_ttl(hash_table, "c", (void *) "c", 10, 1000);
+  assert(zsorted_hash_expire(hash_table, 20, 100) == 0);
+  zsorted_hash_set_with_ttl(hash_table, "a", (void *) "a", 20, 0);
+  zsorted_hash_set_with_ttl(hash_table, "b", (void *) "b", 15, 1);
+  assert(zsorted_hash_expire(hash_table, 20, 100) == 2);
+  assert(zsorted_hash_count(hash_table) == 1);
+  assert(expired == 4);
+
+  assert(zsorted_hash_expire(hash_table, 1010, 100) == 1);
+  assert(expired == 5);
+
+  zfree_sorted_hash_table(hash_table);
+}
+
+// without a timer wheel, set_with_ttl sets the key without an expiry time
+static void zsorted_hash_ttl_without_wheel_test()
+{
+  struct ZSortedHashTable *hash_table;
+
+  hash_table = zcreate_sorted_hash_table();
+
+  assert(zsorted_hash_set_with_ttl(hash_table, "a", (void *) "a", 0, 1) ==
+      ZHASH_OK);
+  assert(zsorted_hash_expire(hash_table, 100, 100) == 0);
+  assert(strcmp(zsorted_hash_get(hash_table, "a"), "a") == 0);
+
+  zfree_sorted_hash_table(hash_table);
+}
+
+static void zsorted_hash_allocator_test()
+{
+  size_t size, ii, count;
+  char key[16];
+  struct TestAllocator state;
+  struct ZAllocator allocator;
+  struct ZSortedHashTable *hash_table;
+
+  test_allocator_init(&allocator, &state, 2);
+  assert(zcreate_sorted_hash_table_with_allocator(ZKEY_ORDER, &allocator) ==
+      NULL);
+  assert(state.live == 0);
+
+  // towers that cannot be allocated leave entries in level 0 only
+  size = 100000;
+  state.remaining = 200;
+  hash_table = zcreate_sorted_hash_table_with_allocator(ZKEY_ORDER, &allocator);
+  assert(hash_table != NULL);
+
+  for (ii = 0; ii < size; ii++) {
+    snprintf(key, sizeof(key), "k%zu", ii);
+    if (zsorted_hash_set(hash_table, key, NULL) != ZHASH_OK) break;
+  }
+
+  assert(ii < size);
+  count = ii;
+  assert(zsorted_hash_count(hash_table) == count);
+  assert(zsorted_hash_exists(hash_table, key) == false);
+  check_key_order(hash_table);
+
+  state.remaining = SIZE_MAX;
+
+  for (ii = count; ii < size; ii++) {
+    snprintf(key, sizeof(key), "k%zu", ii);
+    assert(zsorted_hash_set(hash_table, key, NULL) == ZHASH_OK);
+  }
+
+  assert(zsorted_hash_count(hash_table) == size);
+  check_key_order(hash_table);
+
+  for (ii = 0; ii < size; ii += 2) {
+    snprintf(key, sizeof(key), "k%zu", ii);
+    zsorted_hash_delete(hash_table, key);
+  }
+
+  check_key_order(hash_table);
+
+  zfree_sorted_hash_table(hash_table);
+  assert(state.live == 0);
+}
+
 int main()
 {
   zsorted_hash_set_test();
   zsorted_hash_delete_test();
   zsorted_hash_exists_test();
   ziterator_test();
+  zsorted_hash_key_order_test();
+  zsorted_hash_cache_test();
+  zsorted_hash_ttl_test(ZINSERTION_ORDER);
+  zsorted_hash_ttl_test(ZKEY_ORDER);
+  zsorted_hash_ttl_replace_test(ZINSERTION_ORDER);
+  zsorted_hash_ttl_replace_test(ZKEY_ORDER);
+  zsorted_hash_ttl_due_test(ZINSERTION_ORDER);
+  zsorted_hash_ttl_due_test(ZKEY_ORDER);
+  zsorted_hash_ttl_without_wheel_test();
+  zsorted_hash_allocator_test();
 
   return 0;
 }
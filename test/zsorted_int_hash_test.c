@@ -0,0 +1,306 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <assert.h>
+#include <stdbool.h>
+#include "../src/zsorted_int_hash.h"
+#include "./ztest_allocator.h"
+
+static void zsorted_int_hash_set_test()
+{
+  size_t size, ii;
+  uint64_t *keys;
+  struct ZSortedIntHashTable *hash_table;
+
+  size = 1000;
+  hash_table = zcreate_sorted_int_hash_table();
+  keys = malloc(size * sizeof(uint64_t));
+
+  for (ii = 0; ii < size; ii++) {
+    keys[ii] = ii * 7919;
+    zsorted_int_hash_set(hash_table, keys[ii], (void *) &keys[ii]);
+  }
+
+  assert(zsorted_int_hash_count(hash_table) == size);
+
+  for (ii = 0; ii < size; ii++) {
+    assert(zsorted_int_hash_get(hash_table, keys[ii]) == &keys[ii]);
+    assert(zsorted_int_hash_exists(hash_table, keys[ii]) == true);
+    assert(zsorted_int_hash_exists(hash_table, keys[ii] + 1) == false);
+  }
+
+  free(keys);
+  zfree_sorted_int_hash_table(hash_table);
+}
+
+static void zsorted_int_hash_delete_test()
+{
+  size_t size, ii;
+  uint64_t *keys;
+  struct ZSortedIntHashTable *hash_table;
+
+  size = 1000;
+  hash_table = zcreate_sorted_int_hash_table();
+  keys = malloc(size * sizeof(uint64_t));
+
+  for (ii = 0; ii < size; ii++) {
+    keys[ii] = ii;
+    zsorted_int_hash_set(hash_table, keys[ii], (void *) &keys[ii]);
+  }
+
+  for (ii = 0; ii < size; ii += 2) {
+    assert(zsorted_int_hash_delete(hash_table, keys[ii]) == &keys[ii]);
+    assert(zsorted_int_hash_delete(hash_table, keys[ii]) == NULL);
+  }
+
+  assert(zsorted_int_hash_count(hash_table) == size / 2);
+
+  // deleted nodes are reused, so the node array does not grow
+  for (ii = 0; ii < size; ii += 2) {
+    zsorted_int_hash_set(hash_table, keys[ii], (void *) &keys[ii]);
+  }
+
+  assert(zsorted_int_hash_count(hash_table) == size);
+  assert(hash_table->node_count == size);
+
+  for (ii = 0; ii < size; ii++) {
+    assert(zsorted_int_hash_get(hash_table, keys[ii]) == &keys[ii]);
+  }
+
+  free(keys);
+  zfree_sorted_int_hash_table(hash_table);
+}
+
+static void zsorted_int_iterator_test()
+{
+  size_t size, ii;
+  uint64_t *keys;
+  struct ZSortedIntHashTable *hash_table;
+  struct ZSortedIntIterator *iterator;
+
+  size = 100;
+  hash_table = zcreate_sorted_int_hash_table();
+  keys = malloc(size * sizeof(uint64_t));
+
+  iterator = zcreate_sorted_int_iterator(hash_table);
+  assert(zsorted_int_iterator_exists(iterator) == false);
+  zsorted_int_iterator_next(iterator);
+  zsorted_int_iterator_prev(iterator);
+  assert(zsorted_int_iterator_exists(iterator) == false);
+  zfree_sorted_int_iterator(iterator);
+
+  // keys are inserted in decreasing order, so insertion order differs from
+  // key order
+  for (ii = 0; ii < size; ii++) {
+    keys[ii] = size - ii;
+    zsorted_int_hash_set(hash_table, keys[ii], (void *) &keys[ii]);
+  }
+
+  // updating a value keeps the position of its key
+  zsorted_int_hash_set(hash_table, keys[0], (void *) &keys[0]);
+
+  iterator = zcreate_sorted_int_iterator(hash_table);
+
+  for (ii = 0; ii < size; ii++) {
+    assert(zsorted_int_iterator_exists(iterator) == true);
+    assert(zsorted_int_iterator_get_key(iterator) == keys[ii]);
+    assert(zsorted_int_iterator_get_val(iterator) == &keys[ii]);
+
+    zsorted_int_iterator_next(iterator);
+  }
+
+  assert(zsorted_int_iterator_exists(iterator) == false);
+  assert(zsorted_int_iterator_get_key(iterator) == 0);
+  assert(zsorted_int_iterator_get_val(iterator) == NULL);
+
+  zsorted_int_iterator_next(iterator);
+  zsorted_int_iterator_prev(iterator);
+
+  for (ii = size; ii-- > 0;) {
+    assert(zsorted_int_iterator_exists(iterator) == true);
+    assert(zsorted_int_iterator_get_key(iterator) == keys[ii]);
+    assert(zsorted_int_iterator_get_val(iterator) == &keys[ii]);
+
+    zsorted_int_iterator_prev(iterator);
+  }
+
+  assert(zsorted_int_iterator_exists(iterator) == false);
+  zsorted_int_iterator_next(iterator);
+  assert(zsorted_int_iterator_get_key(iterator) == keys[0]);
+  zfree_sorted_int_iterator(iterator);
+
+  // a deleted and reinserted key moves to the end
+  zsorted_int_hash_delete(hash_table, keys[0]);
+  zsorted_int_hash_delete(hash_table, keys[size - 1]);
+  zsorted_int_hash_set(hash_table, keys[0], (void *) &keys[0]);
+
+  iterator = zcreate_sorted_int_iterator(hash_table);
+
+  for (ii = 1; ii < size - 1; ii++) {
+    assert(zsorted_int_iterator_get_key(iterator) == keys[ii]);
+    zsorted_int_iterator_next(iterator);
+  }
+
+  assert(zsorted_int_iterator_get_key(iterator) == keys[0]);
+  zsorted_int_iterator_next(iterator);
+  assert(zsorted_int_iterator_exists(iterator) == false);
+
+  free(keys);
+  zfree_sorted_int_iterator(iterator);
+  zfree_sorted_int_hash_table(hash_table);
+}
+
+// deleting most entries shrinks the node array, without changing the
+// insertion order or invalidating iterators
+static void zsorted_int_hash_compact_test()
+{
+  size_t size, capacity, ii;
+  uint64_t *keys;
+  struct ZSortedIntHashTable *hash_table;
+  struct ZSortedIntIterator *iterator;
+
+  size = 1000;
+  hash_table = zcreate_sorted_int_hash_table();
+  keys = malloc(size * sizeof(uint64_t));
+
+  for (ii = 0; ii < size; ii++) {
+    keys[ii] = size - ii;
+    zsorted_int_hash_set(hash_table, keys[ii], (void *) &keys[ii]);
+  }
+
+  capacity = hash_table->node_capacity;
+  iterator = zcreate_sorted_int_iterator(hash_table);
+
+  // move the iterator to the last entry, then delete all but every 16th
+  // entry
+  for (ii = 0; ii < size - 1; ii++) zsorted_int_iterator_next(iterator);
+
+  for (ii = 0; ii < size; ii++) {
+    if (ii % 16 == 0 || ii == size - 1) continue;
+    assert(zsorted_int_hash_delete(hash_table, keys[ii]) == &keys[ii]);
+  }
+
+  assert(hash_table->node_capacity < capacity);
+  assert(zsorted_int_hash_count(hash_table) * 4 >= hash_table->node_capacity);
+  assert(hash_table->node_count <= hash_table->node_capacity);
+
+  for (ii = 0; ii < size; ii++) {
+    if (ii % 16 == 0 || ii == size - 1) {
+      assert(zsorted_int_hash_get(hash_table, keys[ii]) == &keys[ii]);
+    } else {
+      assert(zsorted_int_hash_exists(hash_table, keys[ii]) == false);
+    }
+  }
+
+  // the iterator walks back from where it was
+  for (ii = size; ii-- > 0;) {
+    if (ii % 16 != 0 && ii != size - 1) continue;
+
+    assert(zsorted_int_iterator_exists(iterator) == true);
+    assert(zsorted_int_iterator_get_key(iterator) == keys[ii]);
+    assert(zsorted_int_iterator_get_val(iterator) == &keys[ii]);
+    zsorted_int_iterator_prev(iterator);
+  }
+
+  assert(zsorted_int_iterator_exists(iterator) == false);
+  zfree_sorted_int_iterator(iterator);
+
+  // deleting everything leaves an empty, usable table
+  for (ii = 0; ii < size; ii++) zsorted_int_hash_delete(hash_table, keys[ii]);
+
+  assert(zsorted_int_hash_count(hash_table) == 0);
+  assert(hash_table->node_capacity == ZINT_MIN_SIZE);
+
+  zsorted_int_hash_set(hash_table, keys[0], (void *) &keys[0]);
+  iterator = zcreate_sorted_int_iterator(hash_table);
+  assert(zsorted_int_iterator_get_key(iterator) == keys[0]);
+  zsorted_int_iterator_next(iterator);
+  assert(zsorted_int_iterator_exists(iterator) == false);
+
+  free(keys);
+  zfree_sorted_int_iterator(iterator);
+  zfree_sorted_int_hash_table(hash_table);
+}
+
+static void zsorted_int_hash_allocator_test()
+{
+  size_t size, capacity, ii;
+  uint64_t *keys;
+  struct TestAllocator state;
+  struct ZAllocator allocator;
+  struct ZSortedIntHashTable *hash_table;
+  struct ZSortedIntIterator *iterator;
+  enum ZHashStatus status;
+
+  // the integer hash table, its slots, the table and its nodes are four
+  // allocations
+  test_allocator_init(&allocator, &state, 3);
+  assert(zcreate_sorted_int_hash_table_with_allocator(&allocator) == NULL);
+  assert(state.live == 0);
+
+  state.remaining = 10;
+  hash_table = zcreate_sorted_int_hash_table_with_allocator(&allocator);
+  assert(hash_table != NULL);
+
+  size = 100000;
+  keys = malloc(size * sizeof(uint64_t));
+  status = ZHASH_OK;
+
+  // growing the slots or the nodes uses up one allocation
+  for (ii = 0; ii < size && status == ZHASH_OK; ii++) {
+    keys[ii] = ii + 1;
+    status = zsorted_int_hash_set(hash_table, keys[ii], (void *) &keys[ii]);
+  }
+
+  // the failed insertion left the entries and their order unchanged
+  assert(status == ZHASH_NO_MEMORY);
+  size = ii;
+  assert(zsorted_int_hash_count(hash_table) == size - 1);
+  assert(zsorted_int_hash_exists(hash_table, keys[size - 1]) == false);
+
+  iterator = zcreate_sorted_int_iterator(hash_table);
+  for (ii = 0; ii < size - 1; ii++) {
+    assert(zsorted_int_iterator_get_key(iterator) == keys[ii]);
+    assert(zsorted_int_iterator_get_val(iterator) == &keys[ii]);
+    zsorted_int_iterator_next(iterator);
+  }
+  assert(zsorted_int_iterator_exists(iterator) == false);
+  zfree_sorted_int_iterator(iterator);
+
+  state.remaining = SIZE_MAX;
+  assert(zsorted_int_hash_set(hash_table, keys[size - 1],
+        (void *) &keys[size - 1]) == ZHASH_OK);
+  assert(zsorted_int_hash_get(hash_table, keys[size - 1]) == &keys[size - 1]);
+  assert(zsorted_int_hash_count(hash_table) == size);
+
+  // fill the nodes, then overwrite without memory; only a new key needs a node
+  ii = size + 1;
+  while (hash_table->node_count < hash_table->node_capacity) {
+    assert(zsorted_int_hash_set(hash_table, ii++, NULL) == ZHASH_OK);
+  }
+  size = zsorted_int_hash_count(hash_table);
+  capacity = hash_table->node_capacity;
+  state.remaining = 0;
+  assert(zsorted_int_hash_set(hash_table, keys[0], NULL) == ZHASH_OK);
+  assert(zsorted_int_hash_get(hash_table, keys[0]) == NULL);
+  assert(hash_table->node_capacity == capacity);
+  assert(zsorted_int_hash_set(hash_table, ii, NULL) == ZHASH_NO_MEMORY);
+  assert(zsorted_int_hash_exists(hash_table, ii) == false);
+  assert(zsorted_int_hash_count(hash_table) == size);
+
+  zfree_sorted_int_hash_table(hash_table);
+  assert(state.live == 0);
+
+  free(keys);
+}
+
+int main()
+{
+  zsorted_int_hash_set_test();
+  zsorted_int_hash_delete_test();
+  zsorted_int_iterator_test();
+  zsorted_int_hash_compact_test();
+  zsorted_int_hash_allocator_test();
+
+  return 0;
+}
@@ -0,0 +1,48 @@
+#ifndef ZTEST_ALLOCATOR_H
+#define ZTEST_ALLOCATOR_H
+
+// allocator shared by the allocator tests; it fails once its budget of
+// allocations is used up and counts the allocations still live
+
+#include <stdlib.h>
+#include "../src/zhash.h"
+
+struct TestAllocator {
+  size_t remaining;
+  size_t live;
+};
+
+static void *test_alloc(size_t size, void *ctx)
+{
+  struct TestAllocator *state;
+
+  state = (struct TestAllocator *) ctx;
+
+  if (state->remaining == 0) return NULL;
+
+  state->remaining--;
+  state->live++;
+
+  return malloc(size);
+}
+
+static void test_free(void *ptr, void *ctx)
+{
+  ((struct TestAllocator *) ctx)->live--;
+  free(ptr);
+}
+
+// point allocator at state, with a budget of remaining allocations
+static void test_allocator_init(struct ZAllocator *allocator,
+    struct TestAllocator *state, size_t remaining)
+{
+  allocator->alloc = test_alloc;
+  allocator->calloc = NULL;
+  allocator->free = test_free;
+  allocator->ctx = state;
+
+  state->remaining = remaining;
+  state->live = 0;
+}
+
+#endif